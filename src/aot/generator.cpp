@@ -0,0 +1,349 @@
+#include "generator.h"
+
+#include "plugin.h"
+
+#include "../jit.h"
+#include "../version.h"
+#include "../memory/header.h"
+#include "../memory/memory.h"
+
+#include <sstream>
+#include <vector>
+
+namespace {
+    std::string hex(uint32_t value) {
+        std::ostringstream out;
+        out << "0x" << std::hex << value;
+        return out.str();
+    }
+
+    std::string label(uint32_t index) {
+        return "i" + std::to_string(index);
+    }
+
+    std::string signed_value(const std::string &value) {
+        return "static_cast<int16_t>(" + value + ")";
+    }
+}
+
+template<uint8_t Version>
+zm::AotGenerator<Version>::AotGenerator(zm::Memory &memory) :
+    memory(memory),
+    decoder(memory),
+    translator(memory, Header(memory).static_memory_base_address()) {
+    Header header { memory };
+
+    static_memory_base = header.static_memory_base_address();
+    global_variables_address = header.global_variables_address();
+    routines_offset = memory.read_word(0x28);
+
+    // The length is stored divided by 2, 4 or 8, and missing from the oldest stories
+    file_length = static_cast<uint32_t>(memory.read_word(0x1A)) << (Version <= 3 ? 1 : (Version <= 5 ? 2 : 3));
+
+    if (file_length == 0 || file_length > memory.capacity()) {
+        file_length = memory.capacity();
+    }
+}
+
+/*
+ * Collects the constant call targets of the code reachable from start.
+ */
+template<uint8_t Version>
+void zm::AotGenerator<Version>::scan(zm::address start, std::vector<zm::word> &calls) {
+    std::set<address> seen;
+    std::vector<address> pending { start };
+
+    while (!pending.empty() && seen.size() < MAX_TRANSLATED_INSTRUCTIONS) {
+        address pc = pending.back();
+        pending.pop_back();
+
+        if (pc >= file_length || !seen.insert(pc).second) {
+            continue;
+        }
+
+        DecodedInstruction decoded = decoder.decode(pc);
+        Mnemonic mnemonic = decoded.instruction.mnemonic;
+
+        switch (mnemonic) {
+            case Mnemonic::CALL : case Mnemonic::CALL_VS : case Mnemonic::CALL_VS2 : case Mnemonic::CALL_VN :
+            case Mnemonic::CALL_VN2 : case Mnemonic::CALL_1S : case Mnemonic::CALL_1N : case Mnemonic::CALL_2S :
+            case Mnemonic::CALL_2N :
+                if (decoded.operand_count > 0 && decoded.operands[0].type != OperandType::VARIABLE_NUMBER) {
+                    calls.push_back(decoded.operands[0].value);
+                }
+                break;
+            case Mnemonic::NULL_OP :
+                continue;
+            default :
+                break;
+        }
+
+        if (decoded.instruction.branch && decoded.branch_offset != 0 && decoded.branch_offset != 1) {
+            pending.push_back(decoded.next_pc + decoded.branch_offset - 2);
+        }
+
+        if (mnemonic == Mnemonic::JUMP && decoded.operands[0].type != OperandType::VARIABLE_NUMBER) {
+            pending.push_back(decoded.next_pc + static_cast<int16_t>(decoded.operands[0].value) - 2);
+        }
+
+        bool ends = mnemonic == Mnemonic::JUMP || mnemonic == Mnemonic::RET || mnemonic == Mnemonic::RTRUE ||
+                mnemonic == Mnemonic::RFALSE || mnemonic == Mnemonic::RET_POPPED || mnemonic == Mnemonic::PRINT_RET ||
+                mnemonic == Mnemonic::QUIT || mnemonic == Mnemonic::THROW || mnemonic == Mnemonic::RESTART;
+
+        if (!ends) {
+            pending.push_back(decoded.next_pc);
+        }
+    }
+}
+
+template<uint8_t Version>
+void zm::AotGenerator<Version>::discover() {
+    using Traits = VersionTraits<Version>;
+
+    std::vector<word> pending;
+
+    // Version 6 starts with a call to the main routine, the others somewhere in the code
+    if (Version == 6) {
+        pending.push_back(memory.read_word(0x06));
+    } else {
+        scan(memory.read_word(0x06), pending);
+    }
+
+    while (!pending.empty()) {
+        word packed = pending.back();
+        pending.pop_back();
+
+        address routine_address = Traits::unpack_routine(packed, routines_offset);
+
+        if (packed == 0 || routine_address >= file_length || !found.insert(packed).second) {
+            continue;
+        }
+
+        uint8_t locals = memory.read_byte(routine_address);
+
+        if (locals > 15) {
+            continue;
+        }
+
+        scan(routine_address + 1 + (Traits::routine_default_locals ? locals << 1 : 0), pending);
+
+        // Dynamic memory can change under the plugin
+        if (routine_address < static_memory_base) {
+            continue;
+        }
+
+        const TranslatedRoutine *translated = translator.translate(packed, routine_address);
+
+        if (!translated) {
+            continue;
+        }
+
+        for (const auto &ir : translated->code) {
+            if (Jit::compilable(ir)) {
+                compiled[packed] = translated;
+                break;
+            }
+        }
+    }
+}
+
+template<uint8_t Version>
+size_t zm::AotGenerator<Version>::generate(std::ostream &out, const std::string &story) {
+    discover();
+
+    Header header { memory };
+    std::string serial = header.serial();
+
+    out << "// Generated by zetamachine_aot from " << story << ", do not edit\n";
+    out << "#include \"aot/plugin.h\"\n\n";
+    out << "namespace {\n";
+    out << "    using zm::word;\n";
+
+    for (const auto &entry : compiled) {
+        routine(out, *entry.second);
+    }
+
+    out << "\n    const zm::AotRoutine routines[] = {\n";
+
+    for (const auto &entry : compiled) {
+        std::string name = hex(entry.first).substr(2);
+        out << "        { " << hex(entry.first) << ", " << entry.second->code.size() << ", entries_" << name << ", routine_" << name << " },\n";
+    }
+
+    out << "        { 0, 0, nullptr, nullptr }\n";
+    out << "    };\n\n";
+
+    out << "    const zm::AotStory story = { ZM_AOT_ABI, " << header.release() << ", { ";
+
+    for (size_t i = 0; i < serial.size(); ++i) {
+        out << (i ? ", " : "") << static_cast<int>(serial[i]);
+    }
+
+    out << " }, " << hex(header.checksum()) << ", " << compiled.size() << ", routines };\n";
+    out << "}\n\n";
+    out << "extern \"C\" const zm::AotStory *zm_aot_story() {\n";
+    out << "    return &story;\n";
+    out << "}\n";
+
+    return compiled.size();
+}
+
+template<uint8_t Version>
+void zm::AotGenerator<Version>::routine(std::ostream &out, const zm::TranslatedRoutine &routine) {
+    std::string name = hex(routine.packed).substr(2);
+    std::set<uint32_t> targets;
+
+    for (const auto &ir : routine.code) {
+        bool jumps = ir.instruction.branch || ir.instruction.mnemonic == Mnemonic::JUMP;
+
+        if (jumps && ir.target < IR_RETURN_FALSE) {
+            targets.insert(ir.target);
+        }
+    }
+
+    out << "\n    const uint8_t entries_" << name << "[] = {";
+
+    for (size_t i = 0; i < routine.code.size(); ++i) {
+        out << (i % 32 ? " " : "\n        ") << (Jit::compilable(routine.code[i]) ? 1 : 0) << ",";
+    }
+
+    out << "\n    };\n\n";
+    out << "    // Routine at " << hex(routine.begin) << "\n";
+    out << "    uint32_t routine_" << name << "(zm::AotState &s, uint32_t index) {\n";
+    out << "        switch (index) {\n";
+
+    for (uint32_t i = 0; i < routine.code.size(); ++i) {
+        if (Jit::compilable(routine.code[i])) {
+            out << "            case " << i << " : goto " << label(i) << ";\n";
+        }
+    }
+
+    out << "            default : return index;\n";
+    out << "        }\n";
+
+    for (uint32_t i = 0; i < routine.code.size(); ++i) {
+        const IrInstruction &ir = routine.code[i];
+
+        if (Jit::compilable(ir) || targets.count(i)) {
+            out << "\n    " << label(i) << ":\n";
+        }
+
+        instruction(out, i, ir);
+    }
+
+    out << "    }\n";
+}
+
+template<uint8_t Version>
+std::string zm::AotGenerator<Version>::read(const zm::Register &source) {
+    switch (source.type) {
+        case RegisterType::CONSTANT : return hex(source.value);
+        case RegisterType::LOCAL : return "s.locals[" + std::to_string(source.value) + "]";
+        case RegisterType::TEMPORARY : return "s.temporaries[" + std::to_string(source.value) + "]";
+        default : return "s.memory->read_word(" + hex(global_variables_address + (source.value << 1)) + ")";
+    }
+}
+
+template<uint8_t Version>
+std::string zm::AotGenerator<Version>::write(const zm::Register &destination, const std::string &value) {
+    switch (destination.type) {
+        case RegisterType::LOCAL : return "        s.locals[" + std::to_string(destination.value) + "] = " + value + ";\n";
+        case RegisterType::TEMPORARY : return "        s.temporaries[" + std::to_string(destination.value) + "] = " + value + ";\n";
+        case RegisterType::GLOBAL : return "        s.memory->write_word(" + hex(global_variables_address + (destination.value << 1)) + ", " + value + ");\n";
+        default : return "";
+    }
+}
+
+template<uint8_t Version>
+std::string zm::AotGenerator<Version>::branch(const zm::IrInstruction &ir, const std::string &condition) {
+    std::string test = ir.branch_on_true ? condition : "!(" + condition + ")";
+    return "        if (" + test + ") { goto " + label(ir.target) + "; }\n";
+}
+
+template<uint8_t Version>
+void zm::AotGenerator<Version>::instruction(std::ostream &out, uint32_t index, const zm::IrInstruction &ir) {
+    std::string exit = "return " + std::to_string(index) + ";";
+
+    if (!Jit::compilable(ir)) {
+        out << "        " << exit << "\n";
+        return;
+    }
+
+    Mnemonic mnemonic = ir.instruction.mnemonic;
+    std::string a = ir.operand_count > 0 ? read(ir.operands[0]) : "";
+    std::string b = ir.operand_count > 1 ? read(ir.operands[1]) : "";
+    std::string c = ir.operand_count > 2 ? read(ir.operands[2]) : "";
+
+    // Division by zero is reported by the IR executor
+    if (mnemonic == Mnemonic::DIV || mnemonic == Mnemonic::MOD) {
+        out << "        if (!s.budget || " << b << " == 0) { " << exit << " }\n";
+    } else {
+        out << "        if (!s.budget) { " << exit << " }\n";
+    }
+
+    out << "        --s.budget;\n";
+
+    switch (mnemonic) {
+        case Mnemonic::ADD : out << write(ir.store, "static_cast<word>(" + a + " + " + b + ")"); break;
+        case Mnemonic::SUB : out << write(ir.store, "static_cast<word>(" + a + " - " + b + ")"); break;
+        // Unsigned, as words promote to int and their product overflows it
+        case Mnemonic::MUL : out << write(ir.store, "static_cast<word>(static_cast<uint32_t>(" + a + ") * " + b + ")"); break;
+        case Mnemonic::DIV : out << write(ir.store, "static_cast<word>(" + signed_value(a) + " / " + signed_value(b) + ")"); break;
+        case Mnemonic::MOD : out << write(ir.store, "static_cast<word>(" + signed_value(a) + " % " + signed_value(b) + ")"); break;
+        case Mnemonic::AND : out << write(ir.store, "static_cast<word>(" + a + " & " + b + ")"); break;
+        case Mnemonic::OR : out << write(ir.store, "static_cast<word>(" + a + " | " + b + ")"); break;
+        case Mnemonic::NOT : out << write(ir.store, "static_cast<word>(~" + a + ")"); break;
+        case Mnemonic::INC : out << write(ir.operands[0], "static_cast<word>(" + a + " + 1)"); break;
+        case Mnemonic::DEC : out << write(ir.operands[0], "static_cast<word>(" + a + " - 1)"); break;
+        case Mnemonic::STORE : case Mnemonic::PULL : out << write(ir.operands[0], b); break;
+        case Mnemonic::LOAD : case Mnemonic::PUSH : out << write(ir.store, a); break;
+        case Mnemonic::POP : case Mnemonic::NOP : break;
+
+        case Mnemonic::LOADW : out << write(ir.store, "s.memory->read_word(static_cast<word>(" + a + " + (" + b + " << 1)))"); break;
+        case Mnemonic::LOADB : out << write(ir.store, "s.memory->read_byte(static_cast<word>(" + a + " + " + b + "))"); break;
+        case Mnemonic::STOREW : out << "        s.memory->write_word(static_cast<word>(" << a << " + (" << b << " << 1)), " << c << ");\n"; break;
+        case Mnemonic::STOREB : out << "        s.memory->write(static_cast<word>(" << a << " + " << b << "), static_cast<uint8_t>(" << c << "));\n"; break;
+
+        case Mnemonic::JUMP : out << "        goto " << label(ir.target) << ";\n"; break;
+        case Mnemonic::JZ : out << branch(ir, a + " == 0"); break;
+        case Mnemonic::JL : out << branch(ir, signed_value(a) + " < " + signed_value(b)); break;
+        case Mnemonic::JG : out << branch(ir, signed_value(a) + " > " + signed_value(b)); break;
+        case Mnemonic::TEST : out << branch(ir, "(" + a + " & " + b + ") == " + b); break;
+
+        case Mnemonic::JE : {
+            std::string condition;
+
+            for (uint8_t i = 1; i < ir.operand_count; ++i) {
+                condition += (i > 1 ? " || " : "") + a + " == " + read(ir.operands[i]);
+            }
+
+            out << branch(ir, condition.empty() ? "false" : condition);
+            break;
+        }
+
+        // The limit is read before the variable is written, it may be the same one
+        case Mnemonic::INC_CHK : case Mnemonic::DEC_CHK : {
+            bool increment = mnemonic == Mnemonic::INC_CHK;
+
+            out << "        {\n";
+            out << "        auto limit = " << signed_value(b) << ";\n";
+            out << "        auto value = static_cast<int16_t>(" << a << (increment ? " + 1" : " - 1") << ");\n";
+            out << write(ir.operands[0], "static_cast<word>(value)");
+            out << branch(ir, increment ? "value > limit" : "value < limit");
+            out << "        }\n";
+            break;
+        }
+
+        default :
+            break;
+    }
+}
+
+template class zm::AotGenerator<1>;
+template class zm::AotGenerator<2>;
+template class zm::AotGenerator<3>;
+template class zm::AotGenerator<4>;
+template class zm::AotGenerator<5>;
+template class zm::AotGenerator<6>;
+template class zm::AotGenerator<7>;
+template class zm::AotGenerator<8>;
@@ -0,0 +1,57 @@
+#ifndef ZETAMACHINE_AOT_GENERATOR_H
+#define ZETAMACHINE_AOT_GENERATOR_H
+
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <set>
+#include <string>
+
+#include "../decoder.h"
+#include "../translator.h"
+
+namespace zm {
+    class Memory;
+
+    /*
+     * Writes the C++ source of a plugin for a story: its routines in static
+     * memory, translated as the interpreter would, one function each. Only
+     * what the JIT compiles is compiled here too, everything else (calls,
+     * objects, I/O...) is left to the IR executor; memory goes through Memory.
+     *
+     * Routines are found by following calls to constant addresses from the
+     * start of the story, those only ever called indirectly are missed.
+     */
+    template<uint8_t Version>
+    class AotGenerator {
+    public:
+        explicit AotGenerator(Memory &memory);
+
+        // Returns the number of routines written
+        size_t generate(std::ostream &out, const std::string &story);
+
+    private:
+        Memory &memory;
+        Decoder<Version> decoder;
+        Translator<Version> translator;
+
+        address static_memory_base;
+        address global_variables_address;
+        word routines_offset;
+        uint32_t file_length;
+
+        std::set<word> found;
+        std::map<word, const TranslatedRoutine *> compiled;
+
+        void discover();
+        void scan(address start, std::vector<word> &calls);
+        void routine(std::ostream &out, const TranslatedRoutine &routine);
+        void instruction(std::ostream &out, uint32_t index, const IrInstruction &ir);
+
+        std::string read(const Register &source);
+        std::string write(const Register &destination, const std::string &value);
+        std::string branch(const IrInstruction &ir, const std::string &condition);
+    };
+}
+
+#endif //ZETAMACHINE_AOT_GENERATOR_H
@@ -0,0 +1,53 @@
+#include "generator.h"
+
+#include "../version.h"
+#include "../memory/memory.h"
+#include "../memory/story_image.h"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+struct Generate {
+    zm::Memory &memory;
+    std::ostream &out;
+    const std::string &story;
+
+    template<uint8_t Version>
+    size_t apply() { return zm::AotGenerator<Version> { memory }.generate(out, story); }
+};
+
+/*
+ * Writes the C++ source of a plugin for a story. Built into a shared object
+ * (see zetamachine_aot_plugin in CMakeLists.txt), it is then passed to
+ * zetamachine with --aot.
+ */
+int main(int argc, char *argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: zetamachine_aot <story file> <output.cpp>" << std::endl;
+        return 1;
+    }
+
+    std::string story = argv[1];
+
+    // Stories, or the story in a Blorb, whose length fits and whose checksum was compared
+    auto image = zm::StoryImage::map(story);
+
+    if (!image) {
+        return 1;
+    }
+
+    zm::Memory memory { image };
+
+    std::ofstream out(argv[2]);
+
+    if (!out) {
+        std::cerr << "Could not write " << argv[2] << std::endl;
+        return 1;
+    }
+
+    size_t routines = zm::dispatch_version(memory.read(0x00), Generate { memory, out, story });
+    std::cout << "Compiled " << routines << " routines into " << argv[2] << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include "spdlog/spdlog.h"
+
+#include "plugin.h"
+
+#include "../memory/header.h"
+
+#include <dlfcn.h>
+
+zm::AotPlugin::~AotPlugin() {
+    if (handle) {
+        dlclose(handle);
+    }
+}
+
+bool zm::AotPlugin::load(const std::string &path, zm::Memory &memory) {
+    void *library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+    if (!library) {
+        spdlog::warn("Could not load {}: {}", path, dlerror());
+        return false;
+    }
+
+    auto story_function = reinterpret_cast<const AotStory *(*)()>(dlsym(library, ZM_AOT_SYMBOL));
+    const AotStory *story = story_function ? story_function() : nullptr;
+    Header header { memory };
+
+    if (!story || story->abi != ZM_AOT_ABI) {
+        spdlog::warn("{} is not a plugin for this interpreter", path);
+        dlclose(library);
+        return false;
+    }
+
+    if (story->release != header.release() || std::string(story->serial, 6) != header.serial() || story->checksum != header.checksum()) {
+        spdlog::warn("{} was made from another story (release {}, serial {})", path, story->release, std::string(story->serial, 6));
+        dlclose(library);
+        return false;
+    }
+
+    handle = library;
+
+    for (uint32_t i = 0; i < story->routine_count; ++i) {
+        routines[story->routines[i].packed] = &story->routines[i];
+    }
+
+    return true;
+}
+
+const zm::AotRoutine *zm::AotPlugin::find(zm::word packed, size_t instruction_count) const {
+    auto found = routines.find(packed);
+
+    // The translation must be the one the plugin was made from
+    if (found == routines.end() || found->second->instruction_count != instruction_count) {
+        return nullptr;
+    }
+
+    return found->second;
+}
@@ -0,0 +1,75 @@
+#ifndef ZETAMACHINE_AOT_PLUGIN_H
+#define ZETAMACHINE_AOT_PLUGIN_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "../call_stack.h"
+#include "../memory/memory.h"
+
+// Bumped whenever the structures below or the IR they index into change
+#define ZM_AOT_ABI 1
+
+// What plugins export, see zetamachine_aot
+#define ZM_AOT_SYMBOL "zm_aot_story"
+
+namespace zm {
+    // What compiled code works on, filled in before each run
+    struct AotState {
+        word *locals;
+        word *temporaries;
+        Memory *memory;
+        uint64_t budget;
+    };
+
+    /*
+     * Compiled translation of a routine. Like native code of the JIT it is
+     * entered at any IR instruction marked in entries, and returns the index
+     * of the one it stopped at without running any of it.
+     */
+    using AotFunction = uint32_t (*)(AotState &state, uint32_t index);
+
+    struct AotRoutine {
+        word packed;
+        uint32_t instruction_count; // Of the translation it was compiled from
+        const uint8_t *entries;
+        AotFunction function;
+    };
+
+    // The story a plugin was compiled from, and its routines
+    struct AotStory {
+        uint32_t abi;
+        word release;
+        char serial[6];
+        word checksum;
+        uint32_t routine_count;
+        const AotRoutine *routines;
+    };
+
+    /*
+     * A shared object made by zetamachine_aot. It is only used with the exact
+     * story it was made from, and only holds routines from static memory.
+     */
+    class AotPlugin {
+    public:
+        AotPlugin() = default;
+        AotPlugin(const AotPlugin &) = delete;
+        AotPlugin &operator=(const AotPlugin &) = delete;
+        ~AotPlugin();
+
+        // False, and nothing loaded, unless the plugin was made from the story in memory
+        bool load(const std::string &path, Memory &memory);
+
+        bool loaded() const { return handle != nullptr; }
+
+        // Compiled code for a routine translated into that many IR instructions, if any
+        const AotRoutine *find(word packed, size_t instruction_count) const;
+
+    private:
+        void *handle = nullptr;
+        std::unordered_map<word, const AotRoutine *> routines;
+    };
+}
+
+#endif //ZETAMACHINE_AOT_PLUGIN_H
@@ -0,0 +1,72 @@
+#include "bench.h"
+
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+void zm::Bench::write(std::ostream &out) const {
+    out << "benchmark,iterations,ns_per_op";
+
+    for (const char *name : perf_event_names) {
+        out << "," << name << "_per_op";
+    }
+
+    out << "\n";
+
+    for (const auto &result : results) {
+        out << result.name << "," << result.iterations << "," << std::fixed << std::setprecision(3) << result.ns;
+
+        for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+            if (counters.available(static_cast<PerfEvent>(i))) {
+                out << "," << static_cast<double>(result.counters.values[i]) / static_cast<double>(result.iterations);
+            } else {
+                out << ",unavailable";
+            }
+        }
+
+        out << "\n";
+    }
+}
+
+bool zm::Bench::compare(const std::string &baseline, double threshold, std::ostream &out) const {
+    std::ifstream file(baseline);
+    std::map<std::string, double> previous;
+    std::string line;
+
+    // The header, then name,iterations,ns_per_op,...
+    std::getline(file, line);
+
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name, iterations, ns;
+
+        if (std::getline(fields, name, ',') && std::getline(fields, iterations, ',') && std::getline(fields, ns, ',')) {
+            previous[name] = std::stod(ns);
+        }
+    }
+
+    bool passed = true;
+
+    out << std::left << std::setw(32) << "benchmark" << std::right << std::setw(14) << "baseline ns" << std::setw(14) << "ns" << std::setw(10) << "delta" << "\n";
+
+    for (const auto &result : results) {
+        out << std::left << std::setw(32) << result.name << std::right << std::fixed << std::setprecision(2);
+
+        auto found = previous.find(result.name);
+
+        if (found == previous.end() || found->second <= 0.0) {
+            out << std::setw(14) << "-" << std::setw(14) << result.ns << std::setw(10) << "new" << "\n";
+            continue;
+        }
+
+        double delta = 100.0 * (result.ns - found->second) / found->second;
+        bool regressed = delta > threshold;
+        passed = passed && !regressed;
+
+        out << std::setw(14) << found->second << std::setw(14) << result.ns << std::setw(9) << std::showpos << delta << std::noshowpos << "%"
+            << (regressed ? "  REGRESSION" : "") << "\n";
+    }
+
+    return passed;
+}
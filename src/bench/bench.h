@@ -0,0 +1,88 @@
+#ifndef ZETAMACHINE_BENCH_H
+#define ZETAMACHINE_BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "../perf_counters.h"
+
+// Each benchmark runs this many rounds of at least BENCH_ROUND_NS, the fastest one counts
+#define BENCH_ROUNDS 5
+#define BENCH_ROUND_NS 20000000
+
+namespace zm {
+    struct BenchResult {
+        std::string name;
+        uint64_t iterations;
+        double ns; // Per iteration, in the fastest round
+        PerfReading counters; // Over the fastest round
+    };
+
+    class Bench {
+    public:
+        explicit Bench(const std::string &filter) : filter(filter) { }
+
+        // Times body(i), which returns something that depends on its work so it is not optimized away
+        template<typename Body>
+        void run(const std::string &name, Body body) {
+            if (!filter.empty() && name.find(filter) == std::string::npos) {
+                return;
+            }
+
+            BenchResult result { name, 1, 0.0, PerfReading {} };
+
+            // Doubled until one round takes long enough to time
+            while (measure(body, result.iterations).count() < BENCH_ROUND_NS) {
+                result.iterations <<= 1;
+            }
+
+            for (int round = 0; round < BENCH_ROUNDS; ++round) {
+                double ns = static_cast<double>(measure(body, result.iterations).count()) / static_cast<double>(result.iterations);
+
+                // The counters are reset at the start of every round
+                if (round == 0 || ns < result.ns) {
+                    result.ns = ns;
+                    result.counters = counters.read();
+                }
+            }
+
+            results.push_back(result);
+        }
+
+        // CSV, one line per benchmark
+        void write(std::ostream &out) const;
+
+        // Prints the change of every benchmark against a file written by write, false if one got slower than threshold percent
+        bool compare(const std::string &baseline, double threshold, std::ostream &out) const;
+
+        const PerfCounters &get_counters() const { return counters; }
+
+    private:
+        std::string filter;
+        std::vector<BenchResult> results;
+        PerfCounters counters;
+        volatile uint64_t sink = 0;
+
+        template<typename Body>
+        std::chrono::nanoseconds measure(Body &body, uint64_t iterations) {
+            uint64_t value = 0;
+            counters.start();
+            auto start = std::chrono::steady_clock::now();
+
+            for (uint64_t i = 0; i < iterations; ++i) {
+                value += body(i);
+            }
+
+            auto end = std::chrono::steady_clock::now();
+            counters.stop();
+            sink = sink + value;
+
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+        }
+    };
+}
+
+#endif //ZETAMACHINE_BENCH_H
@@ -0,0 +1,134 @@
+#include "image.h"
+
+#include <algorithm>
+
+#include "../memory/zchar_mapper.h"
+
+#define IMAGE_ABBREVIATIONS 0x0100
+#define IMAGE_ABBREVIATION 0x0200
+#define IMAGE_OBJECTS 0x0400
+#define IMAGE_PROPERTIES 0x0800
+#define IMAGE_GLOBALS 0x1200
+#define IMAGE_DICTIONARY 0x1400
+#define IMAGE_TEXT 0x2000
+#define IMAGE_CODE 0x3000
+
+#define IMAGE_OBJECT_COUNT 64
+#define IMAGE_WORD_COUNT 256
+
+// Packs Z-characters three to a word, padded with 5s, the last word marked
+static uint32_t write_zchars(zm::Memory &memory, uint32_t address, std::vector<uint8_t> zchars) {
+    zchars.resize((zchars.size() + 2) / 3 * 3, 5);
+
+    for (size_t i = 0; i < zchars.size(); i += 3) {
+        uint16_t word = (zchars[i] << 10) | (zchars[i + 1] << 5) | zchars[i + 2];
+        memory.write_word(address, i + 3 == zchars.size() ? word | 0x8000 : word);
+        address += 2;
+    }
+
+    return address;
+}
+
+static uint32_t write_bytes(zm::Memory &memory, uint32_t address, std::initializer_list<uint8_t> bytes) {
+    for (uint8_t byte : bytes) {
+        memory.write(address++, byte);
+    }
+
+    return address;
+}
+
+zm::BenchImage zm::build_image(zm::Memory &memory) {
+    BenchImage image {};
+
+    for (uint32_t address = 0; address < memory.capacity(); ++address) {
+        memory.write(address, 0);
+    }
+
+    memory.write(0x00, 5);
+    memory.write_word(0x04, IMAGE_CODE);
+    memory.write_word(0x06, IMAGE_CODE);
+    memory.write_word(0x08, IMAGE_DICTIONARY);
+    memory.write_word(0x0A, IMAGE_OBJECTS);
+    memory.write_word(0x0C, IMAGE_GLOBALS);
+    memory.write_word(0x0E, IMAGE_DICTIONARY);
+    memory.write_word(0x18, IMAGE_ABBREVIATIONS);
+
+    // Every abbreviation is "the"
+    write_zchars(memory, IMAGE_ABBREVIATION, { 25, 13, 10 });
+
+    for (uint32_t i = 0; i < 96; ++i) {
+        memory.write_word(IMAGE_ABBREVIATIONS + (i << 1), IMAGE_ABBREVIATION >> 1);
+    }
+
+    // Lower case, abbreviations, a shift to upper case and digits
+    std::vector<uint8_t> text;
+
+    for (int i = 0; i < 8; ++i) {
+        text.insert(text.end(), { 13, 10, 17, 17, 20, 0, 1, static_cast<uint8_t>(i), 0, 4, 28, 5, 9, 0 });
+    }
+
+    image.text = IMAGE_TEXT;
+    write_zchars(memory, IMAGE_TEXT, text);
+
+    // Object 1 holds all the others, each with properties 20 and 10 (words) and 5 (a byte)
+    image.objects = IMAGE_OBJECT_COUNT;
+    ZCharMapper mapper { memory };
+    uint32_t properties = IMAGE_PROPERTIES;
+
+    for (uint16_t object = 1; object <= IMAGE_OBJECT_COUNT; ++object) {
+        uint32_t entry = IMAGE_OBJECTS + 126 + (object - 1) * 14;
+
+        memory.write_double_word(entry, 0xA5A5A5A5u ^ object);
+        memory.write_word(entry + 6, object == 1 ? 0 : 1);
+        memory.write_word(entry + 8, object == 1 || object == IMAGE_OBJECT_COUNT ? 0 : object + 1);
+        memory.write_word(entry + 10, object == 1 ? 2 : 0);
+        memory.write_word(entry + 12, static_cast<uint16_t>(properties));
+
+        auto name = mapper.encode("lamp", 6);
+        memory.write(properties++, static_cast<uint8_t>(name.size()));
+
+        for (uint16_t word : name) {
+            memory.write_word(properties, word);
+            properties += 2;
+        }
+
+        properties = write_bytes(memory, properties, { 0x40 | 20, 0x12, static_cast<uint8_t>(object), 0x40 | 10, 0x34, 0x56, 5, 0x78, 0 });
+    }
+
+    // A sorted dictionary of made up words
+    const char *syllables[] = { "ba", "co", "di", "fu", "ge", "ho", "ji", "ka", "lo", "mu", "ne", "po", "ru", "sa", "te", "vo" };
+    std::vector<std::pair<std::vector<uint16_t>, std::string>> entries;
+
+    for (int i = 0; i < IMAGE_WORD_COUNT; ++i) {
+        std::string word = std::string(syllables[i & 15]) + syllables[(i >> 4) & 15] + syllables[(i * 7) & 15];
+        entries.emplace_back(mapper.encode(word, 9), word);
+    }
+
+    std::sort(entries.begin(), entries.end());
+
+    uint32_t address = write_bytes(memory, IMAGE_DICTIONARY, { 3, '.', ',', '"', 9 });
+    memory.write_word(address, static_cast<uint16_t>(entries.size()));
+    address += 2;
+
+    for (const auto &entry : entries) {
+        for (uint16_t word : entry.first) {
+            memory.write_word(address, word);
+            address += 2;
+        }
+
+        address += 3;
+        image.words.push_back(entry.second);
+    }
+
+    // new_line; inc 16; add 1 2 -> 16; storew 1 2 3; log_shift 1 2 -> 16
+    image.code[0] = IMAGE_CODE;
+    image.code[1] = write_bytes(memory, image.code[0], { 0xBB });
+    image.code[2] = write_bytes(memory, image.code[1], { 0x95, 0x10 });
+    image.code[3] = write_bytes(memory, image.code[2], { 0x14, 0x01, 0x02, 0x10 });
+    image.code[4] = write_bytes(memory, image.code[3], { 0xE1, 0x57, 0x01, 0x02, 0x03 });
+    write_bytes(memory, image.code[4], { 0xBE, 0x02, 0x5F, 0x01, 0x02, 0x10 });
+
+    memory.write_word(0x1A, static_cast<uint16_t>((IMAGE_CODE + 0x100) >> 2));
+
+    return image;
+}
@@ -0,0 +1,27 @@
+#ifndef ZETAMACHINE_BENCH_IMAGE_H
+#define ZETAMACHINE_BENCH_IMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../memory/memory.h"
+
+namespace zm {
+    // Where build_image puts things, for the benchmarks to aim at
+    struct BenchImage {
+        uint16_t objects; // Numbered from 1
+        uint32_t text; // Encoded string, with abbreviations
+        uint32_t code[5]; // One instruction of each form: 0OP, 1OP, 2OP, VAR and EXT
+        std::vector<std::string> words; // In the dictionary
+    };
+
+    /*
+     * Lays out a small version 5 story in memory: header, abbreviations,
+     * an object tree with properties, a sorted dictionary, a string and
+     * instructions of every form. Nothing in it is meant to be run.
+     */
+    BenchImage build_image(Memory &memory);
+}
+
+#endif //ZETAMACHINE_BENCH_IMAGE_H
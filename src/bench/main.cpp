@@ -0,0 +1,138 @@
+#include "bench.h"
+#include "image.h"
+
+#include "../call_stack.h"
+#include "../decoder.h"
+#include "../memory/dictionary_mapper.h"
+#include "../memory/memory.h"
+#include "../memory/object_mapper.h"
+#include "../memory/zchar_mapper.h"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+
+/*
+ * Microbenchmarks of the interpreter's building blocks, run against a story
+ * laid out in memory (see build_image). Results are written as CSV; given a
+ * baseline written the same way, every benchmark is compared against it.
+ */
+int main(int argc, char *argv[]) {
+    std::string output;
+    std::string baseline;
+    std::string filter;
+    double threshold = 10.0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+
+        if (argument == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (argument == "--baseline" && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (argument == "--threshold" && i + 1 < argc) {
+            threshold = std::stod(argv[++i]);
+        } else if (argument == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else {
+            std::cerr << "Usage: zetamachine_bench [--output <file.csv>] [--baseline <file.csv>] [--threshold <percent>] [--filter <name>]" << std::endl;
+            return 1;
+        }
+    }
+
+    zm::Memory memory { 0x10000 };
+    zm::BenchImage image = zm::build_image(memory);
+    zm::Bench bench { filter };
+
+    // Decoding, one form at a time
+    zm::Decoder<5> decoder { memory };
+    const char *forms[] = { "decode_0op", "decode_1op", "decode_2op", "decode_var", "decode_ext" };
+
+    for (int form = 0; form < 5; ++form) {
+        zm::address pc = image.code[form];
+        bench.run(forms[form], [&](uint64_t) { return decoder.decode(pc).next_pc; });
+    }
+
+    // Text
+    zm::ZCharMapper text { memory };
+    bench.run("zchar_map", [&](uint64_t) { return text.map(image.text).size(); });
+    bench.run("zchar_word_len", [&](uint64_t) { return text.word_len(image.text); });
+
+    // Objects
+    zm::ObjectMapper<5> objects { memory };
+    auto object = [&](uint64_t i) { return static_cast<uint16_t>(2 + (i % (image.objects - 1))); };
+
+    bench.run("object_test_attribute", [&](uint64_t i) { return objects.test_attribute(object(i), i % 48); });
+    bench.run("object_set_clear_attribute", [&](uint64_t i) {
+        objects.set_attribute(object(i), 17);
+        objects.clear_attribute(object(i), 17);
+        return 1;
+    });
+    bench.run("object_tree_walk", [&](uint64_t) {
+        uint64_t count = 0;
+
+        for (uint16_t child = objects.get_child(1); child != 0; child = objects.get_sibling(child)) {
+            count += objects.get_parent(child);
+        }
+
+        return count;
+    });
+    bench.run("object_remove_insert", [&](uint64_t i) {
+        objects.remove_object(object(i));
+        objects.insert_object(object(i), 1);
+        return objects.get_child(1);
+    });
+    bench.run("object_get_property", [&](uint64_t i) { return objects.get_property(object(i), 10); });
+    bench.run("object_get_property_default", [&](uint64_t i) { return objects.get_property(object(i), 30); });
+    bench.run("object_put_property", [&](uint64_t i) {
+        objects.put_property(object(i), 20, static_cast<uint16_t>(i));
+        return 1;
+    });
+    bench.run("object_get_next_property", [&](uint64_t i) { return objects.get_next_property(object(i), 20); });
+
+    // Memory
+    bench.run("memory_read_word", [&](uint64_t i) { return memory.read_word(0x1200 + ((i << 1) & 0x1FE)); });
+    bench.run("memory_write_word", [&](uint64_t i) {
+        memory.write_word(0x1200 + ((i << 1) & 0x1FE), static_cast<uint16_t>(i));
+        return 1;
+    });
+
+    // Dictionary
+    zm::DictionaryMapper<5> dictionary { memory };
+    bench.run("dictionary_lookup_hit", [&](uint64_t i) { return dictionary.lookup(image.words[i % image.words.size()]); });
+    bench.run("dictionary_lookup_miss", [&](uint64_t) { return dictionary.lookup("xyzzy"); });
+
+    // Call stack
+    zm::CallStack stack;
+    bench.run("call_stack_push_pop", [&](uint64_t i) {
+        stack.push(static_cast<zm::address>(i), 4).argument_count = 2;
+        stack.push_value(static_cast<zm::word>(i));
+        zm::word value = stack.pop_value();
+        stack.pop();
+        return value;
+    });
+
+    if (output.empty()) {
+        bench.write(std::cout);
+    } else {
+        std::ofstream file(output);
+
+        if (!file) {
+            std::cerr << "Could not write " << output << std::endl;
+            return 1;
+        }
+
+        bench.write(file);
+    }
+
+    if (!baseline.empty()) {
+        if (!std::ifstream(baseline)) {
+            std::cerr << "Could not read the baseline " << baseline << std::endl;
+            return 1;
+        }
+
+        return bench.compare(baseline, threshold, std::cerr) ? 0 : 2;
+    }
+
+    return 0;
+}
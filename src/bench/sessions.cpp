@@ -0,0 +1,165 @@
+#include "../scheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+// The last line that is not empty
+static std::string last_line(const std::string &text) {
+    size_t end = text.find_last_not_of('\n');
+
+    if (end == std::string::npos) {
+        return "";
+    }
+
+    size_t start = text.rfind('\n', end);
+    start = start == std::string::npos ? 0 : start + 1;
+
+    return text.substr(start, end - start + 1);
+}
+
+// Resident set of the process, 0 where /proc is not there
+static uint64_t resident_kb() {
+    std::ifstream statm("/proc/self/statm");
+    uint64_t size = 0;
+    uint64_t resident = 0;
+
+    statm >> size >> resident;
+    return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) / 1024;
+}
+
+/*
+ * Plays the same story in many sessions at once on the scheduler, typing the
+ * script's next line whenever a session parks for input. Reports instructions
+ * per second, and fails unless every session ended on the same line.
+ */
+int main(int argc, char *argv[]) {
+    std::string path;
+    std::string script_path;
+    zm::Options options;
+    unsigned sessions = 64;
+    unsigned workers = std::max(1u, std::thread::hardware_concurrency());
+    uint64_t slice = 100000;
+
+    // Sessions only agree if their random numbers do
+    options.seed = 12345;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+
+        if (argument == "--sessions" && i + 1 < argc) {
+            sessions = static_cast<unsigned>(std::max(1, std::stoi(argv[++i])));
+        } else if (argument == "--workers" && i + 1 < argc) {
+            workers = static_cast<unsigned>(std::max(1, std::stoi(argv[++i])));
+        } else if (argument == "--slice" && i + 1 < argc) {
+            slice = std::max(1ull, std::stoull(argv[++i]));
+        } else if (argument == "--script" && i + 1 < argc) {
+            script_path = argv[++i];
+        } else if (argument == "--no-fusion") {
+            options.fusion = false;
+        } else if (argument == "--no-translation") {
+            options.translation = false;
+        } else if (argument == "--jit") {
+            options.jit = true;
+        } else if (argument == "--checked") {
+            options.checked = true;
+        } else if (argument == "--images" && i + 1 < argc) {
+            options.images = argv[++i];
+        } else if (path.empty() && argument[0] != '-') {
+            path = argument;
+        } else {
+            path.clear();
+            break;
+        }
+    }
+
+    if (path.empty()) {
+        std::cerr << "Usage: zetamachine_sessions [--sessions <n>] [--workers <n>] [--slice <instructions>] [--script <file>] [--no-fusion] [--no-translation] [--jit] [--checked] [--images <directory>] <story>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> story { std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>() };
+    std::vector<std::string> script;
+
+    if (!script_path.empty()) {
+        std::ifstream lines(script_path);
+
+        if (!lines) {
+            std::cerr << "Could not read " << script_path << std::endl;
+            return 1;
+        }
+
+        for (std::string line; std::getline(lines, line); ) {
+            script.push_back(line);
+        }
+    }
+
+    zm::Scheduler scheduler { workers, slice, options };
+
+    // Every session is on its own line of the script, only touched while it is parked
+    std::vector<size_t> positions(sessions + 1, 0);
+
+    scheduler.on_stop([&](zm::SessionId id, zm::SessionState state) {
+        if (state != zm::SessionState::PARKED) {
+            return;
+        }
+
+        if (positions[id] < script.size()) {
+            scheduler.send(id, script[positions[id]++]);
+        } else {
+            scheduler.close(id);
+        }
+    });
+
+    uint64_t resident_before = resident_kb();
+    auto start = std::chrono::steady_clock::now();
+    std::vector<zm::SessionId> ids;
+
+    for (unsigned i = 0; i < sessions; ++i) {
+        zm::SessionId id = scheduler.add(story);
+
+        if (id == 0) {
+            std::cerr << "Could not load " << path << std::endl;
+            return 1;
+        }
+
+        ids.push_back(id);
+    }
+
+    scheduler.wait();
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    auto stats = scheduler.get_stats();
+
+    // The story's image is shared, so this is mostly what every session keeps of its own
+    uint64_t resident_after = resident_kb();
+    uint64_t resident = resident_after > resident_before ? resident_after - resident_before : 0;
+
+    // Sessions grouped by how they ended
+    std::map<std::string, unsigned> endings;
+
+    for (auto id : ids) {
+        ++endings[last_line(scheduler.take_output(id))];
+    }
+
+    std::cout << sessions << " sessions on " << workers << " workers, " << stats.instructions << " instructions in " << std::fixed
+              << std::setprecision(3) << wall << " s (" << std::setprecision(0) << static_cast<double>(stats.instructions) / wall
+              << " instr/s), " << stats.slices << " slices, " << stats.steals << " steals, " << stats.parks << " parks, "
+              << resident / sessions << " KB resident per session" << std::endl;
+
+    for (const auto &ending : endings) {
+        std::cout << std::setw(8) << ending.second << "  " << ending.first << "\n";
+    }
+
+    return endings.size() == 1 ? 0 : 2;
+}
@@ -0,0 +1,369 @@
+#include "spdlog/spdlog.h"
+
+#include "stories.h"
+
+#include "../story/story_builder.h"
+
+// How much work each story does
+#define ARITHMETIC_OUTER 1000
+#define ARITHMETIC_INNER 1000
+#define RECURSION_ROUNDS 200
+#define RECURSION_DEPTH 1000
+#define RECURSION_FIBONACCI 17
+#define OBJECTS_ROUNDS 20000
+#define OBJECTS_ITEMS 64
+#define TEXT_ROUNDS 20000
+#define PARSER_LINES 20000
+#define PARSER_MAX_WORDS 16
+
+using zm::Argument;
+using zm::Branch;
+using zm::Mnemonic;
+using zm::Variable;
+
+static Variable local(uint8_t number) { return Variable::local(number); }
+static Variable global(uint8_t number) { return Variable::global(number); }
+static Argument reference(Variable variable) { return Argument::by_reference(variable); }
+
+static const Variable sp = Variable::stack();
+
+// call was renamed call_vs in version 4, with the same opcode
+template<uint8_t Version>
+static constexpr Mnemonic call() { return Version <= 3 ? Mnemonic::CALL : Mnemonic::CALL_VS; }
+
+// Calls routine from main, prints its result after the title and quits
+template<uint8_t Version>
+static void main_calling(zm::StoryBuilder<Version> &story, const Argument &routine, const std::string &title) {
+    story.begin_main();
+    story.op(call<Version>(), { routine }, global(0));
+    story.print(title);
+    story.op(Mnemonic::PRINT_NUM, { global(0) });
+    story.op(Mnemonic::NEW_LINE);
+    story.op(Mnemonic::QUIT);
+}
+
+template<uint8_t Version>
+static std::vector<uint8_t> arithmetic() {
+    zm::StoryBuilder<Version> story;
+    Argument work = story.routine();
+
+    main_calling(story, work, "Arithmetic: ");
+
+    // 1: i, 2: j, 3: sum, 4: temporary
+    story.begin(work, 4);
+    auto outer = story.label();
+    auto inner = story.label();
+    auto odd = story.label();
+
+    story.bind(outer);
+    story.op(Mnemonic::STORE, { reference(local(2)), 0 });
+    story.bind(inner);
+    story.op(Mnemonic::MUL, { local(3), 31 }, local(3));
+    story.op(Mnemonic::ADD, { local(3), local(2) }, local(3));
+    story.op(Mnemonic::AND, { local(1), 0xFF }, local(4));
+    story.op(Mnemonic::ADD, { local(3), local(4) }, local(3));
+    story.op(Mnemonic::DIV, { local(3), 7 }, local(4));
+    story.op(Mnemonic::SUB, { local(3), local(4) }, local(3));
+    story.op(Mnemonic::MOD, { local(2), 13 }, local(4));
+    story.op(Mnemonic::JZ, { local(4) }, Branch::unless(odd));
+    story.op(Mnemonic::OR, { local(3), 1 }, local(3));
+    story.bind(odd);
+
+    if (Version >= 5) {
+        story.op(Mnemonic::LOG_SHIFT, { local(3), -3 }, local(4));
+        story.op(Mnemonic::SUB, { local(3), local(4) }, local(3));
+    }
+
+    story.op(Mnemonic::INC_CHK, { reference(local(2)), ARITHMETIC_INNER - 1 }, Branch::unless(inner));
+    story.op(Mnemonic::INC_CHK, { reference(local(1)), ARITHMETIC_OUTER - 1 }, Branch::unless(outer));
+    story.op(Mnemonic::RET, { local(3) });
+
+    return story.build();
+}
+
+template<uint8_t Version>
+static std::vector<uint8_t> recursion() {
+    zm::StoryBuilder<Version> story;
+    Argument run = story.routine();
+    Argument depth = story.routine();
+    Argument fibonacci = story.routine();
+
+    main_calling(story, run, "Recursion: ");
+
+    // 1: round, 2: sum
+    story.begin(run, 2);
+    auto round = story.label();
+    story.bind(round);
+    story.op(call<Version>(), { depth, RECURSION_DEPTH }, sp);
+    story.op(Mnemonic::ADD, { local(2), sp }, local(2));
+    story.op(call<Version>(), { fibonacci, RECURSION_FIBONACCI }, sp);
+    story.op(Mnemonic::ADD, { local(2), sp }, local(2));
+    story.op(Mnemonic::INC_CHK, { reference(local(1)), RECURSION_ROUNDS - 1 }, Branch::unless(round));
+    story.op(Mnemonic::RET, { local(2) });
+
+    // depth(n) = n == 0 ? 0 : depth(n - 1) + 1
+    story.begin(depth, 1);
+    story.op(Mnemonic::JZ, { local(1) }, Branch::when(zm::StoryBuilder<Version>::RETURN_FALSE));
+    story.op(Mnemonic::SUB, { local(1), 1 }, sp);
+    story.op(call<Version>(), { depth, sp }, sp);
+    story.op(Mnemonic::ADD, { sp, 1 }, sp);
+    story.op(Mnemonic::RET_POPPED);
+
+    // fibonacci(n) = n < 2 ? n : fibonacci(n - 1) + fibonacci(n - 2)
+    story.begin(fibonacci, 1);
+    auto recurse = story.label();
+    story.op(Mnemonic::JL, { local(1), 2 }, Branch::unless(recurse));
+    story.op(Mnemonic::RET, { local(1) });
+    story.bind(recurse);
+    story.op(Mnemonic::SUB, { local(1), 1 }, sp);
+    story.op(call<Version>(), { fibonacci, sp }, sp);
+    story.op(Mnemonic::SUB, { local(1), 2 }, sp);
+    story.op(call<Version>(), { fibonacci, sp }, sp);
+    story.op(Mnemonic::ADD, { sp, sp }, sp);
+    story.op(Mnemonic::RET_POPPED);
+
+    return story.build();
+}
+
+template<uint8_t Version>
+static std::vector<uint8_t> objects() {
+    zm::StoryBuilder<Version> story;
+    Argument shuffle = story.routine();
+
+    // Four rooms, and items that start out in the first one
+    for (int room = 0; room < 4; ++room) {
+        story.add_object("room");
+    }
+
+    for (int item = 0; item < OBJECTS_ITEMS; ++item) {
+        uint16_t object = story.add_object(item & 1 ? "small brass lamp" : "rusty key", 1);
+        story.set_property(object, 10, static_cast<uint16_t>(item * 3));
+        story.set_property(object, 12, std::vector<uint8_t> { static_cast<uint8_t>(item) });
+        story.set_property(object, 5, 0x1234);
+
+        if (item & 1) {
+            story.set_attribute(object, 3);
+        }
+    }
+
+    story.set_default(20, 7);
+
+    main_calling(story, shuffle, "Objects: ");
+
+    // 1: round, 2: object, 3: sum, 4: child, 5: temporary
+    story.begin(shuffle, 5);
+    auto round = story.label();
+    auto item = story.label();
+    auto without = story.label();
+    auto moved = story.label();
+    auto room = story.label();
+    auto child = story.label();
+    auto next_room = story.label();
+
+    story.bind(round);
+    story.op(Mnemonic::STORE, { reference(local(2)), 5 });
+
+    // Move every item to another room, flip an attribute and update a property
+    story.bind(item);
+    story.op(Mnemonic::ADD, { local(2), local(1) }, local(5));
+    story.op(Mnemonic::AND, { local(5), 3 }, local(5));
+    story.op(Mnemonic::ADD, { local(5), 1 }, local(5));
+    story.op(Mnemonic::INSERT_OBJ, { local(2), local(5) });
+    story.op(Mnemonic::TEST_ATTR, { local(2), 3 }, Branch::unless(without));
+    story.op(Mnemonic::CLEAR_ATTR, { local(2), 3 });
+    story.jump(moved);
+    story.bind(without);
+    story.op(Mnemonic::SET_ATTR, { local(2), 3 });
+    story.bind(moved);
+    story.op(Mnemonic::GET_PROP, { local(2), 10 }, local(5));
+    story.op(Mnemonic::ADD, { local(3), local(5) }, local(3));
+    story.op(Mnemonic::PUT_PROP, { local(2), 10, local(3) });
+    story.op(Mnemonic::GET_PROP, { local(2), 20 }, local(5));
+    story.op(Mnemonic::ADD, { local(3), local(5) }, local(3));
+    story.op(Mnemonic::INC_CHK, { reference(local(2)), 4 + OBJECTS_ITEMS }, Branch::unless(item));
+
+    // Walk the contents of every room
+    story.op(Mnemonic::STORE, { reference(local(5)), 1 });
+    story.bind(room);
+    story.op(Mnemonic::GET_CHILD, { local(5) }, local(4), Branch::unless(next_room));
+    story.bind(child);
+    story.op(Mnemonic::GET_PARENT, { local(4) }, sp);
+    story.op(Mnemonic::ADD, { local(3), sp }, local(3));
+    story.op(Mnemonic::GET_SIBLING, { local(4) }, local(4), Branch::when(child));
+    story.bind(next_room);
+    story.op(Mnemonic::INC_CHK, { reference(local(5)), 4 }, Branch::unless(room));
+
+    story.op(Mnemonic::INC_CHK, { reference(local(1)), OBJECTS_ROUNDS - 1 }, Branch::unless(round));
+    story.op(Mnemonic::RET, { local(3) });
+
+    return story.build();
+}
+
+template<uint8_t Version>
+static std::vector<uint8_t> text() {
+    zm::StoryBuilder<Version> story;
+    Argument describe = story.routine();
+
+    for (const char *abbreviation : { "the ", "The ", "and ", "you ", "ing ", "tion", "here", "ere ", ", ", ". " }) {
+        story.abbreviate(abbreviation);
+    }
+
+    uint16_t lamp = story.add_object("brass lantern");
+    Argument forest = story.string(
+        "You are standing in a clearing in the middle of the forest. Paths lead off in every direction, and "
+        "the trees here are so tall that you can barely see the sky.\n");
+    Argument house = story.string(
+        "There is a small white house here, with a boarded front door. Somebody has left a mailbox by the path; "
+        "its flag is up (which means there is mail, or that the postman forgot).\n");
+
+    main_calling(story, describe, "Text: ");
+
+    // 1: round
+    story.begin(describe, 1);
+    auto round = story.label();
+    story.bind(round);
+    story.op(Mnemonic::PRINT_PADDR, { forest });
+    story.print("Round ");
+    story.op(Mnemonic::PRINT_NUM, { local(1) });
+    story.op(Mnemonic::PRINT_CHAR, { ':' });
+    story.print(" the ");
+    story.op(Mnemonic::PRINT_OBJ, { lamp });
+    story.print(" is here, shining brightly. You could take it, and then you would be carrying something useful.");
+    story.op(Mnemonic::NEW_LINE);
+    story.op(Mnemonic::PRINT_PADDR, { house });
+    story.op(Mnemonic::INC_CHK, { reference(local(1)), TEXT_ROUNDS - 1 }, Branch::unless(round));
+    story.op(Mnemonic::RET, { local(1) });
+
+    return story.build();
+}
+
+template<uint8_t Version>
+static std::vector<uint8_t> parser() {
+    zm::StoryBuilder<Version> story;
+    Argument parse = story.routine();
+
+    const char *verbs[] = { "take", "drop", "open", "close", "look", "go" };
+    const char *others[] = { "the", "a", "lamp", "brass", "lantern", "mailbox", "leaflet", "door", "north", "south", "east",
+                             "west", "up", "down", "in", "all", "it", "with", "sword", "bottle", "water", "window",
+                             "inventory", "examine", "read", "put", "and", "then", "house", "forest" };
+
+    std::vector<Argument> verb_words;
+
+    for (const char *verb : verbs) {
+        verb_words.push_back(story.word(verb));
+    }
+
+    for (const char *other : others) {
+        story.word(other);
+    }
+
+    // Up to version 4 the text buffer also holds the terminating zero
+    Argument text_buffer = story.array(82, { Version <= 4 ? 81 : 80 });
+    Argument parse_buffer = story.array(2 + 4 * PARSER_MAX_WORDS, { PARSER_MAX_WORDS });
+
+    story.begin_main();
+    story.op(call<Version>(), { parse }, global(0));
+    story.print("Parser: ");
+    story.op(Mnemonic::PRINT_NUM, { global(0) });
+    story.print(", unknown words: ");
+    story.op(Mnemonic::PRINT_NUM, { global(1) });
+    story.op(Mnemonic::NEW_LINE);
+    story.op(Mnemonic::QUIT);
+
+    // 1: line, 2: word, 3: word count, 4: dictionary entry, 5: sum, 6: temporary
+    story.begin(parse, 6);
+    auto line = story.label();
+    auto next_word = story.label();
+    auto verb = story.label();
+    auto unknown = story.label();
+    auto counted = story.label();
+    auto done = story.label();
+
+    story.bind(line);
+
+    if (Version <= 4) {
+        story.op(Mnemonic::SREAD, { text_buffer, parse_buffer });
+    } else {
+        story.op(Mnemonic::AREAD, { text_buffer, parse_buffer }, local(6));
+    }
+
+    story.op(Mnemonic::LOADB, { parse_buffer, 1 }, local(3));
+    story.op(Mnemonic::STORE, { reference(local(2)), 0 });
+
+    // Tell verbs from other known words and from unknown ones
+    story.bind(next_word);
+    story.op(Mnemonic::JL, { local(2), local(3) }, Branch::unless(done));
+    story.op(Mnemonic::MUL, { local(2), 2 }, local(6));
+    story.op(Mnemonic::ADD, { local(6), 1 }, local(6));
+    story.op(Mnemonic::LOADW, { parse_buffer, local(6) }, local(4));
+    story.op(Mnemonic::JZ, { local(4) }, Branch::when(unknown));
+    story.op(Mnemonic::JE, { local(4), verb_words[0], verb_words[1], verb_words[2] }, Branch::when(verb));
+    story.op(Mnemonic::JE, { local(4), verb_words[3], verb_words[4], verb_words[5] }, Branch::when(verb));
+    story.op(Mnemonic::ADD, { local(5), local(4) }, local(5));
+    story.jump(counted);
+    story.bind(verb);
+    story.op(Mnemonic::ADD, { local(5), 1000 }, local(5));
+    story.jump(counted);
+    story.bind(unknown);
+    story.op(Mnemonic::INC, { reference(global(1)) });
+    story.bind(counted);
+    story.op(Mnemonic::INC, { reference(local(2)) });
+    story.jump(next_word);
+
+    // From version 5 on the line is parsed a second time, by the story itself
+    story.bind(done);
+
+    if (Version >= 5) {
+        story.op(Mnemonic::TOKENISE, { text_buffer, parse_buffer });
+        story.op(Mnemonic::LOADB, { parse_buffer, 1 }, local(6));
+        story.op(Mnemonic::ADD, { local(5), local(6) }, local(5));
+    }
+
+    story.op(Mnemonic::INC_CHK, { reference(local(1)), PARSER_LINES - 1 }, Branch::unless(line));
+    story.op(Mnemonic::RET, { local(5) });
+
+    return story.build();
+}
+
+static std::vector<std::string> parser_input() {
+    const char *commands[] = {
+        "take the brass lamp",
+        "open the mailbox and read the leaflet",
+        "go north, then go east",
+        "put the sword and the bottle in the mailbox",
+        "examine the frobozz",
+        "look",
+        "drop all",
+        "close the window. take water from the bottle"
+    };
+
+    std::vector<std::string> lines;
+
+    for (int i = 0; i < PARSER_LINES; ++i) {
+        lines.push_back(commands[i % 8]);
+    }
+
+    return lines;
+}
+
+template<uint8_t Version>
+static std::vector<zm::MacroStory> build_stories() {
+    return {
+        { "arithmetic", Version, arithmetic<Version>(), {} },
+        { "recursion", Version, recursion<Version>(), {} },
+        { "objects", Version, objects<Version>(), {} },
+        { "text", Version, text<Version>(), {} },
+        { "parser", Version, parser<Version>(), parser_input() }
+    };
+}
+
+std::vector<zm::MacroStory> zm::build_macro_stories(uint8_t version) {
+    switch (version) {
+        case 3 : return build_stories<3>();
+        case 5 : return build_stories<5>();
+        case 8 : return build_stories<8>();
+        default :
+            spdlog::error("There are no macro-benchmark stories for version {}", version);
+            return {};
+    }
+}
@@ -0,0 +1,26 @@
+#ifndef ZETAMACHINE_BENCH_STORIES_H
+#define ZETAMACHINE_BENCH_STORIES_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace zm {
+    // A story that exercises one part of the interpreter, and the lines typed into it
+    struct MacroStory {
+        std::string name;
+        uint8_t version;
+        std::vector<uint8_t> image;
+        std::vector<std::string> input;
+    };
+
+    /*
+     * Builds the macro-benchmark stories for a version (3, 5 or 8): a tight
+     * arithmetic loop, deep recursion, shuffling the object tree, printing
+     * lots of text and parsing typed commands. Each one prints a result
+     * that depends on all its work before it quits.
+     */
+    std::vector<MacroStory> build_macro_stories(uint8_t version);
+}
+
+#endif //ZETAMACHINE_BENCH_STORIES_H
@@ -0,0 +1,119 @@
+#include "stories.h"
+
+#include "../headless.h"
+#include "../machine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * End-to-end throughput: runs the macro-benchmark stories through Machine,
+ * the best of a few rounds each, and reports Z instructions per second as CSV.
+ */
+int main(int argc, char *argv[]) {
+    zm::Options options;
+    std::vector<uint8_t> versions { 3, 5, 8 };
+    std::string filter;
+    std::string output;
+    std::string directory;
+    int rounds = 3;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+
+        if (argument == "--no-fusion") {
+            options.fusion = false;
+        } else if (argument == "--no-translation") {
+            options.translation = false;
+        } else if (argument == "--jit") {
+            options.jit = true;
+        } else if (argument == "--checked") {
+            options.checked = true;
+        } else if (argument == "--version" && i + 1 < argc) {
+            versions = { static_cast<uint8_t>(std::stoi(argv[++i])) };
+        } else if (argument == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (argument == "--rounds" && i + 1 < argc) {
+            rounds = std::max(1, std::stoi(argv[++i]));
+        } else if (argument == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (argument == "--write" && i + 1 < argc) {
+            directory = argv[++i];
+        } else {
+            std::cerr << "Usage: zetamachine_throughput [--no-fusion] [--no-translation] [--jit] [--checked] [--version <3|5|8>] [--filter <name>] [--rounds <n>] [--output <file.csv>] [--write <directory>]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::ofstream file;
+
+    if (!output.empty()) {
+        file.open(output);
+
+        if (!file) {
+            std::cerr << "Could not write " << output << std::endl;
+            return 1;
+        }
+    }
+
+    std::ostream &out = output.empty() ? std::cout : file;
+    out << "story,version,instructions,seconds,instructions_per_second,result\n";
+
+    for (uint8_t version : versions) {
+        for (const auto &story : zm::build_macro_stories(version)) {
+            if (story.image.empty()) {
+                return 1;
+            }
+
+            if (!filter.empty() && story.name.find(filter) == std::string::npos) {
+                continue;
+            }
+
+            // The story and its input, to run with zetamachine <story> < <input>
+            if (!directory.empty()) {
+                std::string path = directory + "/" + story.name + ".z" + std::to_string(version);
+                std::ofstream image(path, std::ios::binary);
+                image.write(reinterpret_cast<const char *>(story.image.data()), static_cast<std::streamsize>(story.image.size()));
+
+                std::ofstream input(path + ".txt");
+
+                for (const auto &line : story.input) {
+                    input << line << "\n";
+                }
+            }
+
+            uint64_t instructions = 0;
+            double best = 0.0;
+            std::string last;
+
+            for (int round = 0; round < rounds; ++round) {
+                zm::Transcript video { 0x1000 };
+                zm::ScriptedInput input { story.input };
+
+                zm::Machine machine {};
+                machine.configure(options);
+                machine.attach(&video, &input);
+
+                auto start = std::chrono::steady_clock::now();
+                instructions = machine.run(story.image);
+                std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+                if (round == 0 || elapsed.count() < best) {
+                    best = elapsed.count();
+                }
+
+                last = video.last_line();
+            }
+
+            out << story.name << "," << static_cast<int>(version) << "," << instructions << "," << std::fixed << std::setprecision(6) << best << ","
+                << std::setprecision(0) << static_cast<double>(instructions) / best << ",\"" << last << "\"\n";
+        }
+    }
+
+    return 0;
+}
@@ -1,13 +1,60 @@
 #include "call_stack.h"
 
+#include <atomic>
 
-void zm::CallStack::push(zm::address program_counter) {
-    frames.emplace(StackFrame { program_counter });
+
+zm::CallStack::CallStack() : words(INITIAL_STACK_WORDS) {
+    frames.reserve(INITIAL_STACK_FRAMES);
+}
+
+zm::StackFrame &zm::CallStack::push(zm::address program_counter, uint8_t locals) {
+    if (profile) {
+        profile->enter(program_counter);
+    }
+
+    StackFrame frame {};
+    frame.program_counter = program_counter;
+    frame.start = program_counter;
+    frame.base = top;
+    frame.arity = locals;
+
+    // Grown here rather than by push_back, so that the sampling profiler can tell when not to look
+    if (frames.size() == frames.capacity()) {
+        moving_frames = 1;
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        frames.reserve(frames.capacity() << 1);
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        moving_frames = 0;
+    }
+
+    frames.push_back(frame);
+    std::atomic_signal_fence(std::memory_order_release);
+    set_depth(0);
+
+    return frames.back();
+}
+
+void zm::CallStack::unwind(size_t index) {
+    if (index < frames.size()) {
+        for (size_t i = index; profile && i < frames.size(); ++i) {
+            profile->leave();
+        }
+
+        top = frames[index].base;
+        frames.resize(index);
+    }
+}
+
+uint32_t zm::CallStack::depth(size_t index) const {
+    uint32_t end = index + 1 < frames.size() ? frames[index + 1].base : top;
+
+    return end - frames[index].base - frames[index].arity;
 }
 
-zm::StackFrame zm::CallStack::pop() {
-    zm::StackFrame frame = frames.top();
-    frames.pop();
+void zm::CallStack::set_depth(uint32_t depth) {
+    top = frames.back().base + frames.back().arity + depth;
 
-    return std::move(frame);
+    if (top > words.size()) {
+        words.resize(top << 1);
+    }
 }
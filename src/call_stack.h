@@ -2,8 +2,16 @@
 #define ZETAMACHINE_CALL_STACK_H
 
 
+#include <csignal>
+#include <cstddef>
 #include <cstdint>
-#include <stack>
+#include <vector>
+
+#include "routine_profile.h"
+
+// Initial sizes of the call stack, it grows past them when a story goes deeper
+#define INITIAL_STACK_WORDS 0x4000
+#define INITIAL_STACK_FRAMES 0x100
 
 namespace zm {
     enum class CallType {
@@ -16,24 +24,96 @@ namespace zm {
     using word = uint16_t;
     using address = uint32_t;
 
+    struct TranslatedRoutine;
+
+    /*
+     * Frame record. Its locals and then its evaluation stack live in the
+     * word stack of the CallStack from base on, like a Quetzal Stks frame.
+     */
     struct StackFrame {
         address program_counter;
-        word variables[16];
-        CallType call_type;
+        address start; // Where the routine begins, its header
+        uint32_t base;
         uint8_t arity;
-        std::stack<word> routine_stack;
+        uint8_t argument_count;
         bool store_on_return;
         uint8_t store_to;
+        bool tail_return; // Called from a fused call_vs/ret_popped: return from the caller too
+
+        // Set when the routine runs as IR: where it stands. Its temporaries are its evaluation stack
+        const TranslatedRoutine *routine;
+        uint32_t ir_index;
     };
 
+    /*
+     * All frames share one contiguous word stack, and frames are addressed
+     * by index: calling and returning only move the top, and unwinding to a
+     * frame (throw) is a single step.
+     */
     class CallStack {
     public:
-        void push(address program_counter);
+        CallStack();
+
+        // Adds a frame with room for that many locals, which are left for the caller to set
+        StackFrame &push(address program_counter, uint8_t locals);
+
+        void pop() {
+            if (profile) {
+                profile->leave();
+            }
+
+            top = frames.back().base;
+            frames.pop_back();
+        }
+
+        // Drops every frame from index on
+        void unwind(size_t index);
+
+        StackFrame &get_frame() { return frames.back(); }
+        StackFrame &get_frame(size_t index) { return frames[index]; }
+        const StackFrame &get_frame(size_t index) const { return frames[index]; }
+        size_t size() const { return frames.size(); }
+
+        // Set while the frames move to larger storage, when a signal handler must not read them
+        bool moving() const { return moving_frames != 0; }
+
+        // Locals of the top frame, valid until the next push
+        word *variables() { return &words[frames.back().base]; }
+
+        // Evaluation stack of the top frame
+        void push_value(word value) {
+            if (top == words.size()) {
+                words.resize(words.size() << 1);
+            }
+
+            words[top++] = value;
+        }
+
+        word pop_value() { return words[--top]; }
+        bool stack_empty() const { return top == frames.back().base + frames.back().arity; }
+        word &top_value() { return words[top - 1]; }
+
+        // Locals of a frame
+        const word *locals(size_t index) const { return &words[frames[index].base]; }
+
+        // Values on the evaluation stack of a frame
+        uint32_t depth(size_t index) const;
+        const word *stack(size_t index) const { return &words[frames[index].base + frames[index].arity]; }
+
+        // Makes the evaluation stack of the top frame that deep, e.g. for the temporaries of IR frames
+        void set_depth(uint32_t depth);
+
+        // Tells the profile about every routine entered and left from now on
+        void set_profile(RoutineProfile *profile) { this->profile = profile; }
 
-        StackFrame &get_frame() { return frames.top(); }
-        StackFrame pop();
     private:
-        std::stack<StackFrame> frames;
+        std::vector<word> words;
+        uint32_t top = 0;
+
+        std::vector<StackFrame> frames;
+        volatile std::sig_atomic_t moving_frames = 0;
+
+        RoutineProfile *profile = nullptr;
     };
 }
 
@@ -0,0 +1,135 @@
+#include "decoder.h"
+
+#include "memory/memory.h"
+#include "memory/zchar_mapper.h"
+
+constexpr zm::OperandTypeTable zm::OperandTypeLookup::table;
+
+template<uint8_t Version>
+zm::Decoder<Version>::Decoder(zm::Memory &memory) : memory(memory), end(memory.capacity()) { }
+
+template<uint8_t Version>
+uint8_t zm::Decoder<Version>::byte(zm::address at) {
+    return at < end ? memory.read_byte(at) : 0;
+}
+
+template<uint8_t Version>
+uint16_t zm::Decoder<Version>::word(zm::address at) {
+    return at + 1 < end ? memory.read_word(at) : static_cast<uint16_t>(byte(at) << 8);
+}
+
+template<uint8_t Version>
+void zm::Decoder<Version>::decode_operand(zm::OperandType type, zm::address &pc, zm::DecodedInstruction &decoded) {
+    switch (type) {
+        case OperandType::BYTE : decoded.operands[decoded.operand_count++] = Operand { OperandType::BYTE, byte(pc++) }; break;
+        case OperandType::VARIABLE_NUMBER : decoded.operands[decoded.operand_count++] = Operand { OperandType::VARIABLE_NUMBER, byte(pc++) }; break;
+        case OperandType::WORD : decoded.operands[decoded.operand_count++] = Operand { OperandType::WORD, word(pc) }; pc += 2; break;
+        default : break;
+    }
+}
+
+template<uint8_t Version>
+bool zm::Decoder<Version>::decode_operands(uint8_t definition, zm::address &pc, zm::DecodedInstruction &decoded) {
+    const OperandTypes &types = OperandTypeLookup::table.entries[definition];
+
+    for (uint8_t i = 0; i < types.count; ++i) {
+        decode_operand(types.types[i], pc, decoded);
+    }
+
+    // Tells whether the following definition byte, if any, may still add operands
+    return types.count == 4;
+}
+
+template<uint8_t Version>
+zm::DecodedInstruction zm::Decoder<Version>::decode(zm::address pc) {
+    const OpcodeTable &table = InstructionTable<Version>::table;
+    DecodedInstruction decoded {};
+    decoded.pc = pc;
+
+    // ------ Read instruction ------
+    uint8_t opcode = byte(pc++);
+
+    // Figure out what kind of instruction this is...
+    if (Version >= 5 && opcode == 0xBE) {
+        opcode = byte(pc++);
+        decoded.instruction = table.extended_set[opcode];
+    } else {
+        decoded.instruction = table.set[opcode];
+    }
+
+    const Instruction &instruction = decoded.instruction;
+
+    // Decode operands
+    if (instruction.opcode_type == OpcodeType::OP2) {
+        auto operand_1_type = instruction.value & 0x40 ? OperandType::VARIABLE_NUMBER : OperandType::BYTE;
+        auto operand_2_type = instruction.value & 0x20 ? OperandType::VARIABLE_NUMBER : OperandType::BYTE;
+
+        decoded.operands[decoded.operand_count++] = Operand { operand_1_type, byte(pc++) };
+        decoded.operands[decoded.operand_count++] = Operand { operand_2_type, byte(pc++) };
+
+    } else if (instruction.opcode_type == OpcodeType::OP1) {
+        decode_operand(operand_type((instruction.value & 0x30) >> 4), pc, decoded);
+
+    } else if (instruction.opcode_type == OpcodeType::VAR || instruction.opcode_type == OpcodeType::EXT) {
+        // The double variable calls carry a second operand definition byte
+        bool double_definition = Version >= 4 && instruction.opcode_type == OpcodeType::VAR &&
+                (instruction.mnemonic == Mnemonic::CALL_VS2 || instruction.mnemonic == Mnemonic::CALL_VN2);
+
+        uint8_t first_definition = byte(pc++);
+        uint8_t second_definition = double_definition ? byte(pc++) : 0xFF;
+
+        if (decode_operands(first_definition, pc, decoded)) {
+            decode_operands(second_definition, pc, decoded);
+        }
+    }
+
+    if (instruction.store) {
+        decoded.store_variable = byte(pc++);
+    }
+
+    if (instruction.branch) {
+        /*
+         * Instructions which test a condition are called "branch" instructions.
+         * The branch information is stored in one or two bytes, indicating what to do with the result of the test.
+         * If bit 7 of the first byte is 0, a branch occurs when the condition was false; if 1, then branch is on true.
+         * If bit 6 is set, then the branch occupies 1 byte only, and the "offset" is in the range 0 to 63, given in the bottom 6 bits.
+         * If bit 6 is clear, then the offset is a signed 14-bit number given in bits 0 to 5 of the first byte followed by all 8 of the second.
+         */
+        uint16_t operand = byte(pc);
+
+        decoded.branch_on_true = (operand & 0x0080) != 0;
+
+        if (!(operand & 0x0040)) { // Both bytes at once
+            operand = word(pc);
+            pc += 2;
+            uint16_t offset = operand & 0x3FFF;
+            decoded.branch_offset = static_cast<int16_t>((offset & 0x2000) ? (offset | 0xC000) : offset);
+
+        } else {
+            decoded.branch_offset = operand & 0x3F;
+            ++pc;
+        }
+    }
+
+    // Skip over the inline string of the printing instructions
+    if (instruction.mnemonic == Mnemonic::PRINT || instruction.mnemonic == Mnemonic::PRINT_RET) {
+        decoded.text_address = pc;
+        pc += ZCharMapper{ memory, end }.word_len(pc) << 1;
+    }
+
+    decoded.next_pc = pc;
+    decoded.reads_input = instruction.mnemonic == Mnemonic::SREAD || instruction.mnemonic == Mnemonic::AREAD ||
+            instruction.mnemonic == Mnemonic::READ_CHAR;
+    decoded.handler = static_cast<uint16_t>(instruction.mnemonic);
+
+    return decoded;
+}
+
+template class zm::Decoder<1>;
+template class zm::Decoder<2>;
+template class zm::Decoder<3>;
+template class zm::Decoder<4>;
+template class zm::Decoder<5>;
+template class zm::Decoder<6>;
+template class zm::Decoder<7>;
+template class zm::Decoder<8>;
@@ -0,0 +1,114 @@
+#ifndef ZETAMACHINE_DECODER_H
+#define ZETAMACHINE_DECODER_H
+
+#include <cstdint>
+
+#include "instructions.h"
+#include "call_stack.h"
+
+#define MAX_OPERANDS 8
+
+namespace zm {
+    class Memory;
+
+    enum class OperandType {
+        WORD,
+        VARIABLE_NUMBER,
+        BYTE,
+        OMITTED,
+        STORE,
+        BRANCH,
+    };
+
+    struct Operand {
+        OperandType type;
+        uint16_t value;
+    };
+
+    // The operands described by one VAR/EXT operand type byte, up to the first omitted one
+    struct OperandTypes {
+        uint8_t count;
+        OperandType types[4];
+    };
+
+    struct OperandTypeTable {
+        OperandTypes entries[256];
+    };
+
+    constexpr OperandType operand_type(uint8_t bits) {
+        return bits == 0x00 ? OperandType::WORD : (bits == 0x01 ? OperandType::BYTE : (bits == 0x02 ? OperandType::VARIABLE_NUMBER : OperandType::OMITTED));
+    }
+
+    constexpr OperandTypeTable make_operand_type_table() {
+        OperandTypeTable table {};
+
+        for (int definition = 0; definition < 256; ++definition) {
+            auto &entry = table.entries[definition];
+
+            for (int i = 3; i >= 0; --i) {
+                auto type = operand_type((definition >> (i << 1)) & 0x03);
+
+                // Once an operand is omitted, all the following ones are too
+                if (type == OperandType::OMITTED) {
+                    break;
+                }
+
+                entry.types[entry.count++] = type;
+            }
+        }
+
+        return table;
+    }
+
+    struct OperandTypeLookup {
+        static constexpr OperandTypeTable table = make_operand_type_table();
+    };
+
+    /*
+     * Everything needed to execute an instruction without looking at
+     * its bytes again: operands, store target, branch data and the
+     * address of the instruction that follows it.
+     */
+    struct DecodedInstruction {
+        Instruction instruction;
+        uint8_t operand_count;
+        Operand operands[MAX_OPERANDS];
+        uint8_t store_variable;
+        bool branch_on_true;
+        int16_t branch_offset;
+        address text_address; // Inline string of PRINT and PRINT_RET
+        address pc;
+        address next_pc;
+
+        bool reads_input; // Waits for input before anything else is done, when it is not ready
+
+        uint16_t handler; // The mnemonic, or a fused handler when fused_next is set
+        const DecodedInstruction *fused_next;
+    };
+
+    /*
+     * Decodes instructions from memory before end, the whole of it unless
+     * given. Bytes from end on read as zero and an inline string runs to it
+     * at most, so an instruction cut off by the end decodes past it.
+     */
+    template<uint8_t Version>
+    class Decoder {
+    public:
+        explicit Decoder(Memory &memory);
+        Decoder(Memory &memory, address end) : memory(memory), end(end) { }
+
+        DecodedInstruction decode(address pc);
+
+    private:
+        Memory &memory;
+        address end;
+
+        uint8_t byte(address at);
+        uint16_t word(address at);
+
+        void decode_operand(OperandType type, address &pc, DecodedInstruction &decoded);
+        bool decode_operands(uint8_t definition, address &pc, DecodedInstruction &decoded);
+    };
+}
+
+#endif //ZETAMACHINE_DECODER_H
@@ -0,0 +1,61 @@
+#include "fusion.h"
+
+#include <algorithm>
+
+// Operand known at decode time: a constant, not a variable to be read
+static bool constant(const zm::Operand &operand) {
+    return operand.type != zm::OperandType::VARIABLE_NUMBER;
+}
+
+zm::Fusion zm::match_fusion(const zm::DecodedInstruction &first, const zm::DecodedInstruction &second) {
+    Mnemonic a = first.instruction.mnemonic;
+    Mnemonic b = second.instruction.mnemonic;
+
+    // je a b ?label; jump elsewhere
+    if (a == Mnemonic::JE && b == Mnemonic::JUMP && constant(second.operands[0])) {
+        return Fusion::JE_JUMP;
+    }
+
+    // loadw/loadb -> var; jz var ?label
+    if ((a == Mnemonic::LOADW || a == Mnemonic::LOADB) && b == Mnemonic::JZ &&
+        second.operands[0].type == OperandType::VARIABLE_NUMBER && second.operands[0].value == first.store_variable) {
+        return a == Mnemonic::LOADW ? Fusion::LOADW_JZ : Fusion::LOADB_JZ;
+    }
+
+    // get_prop -> sp; store var sp
+    if (a == Mnemonic::GET_PROP && b == Mnemonic::STORE && first.store_variable == 0x00 &&
+        constant(second.operands[0]) && second.operands[1].type == OperandType::VARIABLE_NUMBER && second.operands[1].value == 0x00) {
+        return Fusion::GET_PROP_STORE;
+    }
+
+    // inc var; jump loop
+    if (a == Mnemonic::INC && b == Mnemonic::JUMP && constant(first.operands[0]) && constant(second.operands[0])) {
+        return Fusion::INC_JUMP;
+    }
+
+    // call_vs -> sp; ret_popped
+    if ((a == Mnemonic::CALL_VS || a == Mnemonic::CALL) && first.store_variable == 0x00 && b == Mnemonic::RET_POPPED) {
+        return Fusion::CALL_VS_RET_POPPED;
+    }
+
+    return Fusion::NONE;
+}
+
+void zm::PairProfile::print(std::ostream &out, int limit) const {
+    std::vector<int> order(counts.size());
+
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<int>(i);
+    }
+
+    std::sort(order.begin(), order.end(), [this](int a, int b) { return counts[a] > counts[b]; });
+
+    out << "Most frequent opcode pairs:" << std::endl;
+
+    for (int i = 0; i < limit && counts[order[i]] > 0; ++i) {
+        int first = order[i] / MNEMONIC_COUNT;
+        int second = order[i] % MNEMONIC_COUNT;
+
+        out << "\t" << mnemonic_names[first] << " -> " << mnemonic_names[second] << "\t" << counts[order[i]] << std::endl;
+    }
+}
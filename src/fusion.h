@@ -0,0 +1,63 @@
+#ifndef ZETAMACHINE_FUSION_H
+#define ZETAMACHINE_FUSION_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "decoder.h"
+#include "instructions.h"
+
+/*
+ * Instruction pairs that run as one handler. Picked from opcode pair counts
+ * (see PairProfile), and restricted to shapes where the second instruction's
+ * operands are known when the pair is decoded.
+ */
+#define ZM_FUSIONS(X) \
+    X(JE_JUMP) X(LOADW_JZ) X(LOADB_JZ) X(GET_PROP_STORE) X(INC_JUMP) X(CALL_VS_RET_POPPED)
+
+namespace zm {
+    enum class Fusion {
+#define ZM_FUSION_ENUM(name) name,
+        ZM_FUSIONS(ZM_FUSION_ENUM)
+#undef ZM_FUSION_ENUM
+        NONE
+    };
+
+    constexpr const char *fusion_names[] = {
+#define ZM_FUSION_NAME(name) #name,
+        ZM_FUSIONS(ZM_FUSION_NAME)
+#undef ZM_FUSION_NAME
+    };
+
+    // Fused handlers are numbered right after the plain mnemonic handlers
+    constexpr uint16_t fused_handler(Fusion fusion) { return static_cast<uint16_t>(MNEMONIC_COUNT + static_cast<int>(fusion)); }
+
+    constexpr int HANDLER_COUNT = MNEMONIC_COUNT + static_cast<int>(Fusion::NONE);
+
+    // Which fused handler, if any, can run first followed by second
+    Fusion match_fusion(const DecodedInstruction &first, const DecodedInstruction &second);
+
+    /*
+     * Counts consecutive mnemonic pairs as they execute. This is the data the
+     * fusion patterns are chosen from; run a story with --pair-profile to get it.
+     */
+    class PairProfile {
+    public:
+        PairProfile() : counts(MNEMONIC_COUNT * MNEMONIC_COUNT, 0) { }
+
+        void record(Mnemonic mnemonic) {
+            auto index = static_cast<int>(mnemonic);
+            ++counts[previous * MNEMONIC_COUNT + index];
+            previous = index;
+        }
+
+        void print(std::ostream &out, int limit) const;
+
+    private:
+        std::vector<uint64_t> counts;
+        int previous = 0;
+    };
+}
+
+#endif //ZETAMACHINE_FUSION_H
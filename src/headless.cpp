@@ -0,0 +1,50 @@
+#include "headless.h"
+
+void zm::Transcript::print(const std::string &text) {
+    contents += text;
+
+    // Trimmed in large steps, so appending stays cheap
+    if (limit != 0 && contents.size() > limit << 1) {
+        contents.erase(0, contents.size() - limit);
+    }
+}
+
+std::string zm::Transcript::last_line() const {
+    size_t end = contents.find_last_not_of('\n');
+
+    if (end == std::string::npos) {
+        return "";
+    }
+
+    size_t start = contents.rfind('\n', end);
+    start = start == std::string::npos ? 0 : start + 1;
+
+    return contents.substr(start, end - start + 1);
+}
+
+bool zm::ScriptedInput::read_line(std::string &line) {
+    if (next == lines.size()) {
+        return false;
+    }
+
+    requests.push_back(std::chrono::steady_clock::now());
+    line = lines[next++];
+
+    if (echo) {
+        echo->print(line + "\n");
+    }
+
+    return true;
+}
+
+bool zm::ScriptedInput::read_char(uint8_t &character) {
+    std::string line;
+
+    if (!read_line(line)) {
+        return false;
+    }
+
+    // A line stands for one key press, an empty one for return
+    character = line.empty() ? 13 : static_cast<uint8_t>(line[0]);
+    return true;
+}
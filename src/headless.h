@@ -0,0 +1,55 @@
+#ifndef ZETAMACHINE_HEADLESS_H
+#define ZETAMACHINE_HEADLESS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "input.h"
+#include "video.h"
+
+namespace zm {
+    /*
+     * What a session printed, with the lines typed into it echoed after their
+     * prompt. With a limit, only about that many of the latest characters are kept.
+     */
+    class Transcript : public Video {
+    public:
+        explicit Transcript(size_t limit = 0) : limit(limit) { }
+
+        void print(const std::string &text) override;
+
+        const std::string &text() const { return contents; }
+
+        // The last line that is not empty
+        std::string last_line() const;
+
+    private:
+        size_t limit;
+        std::string contents;
+    };
+
+    /*
+     * Types a script of lines, then reports that no more input will come.
+     * Remembers when the story asked for every line it got, which ends a turn.
+     */
+    class ScriptedInput : public Input {
+    public:
+        explicit ScriptedInput(const std::vector<std::string> &lines, Transcript *echo = nullptr) : lines(lines), echo(echo) { }
+
+        bool read_line(std::string &line) override;
+        bool read_char(uint8_t &character) override;
+
+        const std::vector<std::chrono::steady_clock::time_point> &get_requests() const { return requests; }
+
+    private:
+        const std::vector<std::string> &lines;
+        Transcript *echo;
+        size_t next = 0;
+        std::vector<std::chrono::steady_clock::time_point> requests;
+    };
+}
+
+#endif //ZETAMACHINE_HEADLESS_H
@@ -0,0 +1,62 @@
+#include "input.h"
+
+#include <iostream>
+
+bool zm::Input::read_line(std::string &line) {
+    return static_cast<bool>(std::getline(std::cin, line));
+}
+
+bool zm::Input::read_char(uint8_t &character) {
+    auto value = std::cin.get();
+
+    if (value == std::char_traits<char>::eof()) {
+        return false;
+    }
+
+    character = static_cast<uint8_t>(value == '\n' ? 13 : value);
+    return true;
+}
+
+bool zm::QueuedInput::ready() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return !lines.empty() || closed;
+}
+
+bool zm::QueuedInput::read_line(std::string &line) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (lines.empty()) {
+        return false;
+    }
+
+    line = std::move(lines.front());
+    lines.pop_front();
+    return true;
+}
+
+bool zm::QueuedInput::read_char(uint8_t &character) {
+    std::string line;
+
+    if (!read_line(line)) {
+        return false;
+    }
+
+    // A line stands for one key press, an empty one for return
+    character = line.empty() ? 13 : static_cast<uint8_t>(line[0]);
+    return true;
+}
+
+void zm::QueuedInput::push_line(const std::string &line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    lines.push_back(line);
+}
+
+void zm::QueuedInput::push_char(uint8_t character) {
+    std::lock_guard<std::mutex> lock(mutex);
+    lines.push_back(character == 13 ? std::string() : std::string(1, static_cast<char>(character)));
+}
+
+void zm::QueuedInput::close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+}
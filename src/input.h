@@ -0,0 +1,56 @@
+#ifndef ZETAMACHINE_INPUT_H
+#define ZETAMACHINE_INPUT_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+
+namespace zm {
+    // What a story stopped for, when its input was not ready
+    enum class InputWait {
+        NONE,
+        LINE,
+        CHAR
+    };
+
+    /*
+     * Where the story's input comes from. The default implementation reads
+     * from standard input. Returning false means no more input will come.
+     */
+    class Input {
+    public:
+        virtual ~Input() = default;
+
+        // False while the next input has not arrived: the story then stops and asks again when resumed
+        virtual bool ready() { return true; }
+
+        virtual bool read_line(std::string &line);
+        virtual bool read_char(uint8_t &character);
+    };
+
+    /*
+     * Input handed over by calls from any thread, never blocking the story:
+     * until something is queued the story waits. A queued key is read as a
+     * line of its own by either kind of read.
+     */
+    class QueuedInput : public Input {
+    public:
+        bool ready() override;
+        bool read_line(std::string &line) override;
+        bool read_char(uint8_t &character) override;
+
+        void push_line(const std::string &line);
+        void push_char(uint8_t character);
+
+        // No more input will come: reads past what is queued fail, and the story quits
+        void close();
+
+    private:
+        std::mutex mutex;
+        std::deque<std::string> lines;
+        bool closed = false;
+    };
+}
+
+#endif //ZETAMACHINE_INPUT_H
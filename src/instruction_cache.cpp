@@ -0,0 +1,122 @@
+#include "instruction_cache.h"
+
+template<uint8_t Version>
+zm::InstructionCache<Version>::InstructionCache(zm::Memory &memory, zm::address static_memory_base, zm::address end) :
+    memory(memory),
+    decoder(memory, end),
+    static_memory_base(static_memory_base),
+    pages((memory.capacity() >> INSTRUCTION_CACHE_PAGE_BITS) + 1) {
+    memory.observe_writes(this);
+}
+
+template<uint8_t Version>
+zm::InstructionCache<Version>::~InstructionCache() {
+    memory.ignore_writes(this);
+}
+
+template<uint8_t Version>
+zm::DecodedInstruction &zm::InstructionCache<Version>::slot(zm::address pc) {
+    auto &page = pages[pc >> INSTRUCTION_CACHE_PAGE_BITS];
+
+    if (!page) {
+        page.reset(new Page());
+    }
+
+    return page->entries[pc & INSTRUCTION_CACHE_PAGE_MASK];
+}
+
+template<uint8_t Version>
+const zm::DecodedInstruction &zm::InstructionCache<Version>::decode(zm::address pc) {
+    auto &entry = slot(pc);
+    entry = decoder.decode(pc);
+    pages[pc >> INSTRUCTION_CACHE_PAGE_BITS]->valid.set(pc & INSTRUCTION_CACHE_PAGE_MASK);
+
+    address end = entry.next_pc;
+
+    if (fusion) {
+        /*
+         * Look at the instruction that follows. If it is not cached yet it is
+         * decoded into its slot but left invalid, so that its own first fetch
+         * still gets a chance to fuse with whatever comes after it.
+         */
+        auto &second = slot(entry.next_pc);
+
+        if (!find(entry.next_pc)) {
+            second = decoder.decode(entry.next_pc);
+        }
+
+        auto fused = match_fusion(entry, second);
+
+        if (fused != Fusion::NONE) {
+            entry.handler = fused_handler(fused);
+            entry.fused_next = &second;
+            end = second.next_pc;
+        }
+    }
+
+    // Self-modifying code: start watching the bytes this instruction came from
+    if (pc < static_memory_base) {
+        memory.extend_watch_limit(end);
+    }
+
+    return entry;
+}
+
+template<uint8_t Version>
+const zm::DecodedInstruction *zm::InstructionCache<Version>::find(zm::address pc) {
+    auto &page = pages[pc >> INSTRUCTION_CACHE_PAGE_BITS];
+
+    if (page && page->valid[pc & INSTRUCTION_CACHE_PAGE_MASK]) {
+        return &page->entries[pc & INSTRUCTION_CACHE_PAGE_MASK];
+    }
+
+    return nullptr;
+}
+
+template<uint8_t Version>
+void zm::InstructionCache<Version>::invalidate(zm::address pc) {
+    auto &page = pages[pc >> INSTRUCTION_CACHE_PAGE_BITS];
+
+    if (page) {
+        page->valid.reset(pc & INSTRUCTION_CACHE_PAGE_MASK);
+    }
+}
+
+template<uint8_t Version>
+void zm::InstructionCache<Version>::clear() {
+    for (auto &page : pages) {
+        page.reset();
+    }
+}
+
+template<uint8_t Version>
+void zm::InstructionCache<Version>::notify_write(uint32_t address, uint32_t length) {
+    /*
+     * Any instruction (or fused pair) starting up to 2 * MAX_INSTRUCTION_LENGTH
+     * bytes before the write may cover the written bytes, so look back that
+     * far and drop every entry whose encoding overlaps them.
+     */
+    uint32_t lookback = MAX_INSTRUCTION_LENGTH << 1;
+    uint32_t first = address >= lookback ? address - lookback + 1 : 0;
+
+    for (uint32_t pc = first; pc < address + length; ++pc) {
+        auto entry = find(pc);
+
+        if (entry) {
+            uint32_t end = entry->fused_next ? entry->fused_next->next_pc : entry->next_pc;
+
+            if (end > address) {
+                invalidate(pc);
+            }
+        }
+    }
+}
+
+template class zm::InstructionCache<1>;
+template class zm::InstructionCache<2>;
+template class zm::InstructionCache<3>;
+template class zm::InstructionCache<4>;
+template class zm::InstructionCache<5>;
+template class zm::InstructionCache<6>;
+template class zm::InstructionCache<7>;
+template class zm::InstructionCache<8>;
@@ -0,0 +1,72 @@
+#ifndef ZETAMACHINE_INSTRUCTION_CACHE_H
+#define ZETAMACHINE_INSTRUCTION_CACHE_H
+
+#include <bitset>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "decoder.h"
+#include "fusion.h"
+#include "memory/memory.h"
+
+#define INSTRUCTION_CACHE_PAGE_BITS 8
+#define INSTRUCTION_CACHE_PAGE_SIZE (1 << INSTRUCTION_CACHE_PAGE_BITS)
+#define INSTRUCTION_CACHE_PAGE_MASK (INSTRUCTION_CACHE_PAGE_SIZE - 1)
+
+// Longest possible encoding: EXT opcode, 2 type bytes, 8 word operands, store and 2 branch bytes
+#define MAX_INSTRUCTION_LENGTH 23
+
+namespace zm {
+    /*
+     * Decoded instructions, keyed by the address they were decoded from.
+     * Pages are only allocated for code that actually runs, so the cost
+     * follows the size of the hot code rather than the size of the story.
+     *
+     * Instructions decoded from dynamic memory are watched and dropped
+     * when any of their bytes are written to. Nothing is read from the
+     * end of the story on, see Decoder.
+     */
+    template<uint8_t Version>
+    class InstructionCache : public WriteObserver {
+    public:
+        InstructionCache(Memory &memory, address static_memory_base, address end);
+        ~InstructionCache() override;
+
+        const DecodedInstruction &fetch(address pc) {
+            auto &page = pages[pc >> INSTRUCTION_CACHE_PAGE_BITS];
+
+            if (page && page->valid[pc & INSTRUCTION_CACHE_PAGE_MASK]) {
+                return page->entries[pc & INSTRUCTION_CACHE_PAGE_MASK];
+            }
+
+            return decode(pc);
+        }
+
+        void invalidate(address pc);
+        void clear();
+
+        void set_fusion(bool enabled) { fusion = enabled; clear(); }
+
+        void notify_write(uint32_t address, uint32_t length) override;
+
+    private:
+        struct Page {
+            DecodedInstruction entries[INSTRUCTION_CACHE_PAGE_SIZE];
+            std::bitset<INSTRUCTION_CACHE_PAGE_SIZE> valid;
+        };
+
+        Memory &memory;
+        Decoder<Version> decoder;
+        address static_memory_base;
+        bool fusion = false;
+
+        std::vector<std::unique_ptr<Page>> pages;
+
+        DecodedInstruction &slot(address pc);
+        const DecodedInstruction &decode(address pc);
+        const DecodedInstruction *find(address pc);
+    };
+}
+
+#endif //ZETAMACHINE_INSTRUCTION_CACHE_H
@@ -0,0 +1,530 @@
+#include "jit.h"
+
+bool zm::Jit::compilable(const zm::IrInstruction &ir) {
+    // Returning needs the call stack
+    if (ir.instruction.branch && ir.target >= IR_RETURN_FALSE) {
+        return false;
+    }
+
+    switch (ir.instruction.mnemonic) {
+        case Mnemonic::JE : case Mnemonic::JL : case Mnemonic::JG : case Mnemonic::JZ : case Mnemonic::TEST :
+        case Mnemonic::INC_CHK : case Mnemonic::DEC_CHK : case Mnemonic::ADD : case Mnemonic::SUB :
+        case Mnemonic::MUL : case Mnemonic::DIV : case Mnemonic::MOD : case Mnemonic::AND : case Mnemonic::OR :
+        case Mnemonic::NOT : case Mnemonic::INC : case Mnemonic::DEC : case Mnemonic::STORE : case Mnemonic::LOAD :
+        case Mnemonic::LOADW : case Mnemonic::LOADB : case Mnemonic::STOREW : case Mnemonic::STOREB :
+        case Mnemonic::JUMP : case Mnemonic::PUSH : case Mnemonic::POP : case Mnemonic::NOP :
+            return true;
+        case Mnemonic::PULL :
+            return !ir.instruction.store;
+        default :
+            return false;
+    }
+}
+
+#ifdef ZM_JIT
+
+#include <cstddef>
+#include <cstring>
+#include <sys/mman.h>
+
+namespace {
+    using zm::IrInstruction;
+    using zm::Mnemonic;
+    using zm::Register;
+    using zm::RegisterType;
+
+    enum Reg : uint8_t {
+        RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+        R12 = 12, R13 = 13, R14 = 14, R15 = 15
+    };
+
+    // Condition codes of the 0F 8x jumps; flipping bit 0 negates them
+    enum Condition : uint8_t {
+        EQUAL = 0x4,
+        ABOVE = 0x7,
+        LESS = 0xC,
+        GREATER = 0xF
+    };
+
+    Condition negate(Condition condition) { return static_cast<Condition>(condition ^ 1); }
+
+    /*
+     * Just the x86-64 instructions the compiler below needs. Operations are
+     * 32 bit on zero extended words, which gives the same low 16 bits.
+     */
+    class Assembler {
+    public:
+        std::vector<uint8_t> code;
+
+        size_t position() const { return code.size(); }
+
+        void byte(uint8_t value) { code.push_back(value); }
+        void dword(uint32_t value) { for (int i = 0; i < 4; ++i) { byte(static_cast<uint8_t>(value >> (i * 8))); } }
+
+        void push(Reg r) { if (r >= 8) { byte(0x41); } byte(0x50 + (r & 7)); }
+        void pop(Reg r) { if (r >= 8) { byte(0x41); } byte(0x58 + (r & 7)); }
+        void ret() { byte(0xC3); }
+
+        // mov r64, [rdi + offset] / mov [rdi + offset], r64 / jmp [rdi + offset]
+        void load_state(Reg r, uint8_t offset) { byte(r >= 8 ? 0x4C : 0x48); byte(0x8B); byte(0x47 | ((r & 7) << 3)); byte(offset); }
+        void store_state(uint8_t offset, Reg r) { byte(r >= 8 ? 0x4C : 0x48); byte(0x89); byte(0x47 | ((r & 7) << 3)); byte(offset); }
+        void jump_state(uint8_t offset) { byte(0xFF); byte(0x67); byte(offset); }
+
+        // movzx r32, word [base + displacement] / mov word [base + displacement], r16
+        void load_word(Reg r, Reg base, int32_t displacement) { rex(r, 0, base); byte(0x0F); byte(0xB7); operand(r, base, displacement); }
+        void store_word(Reg base, int32_t displacement, Reg r) { byte(0x66); rex(r, 0, base); byte(0x89); operand(r, base, displacement); }
+
+        // The same on [base + index]
+        void load_word(Reg r, Reg base, Reg index) { rex(r, index, base); byte(0x0F); byte(0xB7); operand(r, base, index); }
+        void load_byte(Reg r, Reg base, Reg index) { rex(r, index, base); byte(0x0F); byte(0xB6); operand(r, base, index); }
+        void store_word(Reg base, Reg index, Reg r) { byte(0x66); rex(r, index, base); byte(0x89); operand(r, base, index); }
+        void store_byte(Reg base, Reg index, Reg r) { rex(r, index, base); byte(0x88); operand(r, base, index); }
+
+        void move(Reg destination, uint32_t value) { byte(0xB8 + destination); dword(value); }
+        void move(Reg destination, Reg source) { alu(0x89, destination, source); }
+
+        // add 01, or 09, and 21, sub 29, cmp 39, test 85: destination op= source
+        void alu(uint8_t opcode, Reg destination, Reg source) { byte(opcode); byte(0xC0 | (source << 3) | destination); }
+        void imul(Reg destination, Reg source) { byte(0x0F); byte(0xAF); byte(0xC0 | (destination << 3) | source); }
+        void bitwise_not(Reg r) { byte(0xF7); byte(0xD0 + r); }
+        void increment(Reg r) { byte(0xFF); byte(0xC0 + r); }
+        void decrement(Reg r) { byte(0xFF); byte(0xC8 + r); }
+        void shift_left(Reg r) { byte(0xD1); byte(0xE0 + r); }
+        void zero_extend(Reg r) { byte(0x0F); byte(0xB7); byte(0xC0 | (r << 3) | r); }
+        void sign_extend(Reg r) { byte(0x0F); byte(0xBF); byte(0xC0 | (r << 3) | r); }
+        void swap_bytes(Reg r) { byte(0x66); byte(0xC1); byte(0xC8 + r); byte(8); } // ror r16, 8
+        void divide(Reg r) { byte(0x99); byte(0xF7); byte(0xF8 + r); } // cdq; idiv r32
+
+        // cmp dword [rbp], imm32 / cmp dword [rbp], r32: rbp points to the watch limit
+        void compare_limit(uint32_t value) { byte(0x81); byte(0x7D); byte(0); dword(value); }
+        void compare_limit(Reg r) { byte(0x39); byte(0x45 | (r << 3)); byte(0); }
+
+        // The budget lives in r14: test r14, r14 / lea r14, [r14 - 1] (leaves the flags alone)
+        void test_budget() { byte(0x4D); byte(0x85); byte(0xF6); }
+        void consume() { byte(0x4D); byte(0x8D); byte(0x76); byte(0xFF); }
+
+        // Jumps return where their displacement goes, see patch()
+        size_t jump() { byte(0xE9); dword(0); return position() - 4; }
+        size_t jump(Condition condition) { byte(0x0F); byte(0x80 | condition); dword(0); return position() - 4; }
+
+        void patch(size_t at, size_t target) {
+            auto displacement = static_cast<int32_t>(target - (at + 4));
+            std::memcpy(&code[at], &displacement, 4);
+        }
+
+    private:
+        void rex(uint8_t r, uint8_t index, uint8_t base) {
+            uint8_t value = 0x40 | (r >= 8 ? 0x04 : 0) | (index >= 8 ? 0x02 : 0) | (base >= 8 ? 0x01 : 0);
+
+            if (value != 0x40) {
+                byte(value);
+            }
+        }
+
+        void operand(uint8_t r, uint8_t base, int32_t displacement) {
+            byte(0x80 | ((r & 7) << 3) | (base & 7));
+
+            if ((base & 7) == 4) {
+                byte(0x24);
+            }
+
+            dword(static_cast<uint32_t>(displacement));
+        }
+
+        void operand(uint8_t r, uint8_t base, uint8_t index) {
+            byte(0x44 | ((r & 7) << 3));
+            byte(((index & 7) << 3) | (base & 7));
+            byte(0);
+        }
+    };
+
+    /*
+     * Register use: rbx locals, r12 temporaries, r13 memory, r15 globals,
+     * rbp the watch limit, r14 the remaining budget. rax, rcx, rdx and rsi
+     * are scratch.
+     */
+    class Compiler {
+    public:
+        Compiler(const zm::TranslatedRoutine &routine, zm::address globals) :
+            routine(routine), globals(globals), labels(routine.code.size()), exits(routine.code.size()) { }
+
+        std::vector<uint8_t> compile() {
+            prologue();
+
+            for (size_t i = 0; i < routine.code.size(); ++i) {
+                labels[i] = a.position();
+                instruction(static_cast<uint32_t>(i), routine.code[i]);
+            }
+
+            // Exits report the instruction they stopped at
+            for (size_t i = 0; i < routine.code.size(); ++i) {
+                exits[i] = a.position();
+                a.move(RAX, static_cast<uint32_t>(i));
+                fixups.emplace_back(a.jump(), EPILOGUE);
+            }
+
+            size_t epilogue = a.position();
+            a.pop(RDI);
+            a.store_state(offsetof(zm::JitState, budget), R14);
+            a.pop(R15);
+            a.pop(R14);
+            a.pop(R13);
+            a.pop(R12);
+            a.pop(RBP);
+            a.pop(RBX);
+            a.ret();
+
+            for (auto &fixup : fixups) {
+                size_t target;
+
+                if (fixup.second == EPILOGUE) {
+                    target = epilogue;
+                } else if (fixup.second & EXIT) {
+                    target = exits[fixup.second & ~EXIT];
+                } else {
+                    target = labels[fixup.second];
+                }
+
+                a.patch(fixup.first, target);
+            }
+
+            return a.code;
+        }
+
+        const std::vector<size_t> &instruction_offsets() const { return labels; }
+
+    private:
+        // Jump targets: an instruction, its exit, or the epilogue
+        static constexpr uint32_t EXIT = 0x80000000;
+        static constexpr uint32_t EPILOGUE = 0xFFFFFFFF;
+
+        const zm::TranslatedRoutine &routine;
+        zm::address globals;
+
+        Assembler a;
+        std::vector<size_t> labels;
+        std::vector<size_t> exits;
+        std::vector<std::pair<size_t, uint32_t>> fixups;
+
+        void prologue() {
+            a.push(RBX);
+            a.push(RBP);
+            a.push(R12);
+            a.push(R13);
+            a.push(R14);
+            a.push(R15);
+            a.push(RDI);
+
+            a.load_state(RBX, offsetof(zm::JitState, locals));
+            a.load_state(R12, offsetof(zm::JitState, temporaries));
+            a.load_state(R13, offsetof(zm::JitState, memory));
+            a.load_state(R15, offsetof(zm::JitState, globals));
+            a.load_state(RBP, offsetof(zm::JitState, watch_limit));
+            a.load_state(R14, offsetof(zm::JitState, budget));
+            a.jump_state(offsetof(zm::JitState, entry));
+        }
+
+        void go(uint32_t index) { fixups.emplace_back(a.jump(), index); }
+        void go(Condition condition, uint32_t index) { fixups.emplace_back(a.jump(condition), index); }
+        void leave(uint32_t index) { go(index | EXIT); }
+        void leave(Condition condition, uint32_t index) { go(condition, index | EXIT); }
+
+        void load(Reg r, const Register &source) {
+            switch (source.type) {
+                case RegisterType::CONSTANT : a.move(r, source.value); break;
+                case RegisterType::LOCAL : a.load_word(r, RBX, source.value << 1); break;
+                case RegisterType::TEMPORARY : a.load_word(r, R12, source.value << 1); break;
+                default : a.load_word(r, R15, source.value << 1); a.swap_bytes(r); break;
+            }
+        }
+
+        void write(const Register &destination, Reg r) {
+            switch (destination.type) {
+                case RegisterType::LOCAL : a.store_word(RBX, destination.value << 1, r); break;
+                case RegisterType::TEMPORARY : a.store_word(R12, destination.value << 1, r); break;
+                case RegisterType::GLOBAL :
+                    a.move(RSI, r);
+                    a.swap_bytes(RSI);
+                    a.store_word(R15, destination.value << 1, RSI);
+                    break;
+                default : break;
+            }
+        }
+
+        void branch(const IrInstruction &ir, Condition condition) {
+            go(ir.branch_on_true ? condition : negate(condition), ir.target);
+        }
+
+        void instruction(uint32_t index, const IrInstruction &ir) {
+            if (!zm::Jit::compilable(ir)) {
+                leave(index);
+                return;
+            }
+
+            a.test_budget();
+            leave(EQUAL, index);
+
+            // A global written to may be watched, in which case the IR executor does it
+            Mnemonic mnemonic = ir.instruction.mnemonic;
+            bool by_reference = mnemonic == Mnemonic::STORE || mnemonic == Mnemonic::INC || mnemonic == Mnemonic::DEC ||
+                    mnemonic == Mnemonic::INC_CHK || mnemonic == Mnemonic::DEC_CHK || mnemonic == Mnemonic::PULL;
+            const Register &written = by_reference ? ir.operands[0] : ir.store;
+
+            if (written.type == RegisterType::GLOBAL) {
+                a.compare_limit(globals + (written.value << 1));
+                leave(ABOVE, index);
+            }
+
+            switch (mnemonic) {
+                case Mnemonic::ADD : case Mnemonic::SUB : case Mnemonic::AND : case Mnemonic::OR : case Mnemonic::MUL : {
+                    load(RAX, ir.operands[0]);
+                    load(RCX, ir.operands[1]);
+                    a.consume();
+
+                    switch (mnemonic) {
+                        case Mnemonic::ADD : a.alu(0x01, RAX, RCX); break;
+                        case Mnemonic::SUB : a.alu(0x29, RAX, RCX); break;
+                        case Mnemonic::AND : a.alu(0x21, RAX, RCX); break;
+                        case Mnemonic::OR : a.alu(0x09, RAX, RCX); break;
+                        default : a.imul(RAX, RCX); break;
+                    }
+
+                    write(ir.store, RAX);
+                    break;
+                }
+
+                case Mnemonic::DIV : case Mnemonic::MOD :
+                    load(RAX, ir.operands[0]);
+                    load(RCX, ir.operands[1]);
+                    a.sign_extend(RAX);
+                    a.sign_extend(RCX);
+
+                    // Division by zero is reported by the IR executor
+                    a.alu(0x85, RCX, RCX);
+                    leave(EQUAL, index);
+
+                    a.consume();
+                    a.divide(RCX);
+                    write(ir.store, mnemonic == Mnemonic::DIV ? RAX : RDX);
+                    break;
+
+                case Mnemonic::NOT :
+                    load(RAX, ir.operands[0]);
+                    a.consume();
+                    a.bitwise_not(RAX);
+                    write(ir.store, RAX);
+                    break;
+
+                case Mnemonic::INC : case Mnemonic::DEC :
+                    load(RAX, ir.operands[0]);
+                    a.consume();
+
+                    if (mnemonic == Mnemonic::INC) {
+                        a.increment(RAX);
+                    } else {
+                        a.decrement(RAX);
+                    }
+
+                    write(ir.operands[0], RAX);
+                    break;
+
+                case Mnemonic::STORE : case Mnemonic::PULL :
+                    load(RAX, ir.operands[1]);
+                    a.consume();
+                    write(ir.operands[0], RAX);
+                    break;
+
+                case Mnemonic::LOAD : case Mnemonic::PUSH :
+                    load(RAX, ir.operands[0]);
+                    a.consume();
+                    write(ir.store, RAX);
+                    break;
+
+                case Mnemonic::POP : case Mnemonic::NOP :
+                    a.consume();
+                    break;
+
+                case Mnemonic::LOADW : case Mnemonic::LOADB :
+                    load(RAX, ir.operands[0]);
+                    load(RCX, ir.operands[1]);
+
+                    if (mnemonic == Mnemonic::LOADW) {
+                        a.shift_left(RCX);
+                    }
+
+                    a.alu(0x01, RAX, RCX);
+                    a.zero_extend(RAX);
+                    a.consume();
+
+                    if (mnemonic == Mnemonic::LOADW) {
+                        a.load_word(RAX, R13, RAX);
+                        a.swap_bytes(RAX);
+                    } else {
+                        a.load_byte(RAX, R13, RAX);
+                    }
+
+                    write(ir.store, RAX);
+                    break;
+
+                case Mnemonic::STOREW : case Mnemonic::STOREB :
+                    load(RAX, ir.operands[0]);
+                    load(RCX, ir.operands[1]);
+                    load(RDX, ir.operands[2]);
+
+                    if (mnemonic == Mnemonic::STOREW) {
+                        a.shift_left(RCX);
+                    }
+
+                    a.alu(0x01, RAX, RCX);
+                    a.zero_extend(RAX);
+
+                    // Same test as Memory::watch()
+                    a.compare_limit(RAX);
+                    leave(ABOVE, index);
+                    a.consume();
+
+                    if (mnemonic == Mnemonic::STOREW) {
+                        a.swap_bytes(RDX);
+                        a.store_word(R13, RAX, RDX);
+                    } else {
+                        a.store_byte(R13, RAX, RDX);
+                    }
+                    break;
+
+                case Mnemonic::JUMP :
+                    a.consume();
+                    go(ir.target);
+                    break;
+
+                case Mnemonic::JZ :
+                    load(RAX, ir.operands[0]);
+                    a.consume();
+                    a.alu(0x85, RAX, RAX);
+                    branch(ir, EQUAL);
+                    break;
+
+                case Mnemonic::JL : case Mnemonic::JG :
+                    load(RAX, ir.operands[0]);
+                    load(RCX, ir.operands[1]);
+                    a.sign_extend(RAX);
+                    a.sign_extend(RCX);
+                    a.consume();
+                    a.alu(0x39, RAX, RCX);
+                    branch(ir, mnemonic == Mnemonic::JL ? LESS : GREATER);
+                    break;
+
+                case Mnemonic::TEST :
+                    load(RAX, ir.operands[0]);
+                    load(RCX, ir.operands[1]);
+                    a.consume();
+                    a.alu(0x21, RAX, RCX);
+                    a.alu(0x39, RAX, RCX);
+                    branch(ir, EQUAL);
+                    break;
+
+                case Mnemonic::JE :
+                    load(RAX, ir.operands[0]);
+                    a.consume();
+
+                    // Any match makes the condition true
+                    for (uint8_t i = 1; i < ir.operand_count; ++i) {
+                        load(RCX, ir.operands[i]);
+                        a.alu(0x39, RAX, RCX);
+                        go(EQUAL, ir.branch_on_true ? ir.target : index + 1);
+                    }
+
+                    if (!ir.branch_on_true) {
+                        go(ir.target);
+                    }
+                    break;
+
+                case Mnemonic::INC_CHK : case Mnemonic::DEC_CHK :
+                    load(RAX, ir.operands[0]);
+                    load(RCX, ir.operands[1]);
+                    a.consume();
+
+                    if (mnemonic == Mnemonic::INC_CHK) {
+                        a.increment(RAX);
+                    } else {
+                        a.decrement(RAX);
+                    }
+
+                    write(ir.operands[0], RAX);
+                    a.sign_extend(RAX);
+                    a.sign_extend(RCX);
+                    a.alu(0x39, RAX, RCX);
+                    branch(ir, mnemonic == Mnemonic::INC_CHK ? GREATER : LESS);
+                    break;
+
+                default :
+                    break;
+            }
+        }
+    };
+
+    // Bound to references by the fixups, so they need a definition in C++14
+    constexpr uint32_t Compiler::EXIT;
+    constexpr uint32_t Compiler::EPILOGUE;
+}
+
+zm::NativeRoutine::~NativeRoutine() {
+    munmap(code, size);
+}
+
+bool zm::Jit::available() {
+    return true;
+}
+
+bool zm::Jit::compile(zm::TranslatedRoutine &routine) {
+    bool any = false;
+
+    for (const auto &ir : routine.code) {
+        any = any || Jit::compilable(ir);
+    }
+
+    if (!any) {
+        return false;
+    }
+
+    Compiler compiler { routine, global_variables_address };
+    std::vector<uint8_t> code = compiler.compile();
+
+    // Written while writable, then only executable
+    void *memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+
+    std::memcpy(memory, code.data(), code.size());
+
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, code.size());
+        return false;
+    }
+
+    std::unique_ptr<NativeRoutine> native { new NativeRoutine { static_cast<uint8_t *>(memory), code.size(), { } } };
+
+    for (size_t i = 0; i < routine.code.size(); ++i) {
+        native->entries.push_back(Jit::compilable(routine.code[i]) ? native->code + compiler.instruction_offsets()[i] : nullptr);
+    }
+
+    routine.native = native.get();
+    routines.push_back(std::move(native));
+
+    return true;
+}
+
+#else
+
+zm::NativeRoutine::~NativeRoutine() = default;
+
+bool zm::Jit::available() {
+    return false;
+}
+
+bool zm::Jit::compile(zm::TranslatedRoutine &) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef ZETAMACHINE_JIT_H
+#define ZETAMACHINE_JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "translator.h"
+
+/*
+ * Native code is only generated for x86-64 with the System V calling
+ * convention. Define ZM_NO_JIT to leave the code generator out.
+ */
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__)) && !defined(ZM_NO_JIT)
+#define ZM_JIT 1
+#endif
+
+// Calls after which a translated routine is compiled
+#define JIT_CALL_THRESHOLD 64
+
+namespace zm {
+    // What compiled code works on, filled in before each run
+    struct JitState {
+        word *locals;
+        word *temporaries;
+        uint8_t *memory;
+        uint8_t *globals;
+        const uint32_t *watch_limit;
+        uint64_t budget;
+        const void *entry;
+    };
+
+    /*
+     * Native code for a translated routine. It can be entered at any compiled
+     * IR instruction, and returns the index of the one it stopped at: one it
+     * leaves to the IR executor (calls, returns, I/O...), a write to watched
+     * memory, or the end of the budget. Nothing of that instruction has run yet.
+     */
+    struct NativeRoutine {
+        uint8_t *code;
+        size_t size;
+        std::vector<const void *> entries; // Per IR instruction, nullptr when not compiled
+
+        ~NativeRoutine();
+
+        // Runs from the IR instruction at index, which must be compiled
+        uint32_t run(JitState &state, uint32_t index) const {
+            state.entry = entries[index];
+            return reinterpret_cast<uint32_t (*)(JitState *)>(code)(&state);
+        }
+    };
+
+    class Jit {
+    public:
+        explicit Jit(address global_variables_address) : global_variables_address(global_variables_address) { }
+
+        // Compiles the routine, false when there is nothing in it to compile
+        bool compile(TranslatedRoutine &routine);
+
+        static bool available();
+
+        // Whether native code can run the instruction, the others go back to the IR executor
+        static bool compilable(const IrInstruction &ir);
+
+    private:
+        address global_variables_address;
+
+        std::vector<std::unique_ptr<NativeRoutine>> routines;
+    };
+}
+
+#endif //ZETAMACHINE_JIT_H
@@ -1,12 +1,75 @@
 #ifndef ZETAMACHINE_MACHINE_H
 #define ZETAMACHINE_MACHINE_H
 
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
+
+#include "input.h"
+#include "options.h"
+#include "video.h"
 
 namespace zm {
+    class Memory;
+
+    enum class RunStatus {
+        BUDGET, // Ran all it was given, and has more to run
+        WAITING_FOR_LINE,
+        WAITING_FOR_CHAR,
+        QUIT,
+        ERROR // Quit on an error in the story, or nothing is loaded
+    };
+
+    struct RunResult {
+        RunStatus status;
+        uint64_t instructions;
+    };
+
     class Machine {
     public:
-        void run(std::string file);
+        // A loaded story on the processor specialized for its version, with its profiles
+        class Engine;
+
+        // Stays where it is made, a loaded engine keeps references into it
+        Machine();
+        ~Machine();
+
+        // Run the story to completion, and return how many instructions it took
+        uint64_t run(std::string file);
+        uint64_t run(const std::vector<uint8_t> &story);
+
+        /*
+         * Or load it and run it a slice at a time, each one stopping early
+         * when the story quits or waits for input that is not ready. Without
+         * an attached input, the story reads what is sent to the machine.
+         */
+        bool load(const std::vector<uint8_t> &story);
+        RunResult run_for(uint64_t budget);
+
+        void send_line(const std::string &line) { queued_input.push_line(line); }
+        void send_char(uint8_t character) { queued_input.push_char(character); }
+        void close_input() { queued_input.close(); }
+
+        bool loaded() const { return engine != nullptr; }
+
+        void configure(const Options &options) { this->options = options; }
+
+        // Where the story's text goes and its input comes from, the console unless attached
+        void attach(Video *video, Input *input) { this->video = video; this->input = input; }
+
+    private:
+        Options options;
+        Video *video = nullptr;
+        Input *input = nullptr;
+        Video console_video;
+        Input console_input;
+        QueuedInput queued_input;
+
+        std::unique_ptr<Engine> engine;
+
+        void start(std::unique_ptr<Memory> memory, Input &input);
+        uint64_t run(std::unique_ptr<Memory> memory);
     };
 }
 
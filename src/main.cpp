@@ -1,8 +1,59 @@
 #include "machine.h"
 
-int main() {
-    zm::Machine machine {};
+#include <iostream>
+#include <string>
+
+int main(int argc, char *argv[]) {
+    std::string path;
+    zm::Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
 
-    machine.run("");
+        if (argument == "--debug") {
+            options.debug = true;
+        } else if (argument == "--no-fusion") {
+            options.fusion = false;
+        } else if (argument == "--no-translation") {
+            options.translation = false;
+        } else if (argument == "--jit") {
+            options.jit = true;
+        } else if (argument == "--checked") {
+            options.checked = true;
+        } else if (argument == "--aot" && i + 1 < argc) {
+            options.aot_plugin = argv[++i];
+        } else if (argument == "--seed" && i + 1 < argc) {
+            options.seed = static_cast<uint16_t>(std::stoi(argv[++i]));
+        } else if (argument == "--pair-profile") {
+            options.pair_profile = true;
+        } else if (argument == "--opcode-profile" && i + 1 < argc) {
+            options.opcode_profile = argv[++i];
+        } else if (argument == "--routine-profile" && i + 1 < argc) {
+            options.routine_profile = argv[++i];
+        } else if (argument == "--routine-time") {
+            options.routine_time = true;
+        } else if (argument == "--sample-profile" && i + 1 < argc) {
+            options.sample_profile = argv[++i];
+        } else if (argument == "--perf") {
+            options.perf = true;
+        } else if (argument == "--trace" && i + 1 < argc) {
+            options.trace = argv[++i];
+        } else if (argument == "--images" && i + 1 < argc) {
+            options.images = argv[++i];
+        } else if (argument == "--save" && i + 1 < argc) {
+            options.save_file = argv[++i];
+        } else {
+            path = argument;
+        }
+    }
+
+    if (path.empty()) {
+        std::cerr << "Usage: zetamachine [--debug] [--no-fusion] [--no-translation] [--jit] [--checked] [--aot <plugin>] [--seed <n>] [--pair-profile] [--opcode-profile <file.json|file.csv>] [--routine-profile <file>] [--routine-time] [--sample-profile <file>] [--perf] [--trace <file>] [--images <directory>] [--save <file>] <story file>" << std::endl;
+        return 1;
+    }
+
+    zm::Machine machine {};
+    machine.configure(options);
+    machine.run(path);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,70 @@
+#ifndef ZETAMACHINE_BIG_ENDIAN_H
+#define ZETAMACHINE_BIG_ENDIAN_H
+
+#include <cstdint>
+#include <cstring>
+
+/*
+ * Story memory is big-endian. Multi-byte values are read with one unaligned
+ * load and a byte swap on little-endian hosts, rather than a byte at a time.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ZM_FROM_BE16(value) (value)
+#define ZM_FROM_BE32(value) (value)
+#elif defined(__GNUC__)
+#define ZM_FROM_BE16(value) __builtin_bswap16(value)
+#define ZM_FROM_BE32(value) __builtin_bswap32(value)
+#else
+#define ZM_FROM_BE16(value) static_cast<uint16_t>((value) << 8 | (value) >> 8)
+#define ZM_FROM_BE32(value) ((value) << 24 | ((value) << 8 & 0x00FF0000) | ((value) >> 8 & 0x0000FF00) | (value) >> 24)
+#endif
+
+namespace zm {
+    inline uint16_t load_be16(const uint8_t *bytes) {
+        uint16_t value;
+        std::memcpy(&value, bytes, sizeof(value));
+        return static_cast<uint16_t>(ZM_FROM_BE16(value));
+    }
+
+    inline uint32_t load_be32(const uint8_t *bytes) {
+        uint32_t value;
+        std::memcpy(&value, bytes, sizeof(value));
+        return ZM_FROM_BE32(value);
+    }
+
+    inline void store_be16(uint8_t *bytes, uint16_t value) {
+        value = static_cast<uint16_t>(ZM_FROM_BE16(value));
+        std::memcpy(bytes, &value, sizeof(value));
+    }
+
+    inline void store_be32(uint8_t *bytes, uint32_t value) {
+        value = ZM_FROM_BE32(value);
+        std::memcpy(bytes, &value, sizeof(value));
+    }
+
+    /*
+     * Big-endian fields of the structs laid over story memory (the header,
+     * object entries, dictionary entries). They have no alignment, so the
+     * structs match the story byte for byte, and read as plain integers.
+     */
+    class be16 {
+    public:
+        operator uint16_t() const { return load_be16(bytes); }
+
+    private:
+        uint8_t bytes[2];
+    };
+
+    class be32 {
+    public:
+        operator uint32_t() const { return load_be32(bytes); }
+
+    private:
+        uint8_t bytes[4];
+    };
+
+    static_assert(sizeof(be16) == 2 && alignof(be16) == 1, "be16 must overlay two bytes");
+    static_assert(sizeof(be32) == 4 && alignof(be32) == 1, "be32 must overlay four bytes");
+}
+
+#endif //ZETAMACHINE_BIG_ENDIAN_H
@@ -1,27 +1,175 @@
 #include "dictionary_mapper.h"
+#include "header.h"
 #include "memory.h"
-#include "memory_cursor.h"
+#include "zchar_mapper.h"
 
-zm::DictionaryMapper::DictionaryMapper(zm::Memory &memory) : memory(memory) {
-    base_address = memory.read_word(0x08);
+#include <vector>
+
+template<uint8_t Version>
+zm::DictionaryMapper<Version>::DictionaryMapper(zm::Memory &memory) : memory(memory) {
+    base_address = Header(memory).dictionary_address();
 }
 
-zm::DictionaryMapper::DictionaryMapper(zm::Memory &memory, uint32_t address) : memory(memory), base_address(address) { }
+template<uint8_t Version>
+zm::DictionaryMapper<Version>::DictionaryMapper(zm::Memory &memory, uint32_t address) : memory(memory), base_address(address) { }
 
-std::string zm::DictionaryMapper::get_entry(uint16_t entry) {
-    return std::__cxx11::string();
+template<uint8_t Version>
+std::string zm::DictionaryMapper<Version>::get_entry(uint16_t entry) {
+    return ZCharMapper{ memory }.map(entry, Traits::dictionary_word_bytes >> 1);
 }
 
-uint16_t zm::DictionaryMapper::number_of_entries() {
-    MemoryCursor cursor{ memory, base_address };
+template<uint8_t Version>
+uint16_t zm::DictionaryMapper<Version>::number_of_entries() {
+    uint8_t separator_count = memory.read_byte(base_address);
+
+    return memory.view<DictionaryCounts>(base_address + 1 + separator_count).entry_count;
+}
+
+template<uint8_t Version>
+uint16_t zm::DictionaryMapper<Version>::lookup(const std::string &word) {
+    auto key = ZCharMapper{ memory }.encode(word, Traits::dictionary_word_zchars);
+
+    uint8_t separator_count = memory.read_byte(base_address);
+    uint32_t counts_address = base_address + 1 + separator_count;
+    const DictionaryCounts &counts = memory.view<DictionaryCounts>(counts_address);
+
+    uint8_t entry_length = counts.entry_length;
+    auto entry_count = static_cast<int16_t>(counts.entry_count);
+    uint32_t entries_address = counts_address + sizeof(DictionaryCounts);
+
+    // Compares the key with an entry, word by word
+    auto compare = [&](uint32_t address) {
+        const Entry &entry = memory.view<Entry>(address);
+
+        for (size_t i = 0; i < key.size(); ++i) {
+            uint16_t value = entry.text[i];
+
+            if (key[i] != value) {
+                return key[i] < value ? -1 : 1;
+            }
+        }
 
-    uint8_t input_code_size = cursor.next();
-    uint8_t input_code_buffer[64];
+        return 0;
+    };
 
-    cursor.next_bytes(input_code_size, input_code_buffer);
+    if (entry_count < 0) {
+        // A negative count means the entries are not sorted
+        for (int i = 0; i < -entry_count; ++i) {
+            uint32_t entry = entries_address + i * entry_length;
 
-    uint8_t entry_length = cursor.next();
-    uint16_t number_of_entries = cursor.next_word();
+            if (compare(entry) == 0) {
+                return static_cast<uint16_t>(entry);
+            }
+        }
 
-    return number_of_entries;
+        return 0;
+    }
+
+    int low = 0;
+    int high = entry_count - 1;
+
+    while (low <= high) {
+        int middle = (low + high) >> 1;
+        uint32_t entry = entries_address + middle * entry_length;
+        int result = compare(entry);
+
+        if (result == 0) {
+            return static_cast<uint16_t>(entry);
+        } else if (result < 0) {
+            high = middle - 1;
+        } else {
+            low = middle + 1;
+        }
+    }
+
+    return 0;
 }
+
+template<uint8_t Version>
+void zm::DictionaryMapper<Version>::tokenise(uint32_t text_buffer, uint32_t parse_buffer, bool skip_unknown) {
+    uint8_t separator_count = memory.read_byte(base_address);
+    std::vector<uint8_t> separators(separator_count);
+    memory.read_array(base_address + 1, separator_count, separators.data());
+
+    // Collect the typed text
+    std::string text;
+    uint32_t start = text_buffer + Traits::text_buffer_start;
+
+    if (Traits::text_buffer_start == 2) {
+        uint8_t length = memory.read_byte(text_buffer + 1);
+
+        for (uint8_t i = 0; i < length; ++i) {
+            text.push_back(static_cast<char>(memory.read_byte(start + i)));
+        }
+    } else {
+        for (uint32_t address = start; memory.read_byte(address) != 0; ++address) {
+            text.push_back(static_cast<char>(memory.read_byte(address)));
+        }
+    }
+
+    uint8_t max_words = memory.read_byte(parse_buffer);
+    uint8_t word_count = 0;
+
+    auto add_word = [&](size_t position, size_t length) {
+        if (word_count >= max_words) {
+            return;
+        }
+
+        uint16_t entry = lookup(text.substr(position, length));
+        uint32_t block = parse_buffer + 2 + (word_count << 2);
+
+        if (entry != 0 || !skip_unknown) {
+            memory.write_word(block, entry);
+            memory.write(block + 2, static_cast<uint8_t>(length));
+            memory.write(block + 3, static_cast<uint8_t>(position + Traits::text_buffer_start));
+        }
+
+        ++word_count;
+    };
+
+    size_t word_start = 0;
+    size_t word_length = 0;
+
+    for (size_t i = 0; i < text.size(); ++i) {
+        char character = text[i];
+        bool separator = false;
+
+        for (auto candidate : separators) {
+            separator |= candidate == static_cast<uint8_t>(character);
+        }
+
+        if (character == ' ' || separator) {
+            if (word_length > 0) {
+                add_word(word_start, word_length);
+            }
+
+            // Separators are words on their own
+            if (separator) {
+                add_word(i, 1);
+            }
+
+            word_length = 0;
+        } else {
+            if (word_length == 0) {
+                word_start = i;
+            }
+
+            ++word_length;
+        }
+    }
+
+    if (word_length > 0) {
+        add_word(word_start, word_length);
+    }
+
+    memory.write(parse_buffer + 1, word_count);
+}
+
+template class zm::DictionaryMapper<1>;
+template class zm::DictionaryMapper<2>;
+template class zm::DictionaryMapper<3>;
+template class zm::DictionaryMapper<4>;
+template class zm::DictionaryMapper<5>;
+template class zm::DictionaryMapper<6>;
+template class zm::DictionaryMapper<7>;
+template class zm::DictionaryMapper<8>;
@@ -8,20 +8,47 @@
 #include <cstdint>
 #include <string>
 
+#include "big_endian.h"
+#include "../version.h"
+
 namespace zm {
     class Memory;
 
+    // Right after the word separators: how long the entries are, and how many (negative when they are not sorted)
+    struct DictionaryCounts {
+        uint8_t entry_length;
+        be16 entry_count;
+    };
+
+    static_assert(sizeof(DictionaryCounts) == 3, "The entry length and count take three bytes");
+
+    // The start of an entry, its encoded word. The data of the story follows it
+    template<uint8_t Words>
+    struct DictionaryEntry {
+        be16 text[Words];
+    };
+
+    template<uint8_t Version>
     class DictionaryMapper {
     public:
+        using Traits = VersionTraits<Version>;
+        using Entry = DictionaryEntry<(Traits::dictionary_word_bytes >> 1)>;
+
         explicit DictionaryMapper(Memory &memory);
         explicit DictionaryMapper(Memory &memory, uint32_t address);
 
-    private:
-        Memory &memory;
-        uint32_t base_address;
+        // Address of the entry for word, or 0 if it is not in the dictionary
+        uint16_t lookup(const std::string &word);
+
+        // Splits the text buffer into words and fills the parse buffer with their entries
+        void tokenise(uint32_t text_buffer, uint32_t parse_buffer, bool skip_unknown);
 
         std::string get_entry(uint16_t entry);
         uint16_t number_of_entries();
+
+    private:
+        Memory &memory;
+        uint32_t base_address;
     };
 }
 
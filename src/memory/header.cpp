@@ -1,17 +1,22 @@
 #include "header.h"
 #include "memory.h"
 
-uint8_t zm::Header::version() { return memory.read(0x00); }
+zm::Header::Header(zm::Memory &memory) : fields(memory.view<HeaderFields>(0)) { }
 
-uint16_t zm::Header::high_memory_base_address() { return memory.read_word(0x04); }
-uint16_t zm::Header::main_routine_address() { return memory.read_word(0x06); }
-uint16_t zm::Header::dictionary_address() { return memory.read_word(0x08); }
-uint16_t zm::Header::object_table_address() { return memory.read_word(0x0A); }
-uint16_t zm::Header::global_variables_address() { return memory.read_word(0x0C); }
-uint16_t zm::Header::static_memory_base_address() { return memory.read_word(0x0E); }
-uint16_t zm::Header::abbreviations_table_address() { return memory.read_word(0x18); }
-uint16_t zm::Header::terminating_characters_table_address() { return memory.read_word(0x2E); }
-uint16_t zm::Header::header_extension_table_address() { return memory.read_word(0x36); }
+uint8_t zm::Header::version() { return fields.version; }
+uint16_t zm::Header::release() { return fields.release; }
+std::string zm::Header::serial() { return std::string(fields.serial, 6); }
+uint16_t zm::Header::checksum() { return fields.checksum; }
 
-uint16_t zm::Header::routines_offset() { return memory.read_word(0x28) >> 3; }
-uint16_t zm::Header::static_strings_offset() { return memory.read_word(0x2A) >> 3; }
+uint16_t zm::Header::high_memory_base_address() { return fields.high_memory_base; }
+uint16_t zm::Header::main_routine_address() { return fields.initial_pc; }
+uint16_t zm::Header::dictionary_address() { return fields.dictionary; }
+uint16_t zm::Header::object_table_address() { return fields.object_table; }
+uint16_t zm::Header::global_variables_address() { return fields.global_variables; }
+uint16_t zm::Header::static_memory_base_address() { return fields.static_memory_base; }
+uint16_t zm::Header::abbreviations_table_address() { return fields.abbreviations_table; }
+uint16_t zm::Header::terminating_characters_table_address() { return fields.terminating_characters_table; }
+uint16_t zm::Header::header_extension_table_address() { return fields.header_extension_table; }
+
+uint16_t zm::Header::routines_offset() { return fields.routines_offset >> 3; }
+uint16_t zm::Header::static_strings_offset() { return fields.static_strings_offset >> 3; }
@@ -2,15 +2,59 @@
 #define ZETAMACHINE_HEADER_H
 
 #include <cstdint>
+#include <string>
+
+#include "big_endian.h"
 
 namespace zm {
     class Memory;
 
+    // The 64 bytes of the header as they are in memory, with the fields of all versions
+    struct HeaderFields {
+        uint8_t version;
+        uint8_t flags_1;
+        be16 release;
+        be16 high_memory_base;
+        be16 initial_pc; // The main routine, packed, in version 6
+        be16 dictionary;
+        be16 object_table;
+        be16 global_variables;
+        be16 static_memory_base;
+        be16 flags_2;
+        char serial[6];
+        be16 abbreviations_table;
+        be16 file_length; // Divided by 2, 4 or 8
+        be16 checksum;
+        uint8_t interpreter_number;
+        uint8_t interpreter_version;
+        uint8_t screen_height_lines;
+        uint8_t screen_width_characters;
+        be16 screen_width_units;
+        be16 screen_height_units;
+        uint8_t font_width;
+        uint8_t font_height;
+        be16 routines_offset;
+        be16 static_strings_offset;
+        uint8_t background_colour;
+        uint8_t foreground_colour;
+        be16 terminating_characters_table;
+        be16 output_stream_3_width;
+        uint8_t standard_revision[2];
+        be16 alphabet_table;
+        be16 header_extension_table;
+        char username[8];
+    };
+
+    static_assert(sizeof(HeaderFields) == 0x40, "The header is 64 bytes");
+
     class Header {
     public:
-        explicit Header(Memory& memory) : memory(memory) { }
+        explicit Header(Memory& memory);
 
         uint8_t version();
+        uint16_t release();
+        std::string serial();
+        uint16_t checksum();
 
         uint16_t high_memory_base_address();
         uint16_t main_routine_address();
@@ -26,7 +70,7 @@ namespace zm {
         uint16_t static_strings_offset();
 
     private:
-        Memory& memory;
+        const HeaderFields &fields;
     };
 }
 
@@ -1,22 +1,61 @@
 #include "memory.h"
+#include "story_image.h"
 
 #include <fstream>
 #include <iostream>
 #include <cstring>
 
+#include <sys/mman.h>
+
+zm::Memory::Memory(std::shared_ptr<const zm::StoryImage> image) : size(image->size()), image(std::move(image)) {
+    void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, this->image->descriptor(), this->image->offset());
+
+    // Without a mapping, a private copy of the whole story
+    if (mapped == MAP_FAILED) {
+        contents = new uint8_t[size]();
+        std::memcpy(contents, this->image->bytes(), this->image->length());
+        this->image.reset();
+        return;
+    }
+
+    contents = static_cast<uint8_t *>(mapped);
+}
+
+zm::Memory::~Memory() {
+    if (image) {
+        munmap(contents, size);
+    } else {
+        delete[] contents;
+    }
+}
+
 void zm::Memory::load(std::string path) {
     // Load file into memory
     std::ifstream file(path, std::ios::binary | std::ios::ate);
-    std::streamsize size = file.tellg();
+    std::streamsize length = file.tellg();
     file.seekg(0, std::ios::beg);
 
-    if (file.read((char *) contents, size)) {
-        std::cout << "Finished loading " << path << ", size = " << size << std::endl;
+    if (length < 0 || static_cast<uint64_t>(length) > size) {
+        std::cerr << "Loading failed!" << std::endl;
+        return;
+    }
+
+    if (file.read((char *) contents, length)) {
+        std::cout << "Finished loading " << path << ", size = " << length << std::endl;
     } else {
         std::cerr << "Loading failed!" << std::endl;
     }
 }
 
+void zm::Memory::load(const std::vector<uint8_t> &story) {
+    if (story.size() > size) {
+        std::cerr << "Loading failed!" << std::endl;
+        return;
+    }
+
+    std::copy(story.begin(), story.end(), contents);
+}
+
 void zm::Memory::read_array(uint32_t source_address, uint32_t length, uint8_t *array) {
     memcpy(array, contents + source_address, length);
 }
@@ -1,47 +1,122 @@
 #ifndef ZETAMACHINE_MEMORY_H
 #define ZETAMACHINE_MEMORY_H
 
+#include <algorithm>
 #include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
+
+#include "big_endian.h"
 
 namespace zm {
+    class StoryImage;
+
+    /*
+     * Notified whenever memory below the watch limit is written to. Used
+     * to keep anything derived from dynamic memory (e.g. decoded code) in sync.
+     * The limit is shared by all observers, each one filters what concerns it.
+     */
+    class WriteObserver {
+    public:
+        virtual ~WriteObserver() = default;
+
+        virtual void notify_write(uint32_t address, uint32_t length) = 0;
+    };
+
     class Memory {
     public:
         Memory(uint32_t size) : size(size) { contents = new uint8_t[size]; }
-        virtual ~Memory() { delete[] contents; }
+
+        // The story, mapped copy-on-write: writes stay in this memory, the pages nothing writes to are shared
+        explicit Memory(std::shared_ptr<const StoryImage> image);
+
+        virtual ~Memory();
+
+        Memory(const Memory &) = delete;
+        Memory &operator=(const Memory &) = delete;
 
         uint8_t read(uint32_t address) { return contents[address]; }
 
         uint8_t read_byte(uint32_t address) { return read(address); }
-        uint16_t read_word(uint32_t address) { return contents[address] << 8 | contents[address + 1]; }
-        uint32_t read_double_word(uint32_t address) {
-            return contents[address] << 24 | contents[address + 1] << 16 | contents[address + 2] << 8 | contents[address + 3];
-        }
+        uint16_t read_word(uint32_t address) { return load_be16(contents + address); }
+        uint32_t read_double_word(uint32_t address) { return load_be32(contents + address); }
 
         void read_array(uint32_t source_address, uint32_t length, uint8_t *array);
 
         bool read_bit(uint32_t address, uint8_t position) { return ((read(address) >> position) & 0x1) != 0; }
-        void write_bit(uint32_t address, uint8_t position) { }
-
-        void write(uint32_t address, uint8_t value) { contents[address] = value; }
-        void write_word(uint32_t address, uint16_t value) { contents[address] = value >> 8; contents[address + 1] = (value & 0x00FF); }
-        void write_double_word(uint32_t address, uint32_t value) {
-            contents[address] = value >> 24;
-            contents[address + 1] = ((value >> 16) & 0x000000FF);
-            contents[address + 2] = ((value >> 8) & 0x000000FF);
-            contents[address + 3] = (value & 0x000000FF);
+        void write_bit(uint32_t address, uint8_t position, bool value) {
+            write(address, static_cast<uint8_t>(value ? read(address) | (1 << position) : read(address) & ~(1 << position)));
         }
 
+        void write(uint32_t address, uint8_t value) { watch(address, 1); contents[address] = value; }
+        void write_word(uint32_t address, uint16_t value) { watch(address, 2); store_be16(contents + address, value); }
+        void write_double_word(uint32_t address, uint32_t value) { watch(address, 4); store_be32(contents + address, value); }
+
+        // For writing a whole block in place, such as a restored game: the observers are told once, up front
+        uint8_t *rewrite(uint32_t address, uint32_t length) { watch(address, length); return contents + address; }
+
         void load(std::string path);
+        void load(const std::vector<uint8_t> &story);
+
+        uint32_t capacity() const { return size; }
+
+        // The story this memory was mapped from, null when it was not
+        const StoryImage *get_image() const { return image.get(); }
 
+        // Writes to addresses below the watch limit are reported to the observers
+        void observe_writes(WriteObserver *observer) { write_observers.push_back(observer); }
+        void ignore_writes(WriteObserver *observer) {
+            write_observers.erase(std::remove(write_observers.begin(), write_observers.end(), observer), write_observers.end());
+        }
+        void extend_watch_limit(uint32_t limit) { if (limit > watch_limit) watch_limit = limit; }
+
+        // For generated code, which checks its writes against the limit itself
+        const uint32_t *watch_limit_address() const { return &watch_limit; }
+
+        // Bytes in place; anything wider is big-endian, and read through a view
         template<typename T>
         T* cast(uint32_t address) {
+            static_assert(sizeof(T) == 1, "Story memory is big-endian, read wider values through view()");
             return (T*) (contents + address);
         }
 
+        // A struct of bytes and big-endian fields laid over memory, read in place. Writes go through write()
+        template<typename T>
+        const T &view(uint32_t address) const {
+            static_assert(alignof(T) == 1, "Views have to fit anywhere in memory");
+            return *reinterpret_cast<const T *>(contents + address);
+        }
+
     private:
         uint32_t size;
         uint8_t *contents;
+        std::shared_ptr<const StoryImage> image; // Mapped rather than allocated when set
+
+        std::vector<WriteObserver *> write_observers;
+        uint32_t watch_limit = 0;
+
+        void watch(uint32_t address, uint32_t length) {
+            if (address < watch_limit) {
+                for (auto observer : write_observers) {
+                    observer->notify_write(address, length);
+                }
+            }
+        }
+    };
+
+    /*
+     * How the processor reaches memory for the story, picked at compile time.
+     * Unchecked trusts the story and costs nothing. Checked keeps the story's
+     * reads within the story and its writes within dynamic memory, and stops
+     * it with an error at the first access outside them.
+     */
+    struct UncheckedAccess {
+        static constexpr bool checked = false;
+    };
+
+    struct CheckedAccess {
+        static constexpr bool checked = true;
     };
 }
 
@@ -1,28 +1,41 @@
 #include "object_mapper.h"
+#include "header.h"
 #include "memory.h"
 #include "zchar_mapper.h"
 
 #include <iostream>
 
-zm::ObjectV5 zm::ObjectMapper::map_object(uint16_t number) {
-    uint32_t object_address = base_address + DEFAULT_PROPERTY_TABLE_SIZE + ((number - 1) * OBJECT_V5_SIZE);
-
-    return {
-        memory.read_double_word(object_address),
-        memory.read_word(object_address + 4),
-        memory.read_word(object_address + 6),
-        memory.read_word(object_address + 8),
-        memory.read_word(object_address + 10),
-        memory.read_word(object_address + 12),
-        object_address
-    };
+static zm::Object widen(const zm::SmallObjectEntry &entry, uint32_t address) {
+    return { entry.attributes, 0, entry.parent, entry.sibling, entry.child, entry.properties, address };
 }
 
-zm::ObjectMapper::ObjectMapper(zm::Memory &memory) : memory(memory) {
-    base_address = memory.read_word(0x0A);
+static zm::Object widen(const zm::LargeObjectEntry &entry, uint32_t address) {
+    return { entry.attributes_top, entry.attributes_bottom, entry.parent, entry.sibling, entry.child, entry.properties, address };
 }
 
-bool zm::ObjectMapper::test_attribute(uint16_t object, uint8_t attribute) {
+template<uint8_t Version>
+zm::Object zm::ObjectMapper<Version>::map_object(uint16_t number) {
+    uint32_t object_address = get_object_address(number);
+
+    return widen(memory.view<Entry>(object_address), object_address);
+}
+
+template<uint8_t Version>
+void zm::ObjectMapper<Version>::write_link(uint32_t address, uint16_t value) {
+    if (Traits::small_objects) {
+        memory.write(address, static_cast<uint8_t>(value));
+    } else {
+        memory.write_word(address, value);
+    }
+}
+
+template<uint8_t Version>
+zm::ObjectMapper<Version>::ObjectMapper(zm::Memory &memory) : memory(memory) {
+    base_address = Header(memory).object_table_address();
+}
+
+template<uint8_t Version>
+bool zm::ObjectMapper<Version>::test_attribute(uint16_t object, uint8_t attribute) {
     auto obj = map_object(object);
 
     /*
@@ -45,7 +58,8 @@ bool zm::ObjectMapper::test_attribute(uint16_t object, uint8_t attribute) {
     }
 }
 
-void zm::ObjectMapper::set_attribute(uint16_t object, uint8_t attribute) {
+template<uint8_t Version>
+void zm::ObjectMapper<Version>::set_attribute(uint16_t object, uint8_t attribute) {
     auto obj = map_object(object);
 
     if (attribute > 31) {
@@ -57,7 +71,8 @@ void zm::ObjectMapper::set_attribute(uint16_t object, uint8_t attribute) {
     }
 }
 
-void zm::ObjectMapper::clear_attribute(uint16_t object, uint8_t attribute) {
+template<uint8_t Version>
+void zm::ObjectMapper<Version>::clear_attribute(uint16_t object, uint8_t attribute) {
     auto obj = map_object(object);
 
     if (attribute > 31) {
@@ -69,38 +84,17 @@ void zm::ObjectMapper::clear_attribute(uint16_t object, uint8_t attribute) {
     }
 }
 
-void zm::ObjectMapper::insert_object(uint16_t source_object, uint16_t destination_object) {
+template<uint8_t Version>
+void zm::ObjectMapper<Version>::insert_object(uint16_t source_object, uint16_t destination_object) {
+    // Detach from the current parent first, then become the destination's first child
+    remove_object(source_object);
+
     auto source = map_object(source_object);
     auto destination = map_object(destination_object);
 
-    if (source.parent != 0) {
-        auto parent = map_object(source.parent);
-
-        if (parent.child == source_object) {
-            // Promote the sibling to the first child
-            parent.child = source.sibling;
-            memory.write_double_word(parent.address + 10, parent.child);
-        } else {
-            // Search for left sibling and connect to this object's sibling
-            auto obj = map_object(parent.child);
-
-            while (obj.sibling != source_object && obj.sibling != 0) {
-                obj = map_object(obj.sibling);
-            }
-
-            obj.sibling = source.sibling;
-            memory.write_double_word(obj.address + 8, obj.sibling);
-        }
-    }
-
-    source.parent = destination_object;
-    memory.write_double_word(source.address + 6, source.parent);
-
-    source.sibling = destination.child;
-    memory.write_double_word(source.address + 8, source.sibling);
-
-    destination.child = source_object;
-    memory.write_double_word(destination.address + 10, destination.child);
+    write_link(source.address + Traits::object_parent_offset, destination_object);
+    write_link(source.address + Traits::object_sibling_offset, destination.child);
+    write_link(destination.address + Traits::object_child_offset, source_object);
 }
 
 struct PropertyPointer {
@@ -111,39 +105,49 @@ struct PropertyPointer {
     uint32_t data_address;
 };
 
-PropertyPointer compute_property_location(uint32_t property_address, uint16_t property, zm::Memory &memory) {
+template<uint8_t Version>
+PropertyPointer compute_property_location(uint32_t property_address, uint16_t property, uint32_t defaults_address, zm::Memory &memory) {
     // Read property size and number
     uint8_t property_size_first_byte = memory.read_byte(property_address);
-    uint8_t property_number = property_size_first_byte & 0x3F;
+    uint8_t property_number;
 
     auto property_data_address = property_address + 1;
     auto property_size = 0;
 
-    if (property_size_first_byte & 0x80) {
+    if (zm::VersionTraits<Version>::small_objects) {
+        // Size is on bits 5 to 7, number on bits 0 to 4
+        property_number = property_size_first_byte & 0x1F;
+        property_size = (property_size_first_byte >> 5) + 1;
+    } else if (property_size_first_byte & 0x80) {
         // Size is on the second byte, bits 0 to 5
+        property_number = property_size_first_byte & 0x3F;
         property_data_address++;
         property_size = memory.read_byte(property_address + 1) & 0x3F;
+        property_size = property_size == 0 ? 64 : property_size;
     } else {
-        property_size = property_size_first_byte & 0x20 ? 2 : 1;
+        property_number = property_size_first_byte & 0x3F;
+        property_size = property_size_first_byte & 0x40 ? 2 : 1;
     }
 
     if (property > property_number) {
         // Requested property is outside bounds, get the default property
-        return { 2, static_cast<uint8_t>(property), false,static_cast<uint32_t>(memory.read_word(0x0A) + property), static_cast<uint32_t>(memory.read_word(0x0A) + property) };
+        auto default_address = static_cast<uint32_t>(defaults_address + ((property - 1) << 1));
+        return { 2, static_cast<uint8_t>(property), false, default_address, default_address };
 
     } else if (property == property_number) {
         return { static_cast<uint8_t>(property_size), property_number, true, property_address, property_data_address };
     } else {
-        return compute_property_location(property_data_address + property_size, property, memory);
+        return compute_property_location<Version>(property_data_address + property_size, property, defaults_address, memory);
     }
 }
 
-uint16_t zm::ObjectMapper::get_property(uint16_t object, uint16_t property) {
+template<uint8_t Version>
+uint16_t zm::ObjectMapper<Version>::get_property(uint16_t object, uint16_t property) {
     auto obj = map_object(object);
 
     // Jump to property table
     uint16_t object_description_length = memory.read_byte(obj.properties);
-    auto prop = compute_property_location(obj.properties + ((object_description_length << 1) + 1), property, memory);
+    auto prop = compute_property_location<Version>(obj.properties + ((object_description_length << 1) + 1), property, base_address, memory);
 
     if (prop.size == 1) {
         return memory.read_byte(prop.data_address);
@@ -152,17 +156,38 @@ uint16_t zm::ObjectMapper::get_property(uint16_t object, uint16_t property) {
     }
 }
 
-uint16_t zm::ObjectMapper::get_property_address(uint16_t object, uint16_t property) {
+template<uint8_t Version>
+void zm::ObjectMapper<Version>::put_property(uint16_t object, uint16_t property, uint16_t value) {
+    auto obj = map_object(object);
+
+    uint16_t object_description_length = memory.read_byte(obj.properties);
+    auto prop = compute_property_location<Version>(obj.properties + ((object_description_length << 1) + 1), property, base_address, memory);
+
+    // Only properties the object actually has can be written to
+    if (!prop.listed) {
+        return;
+    }
+
+    if (prop.size == 1) {
+        memory.write(prop.data_address, static_cast<uint8_t>(value));
+    } else {
+        memory.write_word(prop.data_address, value);
+    }
+}
+
+template<uint8_t Version>
+uint16_t zm::ObjectMapper<Version>::get_property_address(uint16_t object, uint16_t property) {
     auto obj = map_object(object);
 
     // Jump to property table
     uint16_t object_description_length = memory.read_byte(obj.properties);
-    auto prop = compute_property_location(obj.properties + ((object_description_length << 1) + 1), property, memory);
+    auto prop = compute_property_location<Version>(obj.properties + ((object_description_length << 1) + 1), property, base_address, memory);
 
-    return prop.data_address;
+    return prop.listed ? prop.data_address : 0;
 }
 
-uint16_t zm::ObjectMapper::get_next_property(uint16_t object, uint16_t property) {
+template<uint8_t Version>
+uint16_t zm::ObjectMapper<Version>::get_next_property(uint16_t object, uint16_t property) {
     auto obj = map_object(object);
 
     uint16_t object_description_length = memory.read_byte(obj.properties);
@@ -170,48 +195,67 @@ uint16_t zm::ObjectMapper::get_next_property(uint16_t object, uint16_t property)
 
     if (property == 0) {
         uint8_t property_size_first_byte = memory.read_byte(property_list_address);
-        return property_size_first_byte & 0x3F;
+        return property_size_first_byte & (Traits::small_objects ? 0x1F : 0x3F);
     } else {
-        auto prop = compute_property_location(property_list_address, property, memory);
+        auto prop = compute_property_location<Version>(property_list_address, property, base_address, memory);
 
         if (prop.listed) {
-            return memory.read_byte(prop.data_address + prop.size) & 0x3F;
+            return memory.read_byte(prop.data_address + prop.size) & (Traits::small_objects ? 0x1F : 0x3F);
         } else {
             return prop.number - 1;
         }
     }
 }
 
-uint16_t zm::ObjectMapper::get_property_length(uint16_t property_address) {
+template<uint8_t Version>
+uint16_t zm::ObjectMapper<Version>::get_property_length(uint16_t property_address) {
+    if (property_address == 0) {
+        return 0;
+    }
+
     auto size_byte = memory.read_byte(property_address - 1);
 
-    if (size_byte & 0x80) {
+    if (Traits::small_objects) {
+        return (size_byte >> 5) + 1;
+    } else if (size_byte & 0x80) {
         // 7th bit is set, which means the property length is on bits 0 to 5
-        return size_byte & 0x3F;
+        auto length = size_byte & 0x3F;
+        return length == 0 ? 64 : length;
     } else {
-        return size_byte & 0x20 ? 2 : 1;
+        return size_byte & 0x40 ? 2 : 1;
     }
 }
 
-uint16_t zm::ObjectMapper::get_parent(uint16_t object) {
+template<uint8_t Version>
+uint16_t zm::ObjectMapper<Version>::get_parent(uint16_t object) {
     auto obj = map_object(object);
 
     return obj.parent;
 }
 
-uint16_t zm::ObjectMapper::get_sibling(uint16_t object) {
+template<uint8_t Version>
+uint16_t zm::ObjectMapper<Version>::get_sibling(uint16_t object) {
     auto obj = map_object(object);
 
     return obj.sibling;
 }
 
-uint16_t zm::ObjectMapper::get_child(uint16_t object) {
+template<uint8_t Version>
+uint16_t zm::ObjectMapper<Version>::get_child(uint16_t object) {
     auto obj = map_object(object);
 
     return obj.child;
 }
 
-void zm::ObjectMapper::remove_object(uint16_t object) {
+template<uint8_t Version>
+uint32_t zm::ObjectMapper<Version>::get_name_address(uint16_t object) {
+    auto obj = map_object(object);
+
+    return obj.properties + 1;
+}
+
+template<uint8_t Version>
+void zm::ObjectMapper<Version>::remove_object(uint16_t object) {
     auto obj = map_object(object);
 
     if (obj.parent != 0) {
@@ -219,22 +263,31 @@ void zm::ObjectMapper::remove_object(uint16_t object) {
 
         if (parent.child == object) {
             // The sibling must be promoted as the parent's first child
-            parent.child = obj.sibling;
-            memory.write_word(parent.address + 10, parent.child);
+            write_link(parent.address + Traits::object_child_offset, obj.sibling);
+        } else {
+            // Search for left sibling and connect to this object's sibling
+            auto left = map_object(parent.child);
+
+            while (left.sibling != object && left.sibling != 0) {
+                left = map_object(left.sibling);
+            }
+
+            write_link(left.address + Traits::object_sibling_offset, obj.sibling);
         }
     }
 
-    obj.parent = 0;
-    memory.write_word(obj.address + 6, obj.parent);
+    write_link(obj.address + Traits::object_parent_offset, 0);
+    write_link(obj.address + Traits::object_sibling_offset, 0);
 }
 
-void zm::ObjectMapper::print_object_table() {
+template<uint8_t Version>
+void zm::ObjectMapper<Version>::print_object_table() {
     ZCharMapper char_mapper(memory);
 
     // Print property defaults
     std::cout << "Property defaults:" << std::endl;
-    for (int i = 0; i < 63; i++) {
-        std::cout << "\t[" << i + 1 << "] = " << std::hex << memory.read_word(base_address + i) << std::dec << std::endl;
+    for (int i = 0; i < Traits::property_defaults; i++) {
+        std::cout << "\t[" << i + 1 << "] = " << std::hex << memory.read_word(base_address + (i << 1)) << std::dec << std::endl;
     }
 
     // Compute number of objects
@@ -249,9 +302,9 @@ void zm::ObjectMapper::print_object_table() {
          * table divided by the size of an object
          */
         uint16_t properties_address = object.properties;
-        uint16_t offset = properties_address - (base_address + DEFAULT_PROPERTY_TABLE_SIZE);
+        uint16_t offset = properties_address - (base_address + Traits::property_defaults_size);
 
-        auto pseudo_count = offset / OBJECT_V5_SIZE;
+        auto pseudo_count = offset / Traits::object_entry_size;
 
         if (pseudo_count < object_count) {
             std::cout << "Object count estimated at " << pseudo_count << std::endl;
@@ -267,7 +320,7 @@ void zm::ObjectMapper::print_object_table() {
         if (object.attributes_top == 0x00000000 && object.attributes_bottom == 0x0000) {
             std::cout << "None";
         } else {
-            for (int attribute = 0; attribute < 48; attribute++) {
+            for (int attribute = 0; attribute < Traits::attribute_count; attribute++) {
                 if (test_attribute(object_id, attribute)) {
                     std::cout << attribute << ", ";
                 }
@@ -307,3 +360,12 @@ void zm::ObjectMapper::print_object_table() {
         }
     }
 }
+
+template class zm::ObjectMapper<1>;
+template class zm::ObjectMapper<2>;
+template class zm::ObjectMapper<3>;
+template class zm::ObjectMapper<4>;
+template class zm::ObjectMapper<5>;
+template class zm::ObjectMapper<6>;
+template class zm::ObjectMapper<7>;
+template class zm::ObjectMapper<8>;
@@ -1,24 +1,17 @@
 #ifndef ZETAMACHINE_OBJECT_MAPPER_H
 #define ZETAMACHINE_OBJECT_MAPPER_H
 
-#define OBJECT_V5_SIZE 14
-
-#define DEFAULT_PROPERTY_TABLE_SIZE 126
-
 #include <cstdint>
+#include <type_traits>
+
+#include "big_endian.h"
+#include "../version.h"
 
 namespace zm {
     class Memory;
 
-    struct ObjectV3 {
-        uint32_t attributes;
-        uint8_t parent;
-        uint8_t sibling;
-        uint8_t child;
-        uint16_t properties;
-    };
-
-    struct ObjectV5 {
+    // An object table entry, widened to the largest (version 4+) layout
+    struct Object {
         uint32_t attributes_top;
         uint16_t attributes_bottom;
         uint16_t parent;
@@ -28,8 +21,33 @@ namespace zm {
         uint32_t address;
     };
 
+    // Object table entries as they are in memory, up to version 3 and from version 4 on
+    struct SmallObjectEntry {
+        be32 attributes;
+        uint8_t parent;
+        uint8_t sibling;
+        uint8_t child;
+        be16 properties;
+    };
+
+    struct LargeObjectEntry {
+        be32 attributes_top;
+        be16 attributes_bottom;
+        be16 parent;
+        be16 sibling;
+        be16 child;
+        be16 properties;
+    };
+
+    static_assert(sizeof(SmallObjectEntry) == VersionTraits<3>::object_entry_size, "Object entries are 9 bytes up to version 3");
+    static_assert(sizeof(LargeObjectEntry) == VersionTraits<5>::object_entry_size, "Object entries are 14 bytes from version 4 on");
+
+    template<uint8_t Version>
     class ObjectMapper {
     public:
+        using Traits = VersionTraits<Version>;
+        using Entry = typename std::conditional<Traits::small_objects, SmallObjectEntry, LargeObjectEntry>::type;
+
         explicit ObjectMapper(Memory &memory);
 
         bool test_attribute(uint16_t object, uint8_t attribute);
@@ -39,6 +57,7 @@ namespace zm {
         void insert_object(uint16_t source_object, uint16_t destination_object);
 
         uint16_t get_property(uint16_t object, uint16_t property);
+        void put_property(uint16_t object, uint16_t property, uint16_t value);
         uint16_t get_property_address(uint16_t object, uint16_t property);
         uint16_t  get_next_property(uint16_t object, uint16_t property);
 
@@ -48,6 +67,14 @@ namespace zm {
         uint16_t get_sibling(uint16_t object);
         uint16_t get_child(uint16_t object);
 
+        // Where the object's entry in the object table is
+        uint32_t get_object_address(uint16_t object) const {
+            return base_address + Traits::property_defaults_size + ((object - 1) * Traits::object_entry_size);
+        }
+
+        // Address of the encoded short name, right after its length byte
+        uint32_t get_name_address(uint16_t object);
+
         void remove_object(uint16_t object);
 
         void print_object_table();
@@ -56,7 +83,8 @@ namespace zm {
         uint32_t base_address;
         Memory &memory;
 
-        ObjectV5 map_object(uint16_t number);
+        Object map_object(uint16_t number);
+        void write_link(uint32_t address, uint16_t value);
     };
 }
 
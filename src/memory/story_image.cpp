@@ -0,0 +1,482 @@
+#include "story_image.h"
+#include "header.h"
+
+#include "spdlog/spdlog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define HEADER_LENGTH 0x40
+
+// As much as a story ever got before images were shared
+#define MAX_STORY_LENGTH 1000000
+
+static uint32_t page_size() {
+    static const auto size = static_cast<uint32_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+// An unnamed file, gone once nothing maps it or holds it open
+static int anonymous_file() {
+#ifdef __linux__
+    return memfd_create("zetamachine-story", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+#else
+    char name[] = "/tmp/zetamachine-story-XXXXXX";
+    int file = mkstemp(name);
+
+    if (file >= 0) {
+        unlink(name);
+    }
+
+    return file;
+#endif
+}
+
+// Once sealed, nobody can change the story or its size, even with the file open for writing
+static void seal(int file) {
+#ifdef F_ADD_SEALS
+    fcntl(file, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+#else
+    (void) file;
+#endif
+}
+
+// Where other processes find the image of a story
+// The name also says whether the checksum of the story matched when the image was made
+static std::string image_path(const std::string &directory, const zm::StoryKey &key, bool verified) {
+    char name[80];
+    std::string serial;
+
+    for (char character : key.serial) {
+        char digits[3];
+        std::snprintf(digits, sizeof(digits), "%02x", static_cast<uint8_t>(character));
+        serial += digits;
+    }
+
+    std::snprintf(name, sizeof(name), "zetamachine-%04x-%s-%04x-%u%s.story", key.release, serial.c_str(), key.checksum, key.length,
+                  verified ? "" : "-unverified");
+    return directory + "/" + name;
+}
+
+static bool same_key(const zm::StoryKey &a, const zm::StoryKey &b) {
+    return !(a < b) && !(b < a);
+}
+
+static const zm::HeaderFields &header_of(const uint8_t *story) {
+    return *reinterpret_cast<const zm::HeaderFields *>(story);
+}
+
+// The length is stored divided by 2, 4 or 8, and missing from the oldest stories
+static uint32_t file_length(const zm::HeaderFields &header) {
+    return static_cast<uint32_t>(header.file_length) << (header.version <= 3 ? 1 : (header.version <= 5 ? 2 : 3));
+}
+
+// False when the bytes are no story, or less than their header says
+static bool check_story(const uint8_t *story, size_t length, bool &verified) {
+    uint32_t dynamic_length = length >= HEADER_LENGTH ? header_of(story).static_memory_base : 0;
+
+    if (length < HEADER_LENGTH || length > MAX_STORY_LENGTH || story[0] < 1 || story[0] > 8 || dynamic_length < HEADER_LENGTH) {
+        spdlog::error("Not a story: {} bytes, version {}, static memory at {:x}", length, length == 0 ? 0 : story[0], dynamic_length);
+        return false;
+    }
+
+    uint32_t header_length = file_length(header_of(story));
+
+    if (header_length > length) {
+        spdlog::error("The story is cut short: {} bytes of {}", length, header_length);
+        return false;
+    }
+
+    uint16_t expected = header_of(story).checksum;
+    uint16_t checksum = header_length != 0 ? zm::story_checksum(story, header_length) : expected;
+    verified = checksum == expected;
+
+    if (!verified) {
+        spdlog::warn("The story's checksum is {:x} where its header says {:x}, it may be damaged", checksum, expected);
+    }
+
+    return true;
+}
+
+/*
+ * Eight bytes at a time: each step adds the bytes of a word pairwise into
+ * four 16-bit lanes, folded into the sum before they can carry into each other.
+ */
+uint16_t zm::story_checksum(const uint8_t *story, uint32_t length) {
+    const uint64_t lanes = 0x00FF00FF00FF00FFull;
+    uint32_t sum = 0;
+    uint32_t i = HEADER_LENGTH;
+
+    while (i + 8 <= length) {
+        uint64_t accumulator = 0;
+
+        // At most 510 per lane and step
+        for (uint32_t end = std::min(length - 7, i + 128 * 8); i < end; i += 8) {
+            uint64_t word;
+            std::memcpy(&word, story + i, sizeof(word));
+            accumulator += (word & lanes) + ((word >> 8) & lanes);
+        }
+
+        sum += static_cast<uint32_t>((accumulator & 0xFFFF) + ((accumulator >> 16) & 0xFFFF) + ((accumulator >> 32) & 0xFFFF) + (accumulator >> 48));
+    }
+
+    for (; i < length; ++i) {
+        sum += story[i];
+    }
+
+    return static_cast<uint16_t>(sum);
+}
+
+bool zm::find_blorb_story(const uint8_t *file, size_t size, size_t &offset, size_t &length) {
+    if (size < 12 || std::memcmp(file, "FORM", 4) != 0 || std::memcmp(file + 8, "IFRS", 4) != 0) {
+        return false;
+    }
+
+    size_t end = std::min<size_t>(size, 8 + static_cast<size_t>(zm::load_be32(file + 4)));
+
+    auto executable = [&](size_t chunk) {
+        if (chunk + 8 > end || std::memcmp(file + chunk, "ZCOD", 4) != 0) {
+            return false;
+        }
+
+        offset = chunk + 8;
+        length = std::min<size_t>(zm::load_be32(file + chunk + 4), end - offset);
+        return true;
+    };
+
+    // Chunks are padded to an even length. The resource index names the one with the story
+    for (size_t chunk = 12; chunk + 8 <= end; chunk += 8 + ((static_cast<size_t>(zm::load_be32(file + chunk + 4)) + 1) & ~static_cast<size_t>(1))) {
+        if (std::memcmp(file + chunk, "RIdx", 4) == 0 && chunk + 12 <= end) {
+            uint32_t count = zm::load_be32(file + chunk + 8);
+
+            for (size_t entry = chunk + 12; count > 0 && entry + 12 <= end; entry += 12, --count) {
+                if (std::memcmp(file + entry, "Exec", 4) == 0 && executable(zm::load_be32(file + entry + 8))) {
+                    return true;
+                }
+            }
+        }
+
+        if (executable(chunk)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+zm::StoryKey zm::story_key(const uint8_t *header, size_t header_length, uint32_t length) {
+    if (header_length < HEADER_LENGTH) {
+        return { 0, "", 0, length };
+    }
+
+    const HeaderFields &fields = header_of(header);
+
+    return { fields.release, std::string(fields.serial, 6), fields.checksum, length };
+}
+
+zm::StoryImage::~StoryImage() {
+    munmap(mapping, mapping_length);
+    close(file);
+}
+
+std::shared_ptr<const zm::StoryImage> zm::StoryImage::create(const std::vector<uint8_t> &story, const std::string &directory) {
+    bool verified = true;
+
+    if (!check_story(story.data(), story.size(), verified)) {
+        return nullptr;
+    }
+
+    // Dynamic memory the file leaves out starts as zeros
+    uint32_t dynamic_length = header_of(story.data()).static_memory_base;
+    auto length = static_cast<uint32_t>(story.size());
+    uint32_t size = (std::max(length, dynamic_length) + page_size() - 1) & ~(page_size() - 1);
+    StoryKey key = zm::story_key(story.data(), story.size(), length);
+
+    /*
+     * A shared image is written under a name of its own, and only linked
+     * to where others look for it once complete. Whoever links first wins,
+     * the others use that one.
+     */
+    std::string path = directory.empty() ? "" : image_path(directory, key, verified);
+    std::string partial = path + "." + std::to_string(getpid());
+    int file = directory.empty() ? anonymous_file() : ::open(partial.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0444);
+
+    if (file >= 0 && (ftruncate(file, size) != 0 || pwrite(file, story.data(), length, 0) != static_cast<ssize_t>(length))) {
+        close(file);
+        file = -1;
+
+        if (!directory.empty()) {
+            unlink(partial.c_str());
+        }
+    }
+
+    if (file < 0 && !directory.empty()) {
+        spdlog::warn("Could not share the story in {}, it gets an image of its own", directory);
+        return create(story);
+    }
+
+    if (!directory.empty()) {
+        bool linked = link(partial.c_str(), path.c_str()) == 0;
+        bool taken = !linked && errno == EEXIST;
+        unlink(partial.c_str());
+
+        if (taken) {
+            close(file);
+            auto shared = open(directory, key);
+
+            // Not an image this process can trust, so it makes one of its own
+            return shared ? shared : create(story);
+        }
+    }
+
+    void *view = MAP_FAILED;
+
+    if (file >= 0) {
+        seal(file);
+        view = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+    }
+
+    if (view == MAP_FAILED) {
+        spdlog::error("Could not make an image of the story{}", directory.empty() ? "" : " in " + directory);
+
+        if (file >= 0) {
+            close(file);
+        }
+
+        return nullptr;
+    }
+
+    std::shared_ptr<StoryImage> image { new StoryImage() };
+    image->file = file;
+    image->mapping = view;
+    image->mapping_length = size;
+    image->view = static_cast<const uint8_t *>(view);
+    image->story_key = key;
+    image->story_length = length;
+    image->mapped_size = size;
+    image->dynamic_length = dynamic_length;
+    image->checksum_matches = verified;
+
+    return image;
+}
+
+std::shared_ptr<const zm::StoryImage> zm::StoryImage::open(const std::string &directory, const zm::StoryKey &key) {
+    // Stories whose checksum did not match are rare, and looked for second
+    bool verified = true;
+    int file = ::open(image_path(directory, key, true).c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+
+    if (file < 0 && errno == ENOENT) {
+        verified = false;
+        file = ::open(image_path(directory, key, false).c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    }
+
+    struct stat status {};
+
+    if (file < 0) {
+        return nullptr;
+    }
+
+    /*
+     * Images are complete and checked before anyone can open them, only their
+     * header is looked at. Anyone may write to a directory such as /dev/shm,
+     * so only plain files of this user that nobody else can change are used.
+     */
+    if (fstat(file, &status) != 0 || !S_ISREG(status.st_mode) || status.st_uid != geteuid() || (status.st_mode & (S_IWGRP | S_IWOTH)) != 0 ||
+        status.st_size < static_cast<off_t>(std::max<uint32_t>(key.length, HEADER_LENGTH)) || status.st_size % page_size() != 0) {
+        close(file);
+        return nullptr;
+    }
+
+    auto size = static_cast<uint32_t>(status.st_size);
+    void *view = mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+
+    if (view == MAP_FAILED) {
+        close(file);
+        return nullptr;
+    }
+
+    auto bytes = static_cast<const uint8_t *>(view);
+
+    // The size an image of that story is made with
+    const HeaderFields &header = header_of(bytes);
+    uint32_t expected = (std::max<uint32_t>(key.length, header.static_memory_base) + page_size() - 1) & ~(page_size() - 1);
+
+    if (!same_key(zm::story_key(bytes, HEADER_LENGTH, key.length), key) || size != expected) {
+        munmap(view, size);
+        close(file);
+        return nullptr;
+    }
+
+    std::shared_ptr<StoryImage> image { new StoryImage() };
+    image->file = file;
+    image->mapping = view;
+    image->mapping_length = size;
+    image->view = bytes;
+    image->story_key = key;
+    image->story_length = key.length;
+    image->mapped_size = size;
+    image->dynamic_length = header.static_memory_base;
+    image->checksum_matches = verified;
+
+    return image;
+}
+
+std::shared_ptr<const zm::StoryImage> zm::StoryImage::map(const std::string &path) {
+    int file = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat status {};
+
+    if (file < 0 || fstat(file, &status) != 0 || status.st_size <= 0) {
+        spdlog::error("Could not read a story from {}", path);
+
+        if (file >= 0) {
+            close(file);
+        }
+
+        return nullptr;
+    }
+
+    auto file_size = static_cast<size_t>(status.st_size);
+    void *mapping = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, file, 0);
+
+    if (mapping == MAP_FAILED) {
+        spdlog::error("Could not map {}", path);
+        close(file);
+        return nullptr;
+    }
+
+    auto bytes = static_cast<const uint8_t *>(mapping);
+    size_t offset = 0;
+    size_t length = file_size;
+    bool verified = true;
+
+    find_blorb_story(bytes, file_size, offset, length);
+
+    if (!check_story(bytes + offset, length, verified)) {
+        munmap(mapping, file_size);
+        close(file);
+        return nullptr;
+    }
+
+    uint32_t dynamic_length = header_of(bytes + offset).static_memory_base;
+
+    // Only a story on a page boundary with all of its dynamic memory in the file can be mapped from it
+    if (offset % page_size() != 0 || dynamic_length > length) {
+        auto image = create(std::vector<uint8_t>(bytes + offset, bytes + offset + length));
+        munmap(mapping, file_size);
+        close(file);
+        return image;
+    }
+
+    auto story_length = static_cast<uint32_t>(length);
+
+    std::shared_ptr<StoryImage> image { new StoryImage() };
+    image->file = file;
+    image->file_offset = static_cast<uint32_t>(offset);
+    image->mapping = mapping;
+    image->mapping_length = file_size;
+    image->view = bytes + offset;
+    image->story_key = zm::story_key(bytes + offset, length, story_length);
+    image->story_length = story_length;
+    image->mapped_size = (story_length + page_size() - 1) & ~(page_size() - 1);
+    image->dynamic_length = dynamic_length;
+    image->checksum_matches = verified;
+
+    return image;
+}
+
+zm::StoryRegistry &zm::StoryRegistry::shared() {
+    static StoryRegistry registry;
+    return registry;
+}
+
+std::shared_ptr<const zm::StoryImage> zm::StoryRegistry::get(const std::vector<uint8_t> &story, const std::string &directory) {
+    std::lock_guard<std::mutex> lock(mutex);
+    StoryKey key = story_key(story.data(), story.size(), static_cast<uint32_t>(story.size()));
+    auto image = find(key, directory);
+
+    if (!image) {
+        return insert(StoryImage::create(story, directory));
+    }
+
+    // Stories still being written often leave the header alone
+    if (std::memcmp(image->bytes(), story.data(), story.size()) != 0) {
+        return StoryImage::create(story);
+    }
+
+    return image;
+}
+
+std::shared_ptr<const zm::StoryImage> zm::StoryRegistry::get(const std::string &path, const std::string &directory) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    auto length = static_cast<uint32_t>(std::max<std::streamoff>(file.tellg(), 0));
+    uint8_t header[HEADER_LENGTH];
+
+    if (!file.seekg(0) || !file.read(reinterpret_cast<char *>(header), HEADER_LENGTH)) {
+        spdlog::error("Could not read a story from {}", path);
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Stories in a Blorb file are only found once it is mapped
+    bool blorb = std::memcmp(header, "FORM", 4) == 0;
+    auto image = blorb ? nullptr : find(story_key(header, HEADER_LENGTH, length), directory);
+
+    if (image) {
+        return image;
+    }
+
+    auto mapped = StoryImage::map(path);
+    image = mapped && blorb ? find(mapped->key(), directory) : nullptr;
+
+    if (!mapped || image) {
+        return image;
+    }
+
+    // Shared ones are copied where other processes find them
+    return insert(directory.empty() ? mapped : StoryImage::create(std::vector<uint8_t>(mapped->bytes(), mapped->bytes() + mapped->length()), directory));
+}
+
+size_t zm::StoryRegistry::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t count = 0;
+
+    for (auto &image : images) {
+        count += !image.second.expired();
+    }
+
+    return count;
+}
+
+// In this process first, then among the images other processes shared
+std::shared_ptr<const zm::StoryImage> zm::StoryRegistry::find(const zm::StoryKey &key, const std::string &directory) {
+    auto found = images.find(key);
+    auto image = found != images.end() ? found->second.lock() : nullptr;
+
+    if (!image && !directory.empty()) {
+        image = insert(StoryImage::open(directory, key));
+    }
+
+    return image;
+}
+
+std::shared_ptr<const zm::StoryImage> zm::StoryRegistry::insert(std::shared_ptr<const zm::StoryImage> image) {
+    if (image) {
+        // Images nobody uses any more go as new ones come
+        for (auto i = images.begin(); i != images.end(); ) {
+            i = i->second.expired() ? images.erase(i) : std::next(i);
+        }
+
+        images[image->key()] = image;
+    }
+
+    return image;
+}
@@ -0,0 +1,127 @@
+#ifndef ZETAMACHINE_STORY_IMAGE_H
+#define ZETAMACHINE_STORY_IMAGE_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace zm {
+    // What tells stories apart: the release, serial and checksum in their header, and their length
+    struct StoryKey {
+        uint16_t release;
+        std::string serial;
+        uint16_t checksum;
+        uint32_t length;
+
+        bool operator<(const StoryKey &other) const {
+            return std::tie(release, serial, checksum, length) < std::tie(other.release, other.serial, other.checksum, other.length);
+        }
+    };
+
+    /*
+     * One read-only copy of a story, in a sealed anonymous file that every
+     * Memory made from it maps copy-on-write. Pages no session writes to,
+     * which is all of static and high memory, stay shared between sessions;
+     * each one only gets private copies of the dynamic pages it changes.
+     *
+     * Story files are mapped as they are when they can be, so pages are
+     * only read from them when first used. Images can also be shared between
+     * processes, as read-only files in a directory such as /dev/shm.
+     * Processes forked after an image was made share it anyway.
+     */
+    class StoryImage {
+    public:
+        // Empty when the bytes are not a story. With a directory, the image is shared there
+        static std::shared_ptr<const StoryImage> create(const std::vector<uint8_t> &story, const std::string &directory = "");
+
+        // The image another process of this user shared in the directory, empty when there is none
+        static std::shared_ptr<const StoryImage> open(const std::string &directory, const StoryKey &key);
+
+        // A story file, or the story in a Blorb file, mapped without copying it when it lies on a page boundary
+        static std::shared_ptr<const StoryImage> map(const std::string &path);
+
+        ~StoryImage();
+
+        StoryImage(const StoryImage &) = delete;
+        StoryImage &operator=(const StoryImage &) = delete;
+
+        // Where Memory maps the story from
+        int descriptor() const { return file; }
+        uint32_t offset() const { return file_offset; }
+
+        const StoryKey &key() const { return story_key; }
+
+        // Mapped read-only
+        const uint8_t *bytes() const { return view; }
+
+        // The story, and the pages it is mapped in
+        uint32_t length() const { return story_length; }
+        uint32_t size() const { return mapped_size; }
+
+        // Below the static memory base, what a session may change
+        uint32_t dynamic_size() const { return dynamic_length; }
+
+        // What VERIFY finds: the checksum in the header matches the story, or there is none
+        bool verified() const { return checksum_matches; }
+
+    private:
+        StoryImage() = default;
+
+        int file = -1;
+        uint32_t file_offset = 0;
+        void *mapping = nullptr;
+        size_t mapping_length = 0;
+
+        const uint8_t *view = nullptr;
+        StoryKey story_key;
+        uint32_t story_length = 0;
+        uint32_t mapped_size = 0;
+        uint32_t dynamic_length = 0;
+        bool checksum_matches = true;
+    };
+
+    /*
+     * Hands out one image per story to everyone who loads it, for as long
+     * as any of them still uses it. Stories are told apart by their key.
+     */
+    class StoryRegistry {
+    public:
+        // The process-wide registry
+        static StoryRegistry &shared();
+
+        /*
+         * With a directory, images are also looked for there before one is
+         * made, and made there for other processes to find.
+         */
+        // A story with the key of a different one gets an image of its own
+        std::shared_ptr<const StoryImage> get(const std::vector<uint8_t> &story, const std::string &directory = "");
+
+        // Reads no more than the header when a story with its key is loaded
+        std::shared_ptr<const StoryImage> get(const std::string &path, const std::string &directory = "");
+
+        // Stories with an image in use
+        size_t size();
+
+    private:
+        std::mutex mutex;
+        std::map<StoryKey, std::weak_ptr<const StoryImage>> images;
+
+        std::shared_ptr<const StoryImage> find(const StoryKey &key, const std::string &directory);
+        std::shared_ptr<const StoryImage> insert(std::shared_ptr<const StoryImage> image);
+    };
+
+    // Empty serial when the header is too short
+    StoryKey story_key(const uint8_t *header, size_t header_length, uint32_t length);
+
+    // The sum of the bytes after the header up to length, which VERIFY compares with the header
+    uint16_t story_checksum(const uint8_t *story, uint32_t length);
+
+    // Where the executable (ZCOD) chunk of a Blorb file is, false when it is not a Blorb with one
+    bool find_blorb_story(const uint8_t *file, size_t size, size_t &offset, size_t &length);
+}
+
+#endif //ZETAMACHINE_STORY_IMAGE_H
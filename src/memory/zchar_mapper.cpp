@@ -1,10 +1,11 @@
 #include "zchar_mapper.h"
 #include "memory.h"
 
-#include <iostream>
-#include <sstream>
 #include <string>
 
+// Abbreviations are not meant to hold abbreviations, but a few levels are let through
+#define MAX_ABBREVIATION_DEPTH 3
+
 const char alphabet[3][32] {
         { ' ', '^', '^', '^', '^', '^', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z' },
         { ' ', '^', '^', '^', '^', '^', 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z' },
@@ -22,21 +23,58 @@ enum class CharMode {
     DOUBLE_BOTTOM
 };
 
-zm::ZCharMapper::ZCharMapper(zm::Memory &memory) : memory(memory) {
+zm::ZCharMapper::ZCharMapper(zm::Memory &memory) : ZCharMapper(memory, memory.capacity()) { }
+
+zm::ZCharMapper::ZCharMapper(zm::Memory &memory, uint32_t end) : memory(memory), end(end) {
     abbreviations_base = memory.read_word(0x18);
 }
 
 std::string zm::ZCharMapper::map(uint32_t address) {
-    return map(address, word_len(address));
+    std::string text;
+    map(address, text);
+    return text;
 }
 
 std::string zm::ZCharMapper::map(uint32_t address, uint32_t length) {
-    std::stringstream final;
+    std::string text;
+    append(text, address, length, 0);
+    return text;
+}
+
+bool zm::ZCharMapper::map(uint32_t address, std::string &text) {
+    uint32_t length = word_len(address);
+    return append(text, address, length, 0) && address + (length << 1) <= end;
+}
 
+bool zm::ZCharMapper::append(std::string &text, uint32_t address, uint32_t length, int depth) {
     auto mode = CharMode::NORMAL;
+    bool complete = true;
+
+    // The string the abbreviation in that slot stands for, if it lies before the end
+    auto abbreviate = [&](uint32_t slot) {
+        uint32_t entry = abbreviations_base + (slot << 1);
+
+        if (depth == MAX_ABBREVIATION_DEPTH || entry + 2 > end) {
+            complete = false;
+            return;
+        }
 
-    for (uint32_t i = 0; i < length; ++i) {
-        uint16_t raw = memory.read_word(address + (i << 1));
+        uint32_t string = static_cast<uint32_t>(memory.read_word(entry)) << 1;
+        uint32_t string_length = word_len(string);
+
+        if (!append(text, string, string_length, depth + 1) || string + (string_length << 1) > end) {
+            complete = false;
+        }
+    };
+
+    for (uint32_t i = 0; i < length && complete; ++i) {
+        uint32_t at = address + (i << 1);
+
+        if (at + 2 > end) {
+            return false;
+        }
+
+        uint16_t raw = memory.read_word(at);
 
         uint8_t first_char = ((raw & 0b0111110000000000) >> 10);
         uint8_t second_char = ((raw & 0b0000001111100000) >> 5);
@@ -44,7 +82,7 @@ std::string zm::ZCharMapper::map(uint32_t address, uint32_t length) {
 
         uint8_t chars[3] = { first_char, second_char, third_char };
 
-        char double_character;
+        uint16_t double_character;
 
         for (int j = 0; j < 3; j++) {
             uint8_t code = chars[j];
@@ -57,11 +95,11 @@ std::string zm::ZCharMapper::map(uint32_t address, uint32_t length) {
                         case 3 : mode = CharMode::ABBREV_3; break;
                         case 4 : mode = CharMode::SHIFT; break;
                         case 5 : mode = CharMode::SPECIAL; break;
-                        default : final << alphabet[0][code];
+                        default : text += alphabet[0][code];
                     } break;
-                case CharMode::ABBREV_1 : final << map(memory.read_word((abbreviations_base + (code << 1))) << 1); mode = CharMode::NORMAL; break;
-                case CharMode::ABBREV_2 : final << map(memory.read_word((abbreviations_base + ((32 + code) << 1))) << 1); mode = CharMode::NORMAL; break;
-                case CharMode::ABBREV_3 : final << map(memory.read_word((abbreviations_base + ((64 + code) << 1))) << 1); mode = CharMode::NORMAL; break;
+                case CharMode::ABBREV_1 : abbreviate(code); mode = CharMode::NORMAL; break;
+                case CharMode::ABBREV_2 : abbreviate(32 + code); mode = CharMode::NORMAL; break;
+                case CharMode::ABBREV_3 : abbreviate(64 + code); mode = CharMode::NORMAL; break;
                 case CharMode::SHIFT :
                     switch (code) {
                         case 1 : mode = CharMode::ABBREV_1; break;
@@ -69,7 +107,7 @@ std::string zm::ZCharMapper::map(uint32_t address, uint32_t length) {
                         case 3 : mode = CharMode::ABBREV_3; break;
                         case 4 : mode = CharMode::SHIFT; break;
                         case 5 : mode = CharMode::SPECIAL; break;
-                        default : final << alphabet[1][code]; mode = CharMode::NORMAL;
+                        default : text += alphabet[1][code]; mode = CharMode::NORMAL;
                     } break;
                 case CharMode::SPECIAL :
                     switch (code) {
@@ -79,34 +117,74 @@ std::string zm::ZCharMapper::map(uint32_t address, uint32_t length) {
                         case 4 : mode = CharMode::SHIFT; break;
                         case 5 : mode = CharMode::SPECIAL; break;
                         case 6 : mode = CharMode::DOUBLE_TOP; break;
-                        default : final << alphabet[2][code]; mode = CharMode::NORMAL;
+                        default : text += alphabet[2][code]; mode = CharMode::NORMAL;
                     } break;
                 case CharMode::DOUBLE_TOP :
                     double_character = code & 0b00000111;
                     mode = CharMode::DOUBLE_BOTTOM;
                     break;
                 case CharMode::DOUBLE_BOTTOM :
-                    double_character = ((double_character << 5) & (code & 0b00011111));
-                    final << double_character;
+                    double_character = ((double_character << 5) | (code & 0b00011111));
+                    text += (double_character == 13 ? '\n' : static_cast<char>(double_character));
                     mode = CharMode::NORMAL;
                     break;
             }
         }
     }
 
-    return final.str();
+    return complete;
 }
 
 uint32_t zm::ZCharMapper::word_len(uint32_t address) {
     uint32_t length = 1;
 
-    for (int i = 0; ; i++) {
-        if (!(memory.read_word(address + (i << 1)) & 0b1000000000000000)) {
-            length++;
-        } else {
-            break;
-        }
+    // A string that is not terminated before the end is taken to run one word past it
+    for (uint32_t at = address; at + 2 <= end && !(memory.read_word(at) & 0b1000000000000000); at += 2) {
+        length++;
     }
 
     return length;
 }
+
+std::vector<uint16_t> zm::ZCharMapper::encode(const std::string &text, uint32_t zchar_count) {
+    std::vector<uint8_t> zchars;
+
+    for (char character : text) {
+        if (character >= 'a' && character <= 'z') {
+            zchars.push_back(character - 'a' + 6);
+            continue;
+        }
+
+        // Punctuation and digits live in A2, reached with a single shift
+        bool found = false;
+
+        for (uint8_t code = 7; code < 32 && !found; ++code) {
+            if (alphabet[2][code] == character && code != 7) {
+                zchars.push_back(5);
+                zchars.push_back(code);
+                found = true;
+            }
+        }
+
+        // Anything else is spelled out as a 10-bit ZSCII escape
+        if (!found) {
+            zchars.push_back(5);
+            zchars.push_back(6);
+            zchars.push_back((static_cast<uint8_t>(character) >> 5) & 0x1F);
+            zchars.push_back(static_cast<uint8_t>(character) & 0x1F);
+        }
+    }
+
+    // Truncate or pad with shift characters to the requested length
+    zchars.resize(zchar_count, 5);
+
+    std::vector<uint16_t> words;
+
+    for (uint32_t i = 0; i < zchar_count; i += 3) {
+        words.push_back((zchars[i] << 10) | (zchars[i + 1] << 5) | zchars[i + 2]);
+    }
+
+    words.back() |= 0x8000;
+
+    return words;
+}
@@ -3,21 +3,37 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 namespace zm {
     class Memory;
 
+    /*
+     * Reads text from memory before end, the whole of it unless given. A
+     * string that is not terminated by then runs to it, and reads as far
+     * as it goes.
+     */
     class ZCharMapper {
     public:
         explicit ZCharMapper(Memory &memory);
+        ZCharMapper(Memory &memory, uint32_t end);
 
         std::string map(uint32_t address);
         std::string map(uint32_t address, uint32_t length);
 
+        // False when the string or an abbreviation in it runs past the end, or abbreviations nest too deep
+        bool map(uint32_t address, std::string &text);
+
         uint32_t word_len(uint32_t address);
+
+        // Encodes lower case text into zchar_count Z-characters (a multiple of 3), as stored in the dictionary
+        std::vector<uint16_t> encode(const std::string &text, uint32_t zchar_count);
     private:
         Memory &memory;
+        uint32_t end;
         uint32_t abbreviations_base;
+
+        bool append(std::string &text, uint32_t address, uint32_t length, int depth);
     };
 }
 
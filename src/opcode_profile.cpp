@@ -0,0 +1,142 @@
+#include "opcode_profile.h"
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+static const char *class_names[OPCODE_CLASSES] = { "0OP", "1OP", "2OP", "VAR", "EXT" };
+
+// By the shape of the opcode byte, as in its decoding
+static int opcode_class(uint16_t slot) {
+    if (slot >= INSTRUCTION_SET_LENGTH) {
+        return 4;
+    }
+
+    if (slot < 0x80 || (slot >= 0xC0 && slot < 0xE0)) {
+        return 2;
+    }
+
+    if (slot < 0xB0) {
+        return 1;
+    }
+
+    return slot < 0xC0 ? 0 : 3;
+}
+
+void zm::OpcodeProfile::sample(uint16_t slot) {
+    // The timed instruction ends where the one after it is fetched. Counters are
+    // read outside the clock readings, so their system calls do not show in the cost
+    if (timing) {
+        costs[timed] += ticks() - start;
+        ++samples[timed];
+        timing = false;
+
+        if (counters) {
+            PerfReading &total = class_counters[opcode_class(timed)];
+            total = total + (counters->read() - reading);
+            ++class_samples[opcode_class(timed)];
+        }
+
+        // Jittered, so that loops whose length divides the interval are not always sampled at the same instruction
+        jitter ^= jitter << 13;
+        jitter ^= jitter >> 17;
+        jitter ^= jitter << 5;
+        countdown = OPCODE_SAMPLE_INTERVAL / 2 + (jitter & (OPCODE_SAMPLE_INTERVAL - 1));
+    } else {
+        if (counters) {
+            reading = counters->read();
+        }
+
+        timed = slot;
+        start = ticks();
+        timing = true;
+        countdown = 1;
+    }
+}
+
+bool zm::OpcodeProfile::write(const std::string &path, const OpcodeTable &table) const {
+    std::ofstream file(path);
+
+    if (!file) {
+        return false;
+    }
+
+    bool csv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".csv") == 0;
+    const char *unit = TICKS_UNIT;
+
+    uint64_t interpreted = 0;
+
+    for (uint64_t count : counts) {
+        interpreted += count;
+    }
+
+    if (csv) {
+        file << "opcode,mnemonic,count,samples,mean_cost_" << unit << "\n";
+    } else {
+        file << "{\n"
+             << "  \"interpreted\": " << interpreted << ",\n"
+             << "  \"native\": " << native << ",\n"
+             << "  \"sample_interval\": " << OPCODE_SAMPLE_INTERVAL << ",\n"
+             << "  \"cost_unit\": \"" << unit << "\",\n"
+             << "  \"opcodes\": [";
+    }
+
+    bool first = true;
+
+    for (uint16_t slot = 0; slot < OPCODE_SLOTS; ++slot) {
+        if (counts[slot] == 0) {
+            continue;
+        }
+
+        bool extended = slot >= INSTRUCTION_SET_LENGTH;
+        uint8_t value = static_cast<uint8_t>(slot % INSTRUCTION_SET_LENGTH);
+        const Instruction &instruction = extended ? table.extended_set[value] : table.set[value];
+
+        std::ostringstream opcode;
+        opcode << std::hex << std::setfill('0') << (extended ? "0xbe 0x" : "0x") << std::setw(2) << static_cast<int>(value);
+
+        double cost = samples[slot] ? static_cast<double>(costs[slot]) / static_cast<double>(samples[slot]) : 0.0;
+
+        if (csv) {
+            file << opcode.str() << "," << mnemonic_name(instruction.mnemonic) << "," << counts[slot] << "," << samples[slot] << "," << cost << "\n";
+        } else {
+            file << (first ? "\n" : ",\n")
+                 << "    { \"opcode\": \"" << opcode.str() << "\", \"mnemonic\": \"" << mnemonic_name(instruction.mnemonic)
+                 << "\", \"count\": " << counts[slot] << ", \"samples\": " << samples[slot] << ", \"mean_cost\": " << cost << " }";
+        }
+
+        first = false;
+    }
+
+    if (csv && native > 0) {
+        file << "native,NATIVE," << native << ",0,0\n";
+    } else if (!csv) {
+        file << "\n  ]";
+
+        if (counters) {
+            file << ",\n  \"classes\": [";
+
+            for (int i = 0; i < OPCODE_CLASSES; ++i) {
+                file << (i ? ",\n" : "\n") << "    { \"class\": \"" << class_names[i] << "\", \"samples\": " << class_samples[i];
+
+                for (int event = 0; event < PERF_EVENT_COUNT; ++event) {
+                    file << ", \"" << perf_event_names[event] << "\": ";
+
+                    if (!counters->available(static_cast<PerfEvent>(event))) {
+                        file << "\"unavailable\"";
+                    } else {
+                        file << (class_samples[i] ? static_cast<double>(class_counters[i].values[event]) / static_cast<double>(class_samples[i]) : 0.0);
+                    }
+                }
+
+                file << " }";
+            }
+
+            file << "\n  ]";
+        }
+
+        file << "\n}\n";
+    }
+
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,75 @@
+#ifndef ZETAMACHINE_OPCODE_PROFILE_H
+#define ZETAMACHINE_OPCODE_PROFILE_H
+
+#include <cstdint>
+#include <string>
+
+#include "instructions.h"
+#include "perf_counters.h"
+#include "timer.h"
+
+// FETCH is expanded in every handler, more call sites than GCC inlines into on its own
+#if defined(__GNUC__)
+#define ZM_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ZM_ALWAYS_INLINE inline
+#endif
+
+// One in this many instructions is timed on average, a power of two
+#define OPCODE_SAMPLE_INTERVAL 1024
+
+// Opcode bytes, then the EXT set behind 0xBE
+#define OPCODE_SLOTS (2 * INSTRUCTION_SET_LENGTH)
+
+// 0OP, 1OP, 2OP, VAR and EXT
+#define OPCODE_CLASSES 5
+
+namespace zm {
+    /*
+     * Executions per opcode byte, and the cost of a sample of them: every
+     * OPCODE_SAMPLE_INTERVAL-th instruction or so is timed from its fetch to
+     * the next one. Counting is an increment and a decrement per instruction,
+     * so it can stay on for whole sessions.
+     */
+    class OpcodeProfile {
+    public:
+        ZM_ALWAYS_INLINE void count(const Instruction &instruction) {
+            uint16_t slot = instruction.opcode_type == OpcodeType::EXT ? INSTRUCTION_SET_LENGTH + instruction.value : instruction.value;
+            ++counts[slot];
+
+            if (--countdown == 0) {
+                sample(slot);
+            }
+        }
+
+        // Instructions run by native code, which are not told apart
+        void count_native(uint64_t executed) { native += executed; }
+
+        // Also reads the hardware counters around timed instructions, summed per opcode class
+        void set_counters(const PerfCounters *counters) { this->counters = counters; }
+
+        // JSON, or CSV when the path ends in .csv
+        bool write(const std::string &path, const OpcodeTable &table) const;
+
+    private:
+        uint64_t counts[OPCODE_SLOTS] {};
+        uint64_t costs[OPCODE_SLOTS] {};
+        uint64_t samples[OPCODE_SLOTS] {};
+        uint64_t native = 0;
+
+        uint32_t countdown = OPCODE_SAMPLE_INTERVAL;
+        bool timing = false;
+        uint16_t timed = 0;
+        uint64_t start = 0;
+        uint32_t jitter = 0x9E3779B9;
+
+        const PerfCounters *counters = nullptr;
+        PerfReading reading {};
+        PerfReading class_counters[OPCODE_CLASSES] {};
+        uint64_t class_samples[OPCODE_CLASSES] {};
+
+        void sample(uint16_t slot);
+    };
+}
+
+#endif //ZETAMACHINE_OPCODE_PROFILE_H
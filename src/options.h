@@ -0,0 +1,29 @@
+#ifndef ZETAMACHINE_OPTIONS_H
+#define ZETAMACHINE_OPTIONS_H
+
+#include <cstdint>
+#include <string>
+
+namespace zm {
+    // Runtime switches, mostly for checking and measuring the interpreter
+    struct Options {
+        bool debug = false; // Prints the object table at start
+        bool fusion = true;
+        bool translation = true;
+        bool jit = false;
+        bool checked = false; // Checks every access of the story to memory, for stories that are not trusted
+        std::string aot_plugin; // Made by zetamachine_aot, used if it matches the story
+        uint16_t seed = 0; // Of the random number generator, 0 for an unpredictable one
+        bool pair_profile = false;
+        std::string opcode_profile; // Where to write executions and sampled cost per opcode, as JSON or CSV
+        std::string routine_profile; // Where to write the call graph report, with folded stacks next to it
+        bool routine_time = false; // Also times routines, at every call and return
+        std::string sample_profile; // Where to write the folded stacks sampled on SIGPROF
+        bool perf = false; // Reads hardware counters over the run
+        std::string trace; // Where to write the execution trace, in builds with ZM_TRACE
+        std::string images; // Where story images are shared with other processes, such as /dev/shm
+        std::string save_file; // Where SAVE writes the game and RESTORE reads it, kept in memory when empty
+    };
+}
+
+#endif //ZETAMACHINE_OPTIONS_H
@@ -0,0 +1,139 @@
+#include "perf_counters.h"
+
+#include <iomanip>
+
+#ifdef __linux__
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int open_counter(zm::PerfEvent event) {
+    perf_event_attr attributes {};
+    attributes.size = sizeof(attributes);
+    attributes.disabled = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+
+    switch (event) {
+        case zm::PerfEvent::CYCLES:
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case zm::PerfEvent::INSTRUCTIONS:
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case zm::PerfEvent::BRANCH_MISSES:
+            attributes.type = PERF_TYPE_HARDWARE;
+            attributes.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+        case zm::PerfEvent::L1D_MISSES:
+            attributes.type = PERF_TYPE_HW_CACHE;
+            attributes.config = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+    }
+
+    return static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+}
+
+zm::PerfCounters::PerfCounters() {
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        descriptors[i] = open_counter(static_cast<PerfEvent>(i));
+    }
+}
+
+zm::PerfCounters::~PerfCounters() {
+    for (int descriptor : descriptors) {
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+    }
+}
+
+void zm::PerfCounters::start() {
+    for (int descriptor : descriptors) {
+        if (descriptor >= 0) {
+            ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+            ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+}
+
+void zm::PerfCounters::stop() {
+    for (int descriptor : descriptors) {
+        if (descriptor >= 0) {
+            ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+}
+
+zm::PerfReading zm::PerfCounters::read() const {
+    PerfReading reading {};
+
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        uint64_t value = 0;
+
+        if (descriptors[i] >= 0 && ::read(descriptors[i], &value, sizeof(value)) == sizeof(value)) {
+            reading.values[i] = value;
+        }
+    }
+
+    return reading;
+}
+#else
+zm::PerfCounters::PerfCounters() {
+    for (int &descriptor : descriptors) {
+        descriptor = -1;
+    }
+}
+
+zm::PerfCounters::~PerfCounters() = default;
+
+void zm::PerfCounters::start() { }
+
+void zm::PerfCounters::stop() { }
+
+zm::PerfReading zm::PerfCounters::read() const {
+    return PerfReading {};
+}
+#endif
+
+bool zm::PerfCounters::any_available() const {
+    for (int descriptor : descriptors) {
+        if (descriptor >= 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void zm::PerfCounters::print(std::ostream &out, const zm::PerfReading &reading, uint64_t units) const {
+    for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+        out << "\t" << std::left << std::setw(16) << perf_event_names[i] << std::right;
+
+        if (!available(static_cast<PerfEvent>(i))) {
+            out << std::setw(16) << "unavailable" << "\n";
+            continue;
+        }
+
+        out << std::setw(16) << reading.values[i];
+
+        if (units) {
+            out << std::fixed << std::setprecision(3) << std::setw(12) << static_cast<double>(reading.values[i]) / static_cast<double>(units) << " per Z instruction";
+        }
+
+        out << "\n";
+    }
+
+    auto cycles = reading.values[static_cast<int>(PerfEvent::CYCLES)];
+    auto instructions = reading.values[static_cast<int>(PerfEvent::INSTRUCTIONS)];
+
+    if (available(PerfEvent::CYCLES) && available(PerfEvent::INSTRUCTIONS) && cycles) {
+        out << "\t" << std::left << std::setw(16) << "IPC" << std::right << std::fixed << std::setprecision(3)
+            << std::setw(16) << static_cast<double>(instructions) / static_cast<double>(cycles) << "\n";
+    }
+}
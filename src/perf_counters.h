@@ -0,0 +1,79 @@
+#ifndef ZETAMACHINE_PERF_COUNTERS_H
+#define ZETAMACHINE_PERF_COUNTERS_H
+
+#include <cstdint>
+#include <ostream>
+
+#define ZM_PERF_EVENTS(X) \
+    X(CYCLES, "cycles") X(INSTRUCTIONS, "instructions") X(BRANCH_MISSES, "branch-misses") X(L1D_MISSES, "L1d-misses")
+
+namespace zm {
+    enum class PerfEvent {
+#define ZM_PERF_EVENT_ENUM(name, label) name,
+        ZM_PERF_EVENTS(ZM_PERF_EVENT_ENUM)
+#undef ZM_PERF_EVENT_ENUM
+    };
+
+    constexpr const char *perf_event_names[] = {
+#define ZM_PERF_EVENT_NAME(name, label) label,
+        ZM_PERF_EVENTS(ZM_PERF_EVENT_NAME)
+#undef ZM_PERF_EVENT_NAME
+    };
+
+    constexpr int PERF_EVENT_COUNT = sizeof(perf_event_names) / sizeof(perf_event_names[0]);
+
+    struct PerfReading {
+        uint64_t values[PERF_EVENT_COUNT];
+    };
+
+    /*
+     * Hardware counters of this thread in user space, over Linux
+     * perf_event_open. Each counter is opened on its own, so the ones the
+     * kernel, the VM or the paranoid setting refuse are just unavailable.
+     */
+    class PerfCounters {
+    public:
+        PerfCounters();
+        ~PerfCounters();
+
+        PerfCounters(const PerfCounters &) = delete;
+        PerfCounters &operator=(const PerfCounters &) = delete;
+
+        bool available(PerfEvent event) const { return descriptors[static_cast<int>(event)] >= 0; }
+        bool any_available() const;
+
+        void start();
+        void stop();
+
+        // Counts since start, 0 for unavailable counters
+        PerfReading read() const;
+
+        // One line per counter, rates per unit when units (e.g. Z instructions) is not 0
+        void print(std::ostream &out, const PerfReading &reading, uint64_t units) const;
+
+    private:
+        int descriptors[PERF_EVENT_COUNT];
+    };
+
+    inline PerfReading operator-(const PerfReading &a, const PerfReading &b) {
+        PerfReading difference {};
+
+        for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+            difference.values[i] = a.values[i] - b.values[i];
+        }
+
+        return difference;
+    }
+
+    inline PerfReading operator+(const PerfReading &a, const PerfReading &b) {
+        PerfReading sum {};
+
+        for (int i = 0; i < PERF_EVENT_COUNT; ++i) {
+            sum.values[i] = a.values[i] + b.values[i];
+        }
+
+        return sum;
+    }
+}
+
+#endif //ZETAMACHINE_PERF_COUNTERS_H
@@ -1,6 +1,1729 @@
+#include "spdlog/spdlog.h"
+
 #include "processor.h"
 #include "instructions.h"
+#include "input.h"
+#include "quetzal.h"
+#include "video.h"
+
+#include "memory/header.h"
+#include "memory/memory.h"
+#include "memory/story_image.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+// Reads may go as far as the story or dynamic memory, whichever ends later
+static zm::address story_end(zm::Memory &memory) {
+    uint32_t story_length = memory.get_image() ? memory.get_image()->length() : memory.capacity();
+    return std::min(memory.capacity(), std::max(story_length, static_cast<uint32_t>(zm::Header(memory).static_memory_base_address())));
+}
+
+template<uint8_t Version, typename Access>
+zm::Processor<Version, Access>::Processor(zm::Memory &memory, zm::Video &video, zm::Input &input) :
+    memory(memory),
+    video(video),
+    input(input),
+    instruction_cache(memory, Header(memory).static_memory_base_address(), story_end(memory)),
+    routines(memory, Header(memory).static_memory_base_address(), memory.read_word(0x28)),
+    translator(memory, Header(memory).static_memory_base_address()),
+    jit(memory.read_word(0x0C)),
+    objects(memory),
+    dictionary(memory),
+    text(memory, story_end(memory)) {
+    global_variables_address = memory.read_word(0x0C);
+    routines_offset = memory.read_word(0x28);
+    static_strings_offset = memory.read_word(0x2A);
+
+    // Checked once when the story was loaded, stories loaded otherwise are taken as they are
+    verified = memory.get_image() == nullptr || memory.get_image()->verified();
+
+    writable_end = Header(memory).static_memory_base_address();
+    readable_end = story_end(memory);
+
+    // Saved games are compared with dynamic memory as it is now, in the image when it has all of it
+    uint32_t dynamic_length = std::min(writable_end, memory.capacity());
+
+    if (memory.get_image() && memory.get_image()->length() >= dynamic_length) {
+        original = memory.get_image()->bytes();
+    } else {
+        original_copy.assign(memory.cast<uint8_t>(0), memory.cast<uint8_t>(0) + dynamic_length);
+        original = original_copy.data();
+    }
+
+    initialize_header();
+
+    // Global variables are not checked one by one
+    if (Access::checked && global_variables_address + (240 << 1) > writable_end) {
+        spdlog::error("The global variables at {:x} are not all in dynamic memory, which ends at {:x}", global_variables_address, writable_end);
+        quit = error = true;
+    }
+
+    // The first instruction runs on a frame of its own, which is never returned from
+    pc = memory.read_word(0x06);
+    call_stack.push(pc, 0);
+
+    if (Version == 6) {
+        // Version 6 starts by calling the (packed) main routine instead, which gets its locals like any other
+        call(memory.read_word(0x06), nullptr, 0, false);
+    }
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::initialize_header() {
+    // We are a "DECSystem-20" interpreter, version 'Z', with a screen that never scrolls off
+    memory.write(0x1E, 0x01);
+    memory.write(0x1F, 'Z');
+
+    if (Version >= 4) {
+        memory.write(0x20, 0xFF);
+        memory.write(0x21, 80);
+    }
+
+    if (Version >= 5) {
+        memory.write_word(0x22, 80);
+        memory.write_word(0x24, 0xFF);
+        memory.write(0x26, 1);
+        memory.write(0x27, 1);
+    }
+
+    // Standard 1.1
+    memory.write(0x32, 0x01);
+    memory.write(0x33, 0x01);
+}
+
+// ------ Variables ------
+
+template<uint8_t Version, typename Access>
+zm::word zm::Processor<Version, Access>::read_variable(uint8_t variable) {
+    if (variable == 0x00) { // Top of stack
+        return stacked("Pop") ? call_stack.pop_value() : 0;
+    } else if (variable <= 0x0F) {
+        return call_stack.variables()[variable - 1];
+    } else {
+        return memory.read_word(global_variables_address + ((variable - 0x10) << 1));
+    }
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::write_variable(uint8_t variable, zm::word value) {
+    if (variable == 0x00) {
+        call_stack.push_value(value);
+    } else if (variable <= 0x0F) {
+        // Set local variable
+        call_stack.variables()[variable - 1] = value;
+    } else {
+        // Set global variable
+        memory.write_word(global_variables_address + ((variable - 0x10) << 1), value);
+    }
+}
+
+/*
+ * Instructions that take a variable by reference (inc, dec, load, store, pull...)
+ * read and write the top of the stack in place instead of pushing or popping.
+ */
+template<uint8_t Version, typename Access>
+zm::word zm::Processor<Version, Access>::read_indirect(uint8_t variable) {
+    if (variable == 0x00) {
+        return stacked("Read of the top of the stack") ? call_stack.top_value() : 0;
+    }
+
+    return read_variable(variable);
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::write_indirect(uint8_t variable, zm::word value) {
+    if (variable == 0x00) {
+        if (stacked("Write to the top of the stack")) {
+            call_stack.top_value() = value;
+        }
+        return;
+    }
+
+    write_variable(variable, value);
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::store(zm::word value) {
+    ZM_TRACE_STORE(value);
+    write_variable(current->store_variable, value);
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::branch(bool condition) {
+    ZM_TRACE_BRANCH(condition == current->branch_on_true);
+
+    if (condition != current->branch_on_true) {
+        return;
+    }
+
+    // Offsets 0 and 1 mean "return false" and "return true" from the current routine
+    switch (current->branch_offset) {
+        case 0 : ret(0); break;
+        case 1 : ret(1); break;
+        default : pc = current->next_pc + current->branch_offset - 2;
+    }
+}
+
+// ------ Jumps ------
+
+template<uint8_t Version, typename Access>
+bool zm::Processor<Version, Access>::je(const zm::word *values, uint8_t count) {
+    for (uint8_t i = 1; i < count; ++i) {
+        if (values[0] == values[i]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+template<uint8_t Version, typename Access>
+bool zm::Processor<Version, Access>::jin(zm::word a, zm::word b) {
+    if (!valid_object(a, "jin")) {
+        return b == 0;
+    }
+
+    return objects.get_parent(a) == b;
+}
+
+// ------ Routines ------
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::call(zm::word routine, const zm::word *args, uint8_t arg_count, bool store_result) {
+    // Calling address 0 does nothing and returns false
+    if (routine == 0) {
+        if (store_result) {
+            store(0);
+        }
+        return;
+    }
+
+    if (!readable(Traits::unpack_routine(routine, routines_offset), 1, "call")) {
+        return;
+    }
+
+    RoutineDescriptor &descriptor = routines.fetch(routine);
+
+    // Remember where to come back to, then push a new stack frame with the address to jump to
+    call_stack.get_frame().program_counter = pc;
+
+    StackFrame &frame = call_stack.push(descriptor.header, descriptor.locals);
+    frame.argument_count = arg_count;
+    frame.store_on_return = store_result;
+    frame.store_to = store_result ? current->store_variable : 0;
+
+    // Locals start from their defaults, then the arguments
+    word *variables = call_stack.variables();
+    std::copy(descriptor.defaults, descriptor.defaults + descriptor.locals, variables);
+    std::copy(args, args + std::min(arg_count, descriptor.locals), variables);
+
+    pc = descriptor.entry;
+
+    if (translation) {
+        // A retired translation is looked up again, the routine may translate differently now
+        if (!descriptor.translated || (descriptor.translation && !descriptor.translation->valid)) {
+            descriptor.translation = translator.translate(routine, descriptor.header);
+            descriptor.translated = true;
+        }
+
+        TranslatedRoutine *translated = descriptor.translation;
+
+        // Translations are not checked as they run, so checked access keeps routines that run past the story interpreted
+        if (Access::checked && translated && translated->end > readable_end) {
+            translated = nullptr;
+        }
+
+        if (translated && ++translated->calls == 1 && plugin.loaded()) {
+            translated->compiled = plugin.find(routine, translated->code.size());
+        }
+
+        if (translated && jit_enabled && !translated->native && !translated->compiled && translated->calls == JIT_CALL_THRESHOLD) {
+            jit.compile(*translated);
+        }
+
+        frame.routine = translated;
+    }
+
+    // The evaluation stack of the frame holds its temporaries
+    if (frame.routine) {
+        call_stack.set_depth(frame.routine->max_depth);
+        switch_engine = true;
+    }
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::ret(zm::word value) {
+    // In version 6 the main routine has a frame of its own, above the first one
+    if (call_stack.size() <= (Version == 6 ? 2u : 1u)) {
+        spdlog::error("Return from the main routine at {:x}", pc);
+        quit = error = true;
+        return;
+    }
+
+    StackFrame frame = call_stack.get_frame();
+    call_stack.pop();
+
+    StackFrame &caller = call_stack.get_frame();
+    pc = caller.program_counter;
+
+    // The caller's next instruction was ret_popped of this very value
+    if (frame.tail_return) {
+        if (profiling) {
+            opcode_profile.count(InstructionTable<Version>::table.set[0xB8]);
+            routine_profile.step();
+        }
+
+        ret(value);
+        return;
+    }
+
+    // Translated callers resume right after their call, which knows where the result goes
+    if (caller.routine) {
+        if (frame.store_on_return) {
+            word *variables = call_stack.variables();
+            write_register(caller.routine->code[caller.ir_index - 1].store, variables, variables + caller.arity, value);
+        }
+
+        if (!caller.routine->valid) {
+            deoptimize();
+        }
+
+        switch_engine = true;
+        return;
+    }
+
+    if (frame.store_on_return) {
+        write_variable(frame.store_to, value);
+    }
+}
+
+/*
+ * Turns the top frame, running a retired translation, back into an
+ * interpreted one. The temporaries live where it stands already are its stack.
+ */
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::deoptimize() {
+    StackFrame &frame = call_stack.get_frame();
+    const IrInstruction &resume = frame.routine->code[frame.ir_index];
+
+    call_stack.set_depth(resume.depth);
+    frame.program_counter = resume.pc;
+    frame.routine = nullptr;
+    pc = resume.pc;
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::throw_to(zm::word value, zm::word frame) {
+    // Unwind to the frame CATCH returned, then return from it
+    call_stack.unwind(frame > 1 ? frame : 1);
+
+    ret(value);
+}
+
+// ------ Storage ------
+
+template<uint8_t Version, typename Access>
+zm::word zm::Processor<Version, Access>::loadb(zm::word array, zm::word index) {
+    auto address = static_cast<word>(array + index);
+    return readable(address, 1, "loadb") ? memory.read_byte(address) : 0;
+}
+
+template<uint8_t Version, typename Access>
+zm::word zm::Processor<Version, Access>::loadw(zm::word array, zm::word index) {
+    auto address = static_cast<word>(array + (index << 1));
+    return readable(address, 2, "loadw") ? memory.read_word(address) : 0;
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::storeb(zm::word array, zm::word index, zm::word value) {
+    auto address = static_cast<word>(array + index);
+
+    if (writable(address, 1, "storeb")) {
+        memory.write(address, static_cast<uint8_t>(value));
+    }
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::storew(zm::word array, zm::word index, zm::word value) {
+    auto address = static_cast<word>(array + (index << 1));
+
+    if (writable(address, 2, "storew")) {
+        memory.write_word(address, value);
+    }
+}
+
+template<uint8_t Version, typename Access>
+bool zm::Processor<Version, Access>::readable(zm::address start, uint32_t length, const char *operation) {
+    if (!Access::checked || start + length <= readable_end) {
+        return true;
+    }
+
+    spdlog::error("{} at {:x} reads {:x}, past the end of the story at {:x}", operation, pc, start, readable_end);
+    quit = error = true;
+    return false;
+}
+
+template<uint8_t Version, typename Access>
+bool zm::Processor<Version, Access>::stacked(const char *operation) {
+    if (!Access::checked || !call_stack.stack_empty()) {
+        return true;
+    }
+
+    spdlog::error("{} at {:x} takes a value from an empty stack", operation, pc);
+    quit = error = true;
+    return false;
+}
+
+template<uint8_t Version, typename Access>
+bool zm::Processor<Version, Access>::writable(zm::address start, uint32_t length, const char *operation) {
+    if (!Access::checked || start + length <= writable_end) {
+        return true;
+    }
+
+    spdlog::error("{} at {:x} writes {:x}, past dynamic memory which ends at {:x}", operation, pc, start, writable_end);
+    quit = error = true;
+    return false;
+}
+
+// ------ Arithmetic ------
+
+template<uint8_t Version, typename Access>
+int16_t zm::Processor<Version, Access>::div(int16_t a, int16_t b) {
+    if (b == 0) {
+        spdlog::error("Division by zero at {:x}", pc);
+        quit = error = true;
+        return 0;
+    }
+
+    return static_cast<int16_t>(a / b);
+}
+
+template<uint8_t Version, typename Access>
+int16_t zm::Processor<Version, Access>::mod(int16_t a, int16_t b) {
+    if (b == 0) {
+        spdlog::error("Division by zero at {:x}", pc);
+        quit = error = true;
+        return 0;
+    }
+
+    return static_cast<int16_t>(a % b);
+}
+
+template<uint8_t Version, typename Access>
+int16_t zm::Processor<Version, Access>::inc(uint8_t variable) {
+    auto value = static_cast<int16_t>(read_indirect(variable) + 1);
+    write_indirect(variable, value);
+    return value;
+}
+
+template<uint8_t Version, typename Access>
+int16_t zm::Processor<Version, Access>::dec(uint8_t variable) {
+    auto value = static_cast<int16_t>(read_indirect(variable) - 1);
+    write_indirect(variable, value);
+    return value;
+}
+
+template<uint8_t Version, typename Access>
+zm::word zm::Processor<Version, Access>::log_shift(zm::word number, int16_t places) {
+    if (places >= 16 || places <= -16) {
+        return 0;
+    }
+
+    return places >= 0 ? static_cast<word>(number << places) : static_cast<word>(number >> -places);
+}
+
+template<uint8_t Version, typename Access>
+zm::word zm::Processor<Version, Access>::art_shift(zm::word number, int16_t places) {
+    auto value = static_cast<int16_t>(number);
+
+    if (places >= 16) {
+        return 0;
+    } else if (places <= -16) {
+        return value < 0 ? 0xFFFF : 0;
+    }
+
+    return places >= 0 ? static_cast<word>(value << places) : static_cast<word>(value >> -places);
+}
+
+// ------ Objects ------
+
+template<uint8_t Version, typename Access>
+bool zm::Processor<Version, Access>::valid_object(zm::word object, const char *operation) {
+    if (object == 0) {
+        spdlog::warn("{} on object 0 at {:x}", operation, pc);
+        return false;
+    }
+
+    // The object operations write to the entry, so all of it has to be in dynamic memory
+    if (Access::checked && objects.get_object_address(object) + Traits::object_entry_size > writable_end) {
+        spdlog::error("{} on object {} at {:x}, past the end of the object table", operation, object, pc);
+        quit = error = true;
+        return false;
+    }
 
-bool zm::Processor::tick() {
     return true;
-}
\ No newline at end of file
+}
+
+template<uint8_t Version, typename Access>
+bool zm::Processor<Version, Access>::valid_attribute(zm::word attribute, const char *operation) {
+    if (Access::checked && attribute >= Traits::attribute_count) {
+        spdlog::error("{} on attribute {} at {:x}, there are only {}", operation, attribute, pc, static_cast<int>(Traits::attribute_count));
+        quit = error = true;
+        return false;
+    }
+
+    return true;
+}
+
+// ------ Printing ------
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::output(const std::string &text) {
+    if (memory_streams.empty()) {
+        video.print(text);
+        return;
+    }
+
+    // Stream 3 takes all the output while it is selected
+    auto &stream = memory_streams.back();
+
+    for (char character : text) {
+        address at = stream.first + 2 + stream.second++;
+
+        if (!writable(at, 1, "Output stream 3")) {
+            return;
+        }
+
+        memory.write(at, static_cast<uint8_t>(character == '\n' ? 13 : character));
+    }
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::print_zscii(zm::word character) {
+    if (character == 13) {
+        output("\n");
+    } else if (character >= 32 && character <= 126) {
+        output(std::string(1, static_cast<char>(character)));
+    } else if (character != 0) {
+        output("?");
+    }
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::print_string(zm::address string, const char *operation) {
+    std::string printed;
+
+    if (!text.map(string, printed) && Access::checked) {
+        spdlog::error("{} at {:x} prints {:x}, which runs past the end of the story at {:x} or nests abbreviations too deep", operation, pc, string, readable_end);
+        quit = error = true;
+        return;
+    }
+
+    output(printed);
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::print_addr(zm::address byte_address) {
+    print_string(byte_address, "print_addr");
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::print_paddr(zm::word packed_address) {
+    print_string(Traits::unpack_string(packed_address, static_strings_offset), "print_paddr");
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::print_obj(zm::word object) {
+    if (!valid_object(object, "print_obj")) {
+        return;
+    }
+
+    print_string(objects.get_name_address(object), "print_obj");
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::print_num(int16_t number) {
+    output(std::to_string(number));
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::print_table(zm::word zscii_text, zm::word width, zm::word height, zm::word skip) {
+    address character = zscii_text;
+
+    if (height > 0 && !readable(zscii_text, (height - 1) * (width + skip) + width, "print_table")) {
+        return;
+    }
+
+    for (word row = 0; row < height; ++row) {
+        if (row > 0) {
+            output("\n");
+        }
+
+        for (word column = 0; column < width; ++column) {
+            print_zscii(memory.read_byte(character++));
+        }
+
+        character += skip;
+    }
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::print_unicode(zm::word char_number) {
+    std::string encoded;
+
+    // UTF-8
+    if (char_number < 0x80) {
+        encoded.push_back(static_cast<char>(char_number));
+    } else if (char_number < 0x800) {
+        encoded.push_back(static_cast<char>(0xC0 | (char_number >> 6)));
+        encoded.push_back(static_cast<char>(0x80 | (char_number & 0x3F)));
+    } else {
+        encoded.push_back(static_cast<char>(0xE0 | (char_number >> 12)));
+        encoded.push_back(static_cast<char>(0x80 | ((char_number >> 6) & 0x3F)));
+        encoded.push_back(static_cast<char>(0x80 | (char_number & 0x3F)));
+    }
+
+    output(encoded);
+}
+
+// ------ Input ------
+
+template<uint8_t Version, typename Access>
+bool zm::Processor<Version, Access>::read(zm::word text_buffer, zm::word parse_buffer) {
+    std::string line;
+
+    if (!input.read_line(line)) {
+        quit = true;
+        return false;
+    }
+
+    if (!writable(text_buffer, 2, "read") || (parse_buffer != 0 && !writable(parse_buffer, 2, "read"))) {
+        return false;
+    }
+
+    uint8_t max_length = memory.read_byte(text_buffer);
+
+    // Up to version 4 the buffer also holds the terminating zero
+    if (Version <= 4) {
+        --max_length;
+    }
+
+    if (line.size() > max_length) {
+        line.resize(max_length);
+    }
+
+    address start = text_buffer + Traits::text_buffer_start;
+
+    // Parsing fills in as many words as the parse buffer says it has room for
+    if (!writable(start, static_cast<uint32_t>(line.size()) + 1, "read") ||
+        (parse_buffer != 0 && !writable(parse_buffer, 2 + (memory.read_byte(parse_buffer) << 2), "read"))) {
+        return false;
+    }
+
+    for (size_t i = 0; i < line.size(); ++i) {
+        auto character = static_cast<char>(std::tolower(static_cast<unsigned char>(line[i])));
+        memory.write(start + i, static_cast<uint8_t>(character));
+    }
+
+    if (Version <= 4) {
+        memory.write(start + line.size(), 0);
+    } else {
+        memory.write(text_buffer + 1, static_cast<uint8_t>(line.size()));
+    }
+
+    if (parse_buffer != 0) {
+        dictionary.tokenise(text_buffer, parse_buffer, false);
+    }
+
+    return true;
+}
+
+template<uint8_t Version, typename Access>
+bool zm::Processor<Version, Access>::read_char() {
+    uint8_t character;
+
+    if (!input.read_char(character)) {
+        quit = true;
+        return false;
+    }
+
+    store(character);
+    return true;
+}
+
+// ------ Tables ------
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::scan_table(zm::word x, zm::word table, zm::word length, zm::word form) {
+    bool words = (form & 0x80) != 0;
+    uint8_t field_length = form & 0x7F;
+
+    if (!readable(table, length * field_length, "scan_table")) {
+        return;
+    }
+
+    for (word i = 0; i < length; ++i) {
+        address entry = table + i * field_length;
+        word value = words ? memory.read_word(entry) : memory.read_byte(entry);
+
+        if (value == x) {
+            store(static_cast<word>(entry));
+            branch(true);
+            return;
+        }
+    }
+
+    store(0);
+    branch(false);
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::copy_table(zm::word first, zm::word second, zm::word size) {
+    auto length = static_cast<int16_t>(size);
+    auto count = static_cast<uint32_t>(second == 0 ? std::max<int16_t>(length, 0) : std::abs(length));
+
+    if (!readable(first, count, "copy_table") || !writable(second == 0 ? first : second, count, "copy_table")) {
+        return;
+    }
+
+    if (second == 0) {
+        for (int16_t i = 0; i < length; ++i) {
+            memory.write(first + i, 0);
+        }
+    } else if (length < 0 || first > second) {
+        // A negative size forces a forward copy, even if the tables overlap
+        for (int16_t i = 0; i < std::abs(length); ++i) {
+            memory.write(second + i, memory.read_byte(first + i));
+        }
+    } else {
+        for (int16_t i = length - 1; i >= 0; --i) {
+            memory.write(second + i, memory.read_byte(first + i));
+        }
+    }
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::encode_text(zm::word zscii_text, zm::word length, zm::word from, zm::word coded_text) {
+    std::string word_text;
+
+    if (!readable(zscii_text + from, length, "encode_text")) {
+        return;
+    }
+
+    for (word i = 0; i < length; ++i) {
+        word_text.push_back(static_cast<char>(memory.read_byte(zscii_text + from + i)));
+    }
+
+    auto encoded = text.encode(word_text, Traits::dictionary_word_zchars);
+
+    if (!writable(coded_text, static_cast<uint32_t>(encoded.size()) << 1, "encode_text")) {
+        return;
+    }
+
+    for (size_t i = 0; i < encoded.size(); ++i) {
+        memory.write_word(coded_text + (i << 1), encoded[i]);
+    }
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::output_stream(int16_t number, zm::word table) {
+    if (number == 3) {
+        if (writable(table, 2, "output_stream")) {
+            memory_streams.emplace_back(table, 0);
+        }
+    } else if (number == -3 && !memory_streams.empty()) {
+        auto &stream = memory_streams.back();
+        memory.write_word(stream.first, stream.second);
+        memory_streams.pop_back();
+    }
+}
+
+template<uint8_t Version, typename Access>
+zm::word zm::Processor<Version, Access>::random(int16_t range) {
+    if (range > 0) {
+        return rng.random(static_cast<uint16_t>(range));
+    }
+
+    rng.seed(static_cast<uint16_t>(-range));
+    return 0;
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::unsupported() {
+    spdlog::warn("Unsupported instruction {} at {:x}", mnemonic_name(current->instruction.mnemonic), pc);
+}
+
+// ------ Saving ------
+
+/*
+ * Quetzal: the header of the story (IFhd), dynamic memory as it differs from
+ * the original (CMem) and every frame (Stks), with where the routine of each
+ * frame begins, which Quetzal leaves out (IntD).
+ */
+template<uint8_t Version, typename Access>
+bool zm::Processor<Version, Access>::save_game(zm::address resume) {
+    const HeaderFields &header = memory.view<HeaderFields>(0);
+    QuetzalWriter quetzal;
+
+    quetzal.begin("IFhd");
+    quetzal.word(header.release);
+    quetzal.bytes(header.serial, sizeof(header.serial));
+    quetzal.word(header.checksum);
+    quetzal.address(resume);
+    quetzal.end();
+
+    quetzal.begin("CMem");
+    quetzal.compressed_memory(memory.cast<uint8_t>(0), original, std::min(writable_end, memory.capacity()));
+    quetzal.end();
+
+    // Where the result of a frame goes: translated callers only know it from their call, which decodes to the same
+    auto result_of = [this](size_t index) -> uint8_t {
+        const StackFrame &caller = call_stack.get_frame(index - 1);
+
+        if (caller.routine) {
+            return instruction_cache.fetch(caller.routine->code[caller.ir_index - 1].pc).store_variable;
+        }
+
+        return call_stack.get_frame(index).store_to;
+    };
+
+    quetzal.begin("Stks");
+
+    for (size_t i = 0; i < call_stack.size(); ++i) {
+        const StackFrame &frame = call_stack.get_frame(i);
+        uint32_t depth = call_stack.depth(i);
+
+        // Translated frames wait after a call: their stack is the temporaries live there, but for the result to come
+        if (frame.routine && i + 1 < call_stack.size()) {
+            depth = frame.routine->code[frame.ir_index].depth;
+
+            if (call_stack.get_frame(i + 1).store_on_return && result_of(i + 1) == 0) {
+                --depth;
+            }
+        }
+
+        // The first frame is never called, so only its stack is saved
+        quetzal.address(i > 0 ? call_stack.get_frame(i - 1).program_counter : 0);
+        quetzal.byte(i > 0 ? static_cast<uint8_t>(frame.arity | (frame.store_on_return ? 0x00 : 0x10)) : 0);
+        quetzal.byte(i > 0 ? result_of(i) : 0);
+        quetzal.byte(i > 0 ? static_cast<uint8_t>((1 << frame.argument_count) - 1) : 0);
+        quetzal.word(static_cast<word>(depth));
+
+        for (uint8_t local = 0; local < frame.arity; ++local) {
+            quetzal.word(call_stack.locals(i)[local]);
+        }
+
+        for (uint32_t value = 0; value < depth; ++value) {
+            quetzal.word(call_stack.stack(i)[value]);
+        }
+    }
+
+    quetzal.end();
+
+    quetzal.begin("IntD");
+    quetzal.bytes("UNIX", 4);
+    quetzal.byte(0x00);
+    quetzal.byte(0x00);
+    quetzal.word(0x0000);
+    quetzal.bytes("ZETA", 4);
+
+    for (size_t i = 0; i < call_stack.size(); ++i) {
+        quetzal.address(call_stack.get_frame(i).start);
+    }
+
+    quetzal.end();
+
+    if (save_file.empty()) {
+        saved_game = quetzal.finish();
+        return true;
+    }
+
+    std::vector<uint8_t> save = quetzal.finish();
+    std::ofstream file(save_file, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(save.data()), static_cast<std::streamsize>(save.size()));
+
+    if (!file) {
+        spdlog::error("Could not save the game to {}", save_file);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Everything is checked before anything is restored, so a game that cannot
+ * be restored leaves the story as it was. Restored frames are interpreted,
+ * their routines run translated again from their next call.
+ */
+template<uint8_t Version, typename Access>
+bool zm::Processor<Version, Access>::restore_game() {
+    std::vector<uint8_t> read;
+
+    if (!save_file.empty()) {
+        std::ifstream file(save_file, std::ios::binary);
+
+        if (!file) {
+            spdlog::error("Could not read a saved game from {}", save_file);
+            return false;
+        }
+
+        read.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+
+    const std::vector<uint8_t> &save = save_file.empty() ? saved_game : read;
+    const HeaderFields &header = memory.view<HeaderFields>(0);
+    QuetzalReader quetzal(save);
+
+    if (save.empty()) {
+        spdlog::warn("No game was saved");
+        return false;
+    }
+
+    const uint8_t *story;
+    uint32_t story_length;
+
+    if (!quetzal.valid() || !quetzal.find("IFhd", story, story_length) || story_length < 13) {
+        spdlog::error("Not a saved game");
+        return false;
+    }
+
+    if (load_be16(story) != header.release || std::memcmp(story + 2, header.serial, sizeof(header.serial)) != 0 ||
+        load_be16(story + 8) != header.checksum) {
+        spdlog::error("The saved game is of another story");
+        return false;
+    }
+
+    address resume = load_address(story + 10);
+    const uint8_t *frames;
+    uint32_t frames_length;
+    size_t frame_count = 0;
+    uint32_t position = 0;
+
+    if (quetzal.find("Stks", frames, frames_length)) {
+        for (; position < frames_length && frames_length - position >= 8; ++frame_count) {
+            position += 8 + (((frames[position + 3] & 0x0F) + load_be16(frames + position + 6)) << 1);
+        }
+    }
+
+    if (frame_count == 0 || position != frames_length || resume == 0 || resume + 2 >= readable_end) {
+        spdlog::error("The saved game has no frames the story can resume in");
+        return false;
+    }
+
+    const uint8_t *contents;
+    uint32_t contents_length;
+    uint32_t dynamic_length = std::min(writable_end, memory.capacity());
+    word flags = memory.read_word(0x10);
+
+    if (quetzal.find("CMem", contents, contents_length)) {
+        if (!decompress_memory(contents, contents_length, original, memory.rewrite(0, dynamic_length), dynamic_length)) {
+            spdlog::error("The memory of the saved game does not fit in dynamic memory");
+            return false;
+        }
+    } else if (quetzal.find("UMem", contents, contents_length) && contents_length == dynamic_length) {
+        std::memcpy(memory.rewrite(0, dynamic_length), contents, dynamic_length);
+    } else {
+        spdlog::error("The saved game has no memory for the story");
+        return false;
+    }
+
+    // Transcripting and fixed pitch stay as they were, and so does the interpreter
+    memory.write_word(0x10, static_cast<word>((memory.read_word(0x10) & ~0x0003) | (flags & 0x0003)));
+    initialize_header();
+
+    const uint8_t *starts;
+    uint32_t starts_length;
+
+    if (!quetzal.find("IntD", starts, starts_length) || starts_length != 12 + 3 * frame_count || std::memcmp(starts + 8, "ZETA", 4) != 0) {
+        starts = nullptr;
+    }
+
+    call_stack.unwind(0);
+
+    for (size_t i = 0, record = 0; i < frame_count; ++i) {
+        uint8_t locals = frames[record + 3] & 0x0F;
+        word depth = load_be16(frames + record + 6);
+
+        if (i > 0) {
+            call_stack.get_frame().program_counter = load_address(frames + record);
+        }
+
+        StackFrame &frame = call_stack.push(starts ? load_address(starts + 12 + 3 * i) : 0, locals);
+        frame.store_on_return = (frames[record + 3] & 0x10) == 0;
+        frame.store_to = frames[record + 4];
+
+        while (frame.argument_count < 7 && (frames[record + 5] >> frame.argument_count & 1)) {
+            ++frame.argument_count;
+        }
+
+        const uint8_t *values = frames + record + 8;
+
+        for (uint8_t local = 0; local < locals; ++local, values += 2) {
+            call_stack.variables()[local] = load_be16(values);
+        }
+
+        for (word value = 0; value < depth; ++value, values += 2) {
+            call_stack.push_value(load_be16(values));
+        }
+
+        record = static_cast<size_t>(values - frames);
+    }
+
+    if (Version <= 3) {
+        // The save branches as if it had succeeded: its branch follows its opcode
+        current = &instruction_cache.fetch(resume - 1);
+        pc = current->next_pc;
+        branch(true);
+    } else {
+        // ...or stores 2 where it stores its result
+        pc = resume + 1;
+        write_variable(memory.read_byte(resume), 2);
+    }
+
+    return true;
+}
+
+// ------ Dispatch ------
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::instrument() {
+    if (profile_pairs) {
+        pair_profile.record(current->instruction.mnemonic);
+    }
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::configure(const zm::Options &options) {
+    profile_pairs = options.pair_profile;
+    save_file = options.save_file;
+    profiling = !options.opcode_profile.empty() || !options.routine_profile.empty();
+
+    if (options.seed != 0) {
+        rng.seed(options.seed);
+    }
+
+    if (!options.routine_profile.empty()) {
+        routine_profile.set_timed(options.routine_time);
+        call_stack.set_profile(&routine_profile);
+    }
+    instrumented = profile_pairs;
+
+    // Tracing and pair counting want to see every instruction go through a FETCH
+    instruction_cache.set_fusion(options.fusion && !options.pair_profile && !tracing);
+    translation = options.translation && !instrumented;
+    // Native code reaches memory directly, so checked access keeps to the engines that check
+    jit_enabled = options.jit && translation && Jit::available() && !tracing && !Access::checked;
+
+    if (options.jit && !Jit::available()) {
+        spdlog::warn("No native code generator in this build, running translated routines on the IR executor");
+    }
+
+    if (Access::checked && (options.jit || !options.aot_plugin.empty())) {
+        spdlog::warn("Checked memory access runs without native code");
+    }
+
+    if (!options.aot_plugin.empty() && translation && !tracing && !Access::checked) {
+        plugin.load(options.aot_plugin, memory);
+    }
+
+    if (!options.sample_profile.empty() && !sample_profile.start(&pc, &call_stack)) {
+        spdlog::warn("Could not start the sampling profiler");
+    }
+
+    if (!options.trace.empty() && !tracing) {
+        spdlog::warn("This build does not record traces, configure it with -DZM_TRACE=ON");
+    }
+}
+
+template<uint8_t Version, typename Access>
+uint64_t zm::Processor<Version, Access>::execute(uint64_t budget) {
+    uint64_t executed = 0;
+    waiting = InputWait::NONE;
+    sample_profile.enter();
+
+    // Each engine runs until a call or return crosses over to the other one
+    while (!quit && waiting == InputWait::NONE && executed < budget) {
+        StackFrame &frame = call_stack.get_frame();
+        switch_engine = false;
+        translator.acknowledge();
+
+        if (frame.routine && !frame.routine->valid) {
+            deoptimize();
+        }
+
+        if (!frame.routine) {
+            executed += interpret(budget - executed);
+        } else if (frame.routine->native || frame.routine->compiled) {
+            executed += run_native(budget - executed);
+        } else {
+            executed += run_translated(budget - executed);
+        }
+    }
+
+    sample_profile.leave();
+    return executed;
+}
+
+template<uint8_t Version, typename Access>
+uint64_t zm::Processor<Version, Access>::interpret(uint64_t budget) {
+    uint64_t executed = 0;
+    word args[MAX_OPERANDS];
+
+    /*
+     * Fetch the next decoded instruction and resolve its operands, in order
+     * (so that stack operands are popped left to right). Checked access first
+     * makes sure all of the instruction lies in the story. A read whose input
+     * has not arrived stops before anything is popped or counted, and runs
+     * from the start once it has.
+     */
+#define FETCH() \
+    do { \
+        if (quit || switch_engine || executed == budget || !readable(pc, 1, "Execution")) { \
+            return executed; \
+        } \
+        current = &instruction_cache.fetch(pc); \
+        if (Access::checked && !readable(pc, (current->fused_next ? current->fused_next->next_pc : current->next_pc) - pc, "Execution")) { \
+            return executed; \
+        } \
+        if (current->reads_input && !input.ready()) { \
+            waiting = current->instruction.mnemonic == Mnemonic::READ_CHAR ? InputWait::CHAR : InputWait::LINE; \
+            return executed; \
+        } \
+        ++executed; \
+        if (profiling) { \
+            opcode_profile.count(current->instruction); \
+            routine_profile.step(); \
+        } \
+        for (uint8_t i = 0; i < current->operand_count; ++i) { \
+            const Operand &operand = current->operands[i]; \
+            args[i] = operand.type == OperandType::VARIABLE_NUMBER ? read_variable(static_cast<uint8_t>(operand.value)) : operand.value; \
+        } \
+        ZM_TRACE_INSTRUCTION(pc, current->instruction.mnemonic, current->operand_count, args, 0); \
+        if (instrumented) { \
+            instrument(); \
+        } \
+        pc = current->next_pc; \
+    } while (0)
+
+#ifdef ZM_COMPUTED_GOTO
+    static void *handlers[] = {
+#define ZM_HANDLER_ADDRESS(name) &&op_##name,
+        ZM_MNEMONICS(ZM_HANDLER_ADDRESS)
+#undef ZM_HANDLER_ADDRESS
+#define ZM_FUSED_ADDRESS(name) &&fused_##name,
+        ZM_FUSIONS(ZM_FUSED_ADDRESS)
+#undef ZM_FUSED_ADDRESS
+    };
+
+#define HANDLER(name) op_##name:
+#define FUSED(name) fused_##name:
+#define NEXT FETCH(); goto *handlers[current->handler]
+
+    NEXT;
+#else
+#define HANDLER(name) case static_cast<uint16_t>(Mnemonic::name):
+#define FUSED(name) case fused_handler(Fusion::name):
+#define NEXT continue
+
+    for (;;) {
+        FETCH();
+
+        switch (current->handler) {
+#endif
+            // 2OP
+            HANDLER(JE) branch(je(args, current->operand_count)); NEXT;
+            HANDLER(JL) branch(jl(args[0], args[1])); NEXT;
+            HANDLER(JG) branch(jg(args[0], args[1])); NEXT;
+            HANDLER(DEC_CHK) branch(dec(static_cast<uint8_t>(args[0])) < static_cast<int16_t>(args[1])); NEXT;
+            HANDLER(INC_CHK) branch(inc(static_cast<uint8_t>(args[0])) > static_cast<int16_t>(args[1])); NEXT;
+            HANDLER(JIN) branch(jin(args[0], args[1])); NEXT;
+            HANDLER(TEST) branch((args[0] & args[1]) == args[1]); NEXT;
+            HANDLER(OR) store(args[0] | args[1]); NEXT;
+            HANDLER(AND) store(args[0] & args[1]); NEXT;
+            HANDLER(TEST_ATTR) branch(valid_object(args[0], "test_attr") && valid_attribute(args[1], "test_attr") && objects.test_attribute(args[0], static_cast<uint8_t>(args[1]))); NEXT;
+            HANDLER(SET_ATTR) if (valid_object(args[0], "set_attr") && valid_attribute(args[1], "set_attr")) { objects.set_attribute(args[0], static_cast<uint8_t>(args[1])); } NEXT;
+            HANDLER(CLEAR_ATTR) if (valid_object(args[0], "clear_attr") && valid_attribute(args[1], "clear_attr")) { objects.clear_attribute(args[0], static_cast<uint8_t>(args[1])); } NEXT;
+            HANDLER(STORE) write_indirect(static_cast<uint8_t>(args[0]), args[1]); NEXT;
+            HANDLER(INSERT_OBJ) if (valid_object(args[0], "insert_obj") && valid_object(args[1], "insert_obj")) { objects.insert_object(args[0], args[1]); } NEXT;
+            HANDLER(LOADW) store(loadw(args[0], args[1])); NEXT;
+            HANDLER(LOADB) store(loadb(args[0], args[1])); NEXT;
+            HANDLER(GET_PROP) store(valid_object(args[0], "get_prop") ? objects.get_property(args[0], args[1]) : 0); NEXT;
+            HANDLER(GET_PROP_ADDR) store(valid_object(args[0], "get_prop_addr") ? objects.get_property_address(args[0], args[1]) : 0); NEXT;
+            HANDLER(GET_NEXT_PROP) store(valid_object(args[0], "get_next_prop") ? objects.get_next_property(args[0], args[1]) : 0); NEXT;
+            HANDLER(ADD) store(add(args[0], args[1])); NEXT;
+            HANDLER(SUB) store(sub(args[0], args[1])); NEXT;
+            HANDLER(MUL) store(mul(args[0], args[1])); NEXT;
+            HANDLER(DIV) store(div(args[0], args[1])); NEXT;
+            HANDLER(MOD) store(mod(args[0], args[1])); NEXT;
+            HANDLER(CALL_2S) call(args[0], args + 1, 1, true); NEXT;
+            HANDLER(CALL_2N) call(args[0], args + 1, 1, false); NEXT;
+            HANDLER(THROW) throw_to(args[0], args[1]); NEXT;
+
+            // 1OP
+            HANDLER(JZ) branch(jz(args[0])); NEXT;
+            HANDLER(GET_SIBLING) { word sibling = valid_object(args[0], "get_sibling") ? objects.get_sibling(args[0]) : 0; store(sibling); branch(sibling != 0); } NEXT;
+            HANDLER(GET_CHILD) { word child = valid_object(args[0], "get_child") ? objects.get_child(args[0]) : 0; store(child); branch(child != 0); } NEXT;
+            HANDLER(GET_PARENT) store(valid_object(args[0], "get_parent") ? objects.get_parent(args[0]) : 0); NEXT;
+            HANDLER(GET_PROP_LEN) store(objects.get_property_length(args[0])); NEXT;
+            HANDLER(INC) inc(static_cast<uint8_t>(args[0])); NEXT;
+            HANDLER(DEC) dec(static_cast<uint8_t>(args[0])); NEXT;
+            HANDLER(PRINT_ADDR) print_addr(args[0]); NEXT;
+            HANDLER(CALL_1S) call(args[0], args + 1, 0, true); NEXT;
+            HANDLER(REMOVE_OBJ) if (valid_object(args[0], "remove_obj")) { objects.remove_object(args[0]); } NEXT;
+            HANDLER(PRINT_OBJ) print_obj(args[0]); NEXT;
+            HANDLER(RET) ret(args[0]); NEXT;
+            HANDLER(JUMP) jump(args[0]); NEXT;
+            HANDLER(PRINT_PADDR) print_paddr(args[0]); NEXT;
+            HANDLER(LOAD) store(read_indirect(static_cast<uint8_t>(args[0]))); NEXT;
+            HANDLER(NOT) store(static_cast<word>(~args[0])); NEXT;
+            HANDLER(CALL_1N) call(args[0], args + 1, 0, false); NEXT;
+
+            // 0OP
+            HANDLER(RTRUE) ret(1); NEXT;
+            HANDLER(RFALSE) ret(0); NEXT;
+            HANDLER(PRINT) print_string(current->text_address, "print"); NEXT;
+            HANDLER(PRINT_RET) print_string(current->text_address, "print_ret"); output("\n"); ret(1); NEXT;
+            HANDLER(NOP) NEXT;
+            HANDLER(RET_POPPED) ret(read_variable(0)); NEXT;
+            HANDLER(POP) read_variable(0); NEXT;
+            HANDLER(CATCH) store(static_cast<word>(call_stack.size())); NEXT;
+            HANDLER(QUIT) quit = true; NEXT;
+            HANDLER(NEW_LINE) output("\n"); NEXT;
+            HANDLER(SHOW_STATUS) NEXT;
+            // The checksum was compared with the header when the story was loaded
+            HANDLER(VERIFY) branch(verified); NEXT;
+            HANDLER(PIRACY) branch(true); NEXT;
+
+            // VAR
+            HANDLER(CALL) HANDLER(CALL_VS) HANDLER(CALL_VS2) call(args[0], args + 1, current->operand_count - 1, true); NEXT;
+            HANDLER(CALL_VN) HANDLER(CALL_VN2) call(args[0], args + 1, current->operand_count - 1, false); NEXT;
+            HANDLER(STOREW) storew(args[0], args[1], args[2]); NEXT;
+            HANDLER(STOREB) storeb(args[0], args[1], args[2]); NEXT;
+            HANDLER(PUT_PROP) if (valid_object(args[0], "put_prop")) { objects.put_property(args[0], args[1], args[2]); } NEXT;
+            HANDLER(SREAD) read(args[0], current->operand_count > 1 ? args[1] : 0); NEXT;
+            HANDLER(AREAD) if (read(args[0], current->operand_count > 1 ? args[1] : 0)) { store(13); } NEXT;
+            HANDLER(PRINT_CHAR) print_zscii(args[0]); NEXT;
+            HANDLER(PRINT_NUM) print_num(static_cast<int16_t>(args[0])); NEXT;
+            HANDLER(RANDOM) store(random(static_cast<int16_t>(args[0]))); NEXT;
+            HANDLER(PUSH) write_variable(0, args[0]); NEXT;
+            HANDLER(PULL) {
+                word value = read_variable(0);
+
+                if (current->instruction.store) {
+                    store(value);
+                } else {
+                    write_indirect(static_cast<uint8_t>(args[0]), value);
+                }
+            } NEXT;
+            HANDLER(GET_CURSOR) storew(args[0], 0, 1); storew(args[0], 1, 1); NEXT;
+            HANDLER(OUTPUT_STREAM) output_stream(static_cast<int16_t>(args[0]), current->operand_count > 1 ? args[1] : 0); NEXT;
+            HANDLER(READ_CHAR) read_char(); NEXT;
+            HANDLER(SCAN_TABLE) scan_table(args[0], args[1], args[2], current->operand_count > 3 ? args[3] : 0x82); NEXT;
+            HANDLER(TOKENISE) {
+                if (!readable(args[0], 2, "tokenise") || !writable(args[1], 2, "tokenise") ||
+                    !writable(args[1], 2 + (memory.read_byte(args[1]) << 2), "tokenise")) {
+                    NEXT;
+                }
+
+                if (current->operand_count > 2 && args[2] != 0) {
+                    DictionaryMapper<Version>(memory, args[2]).tokenise(args[0], args[1], current->operand_count > 3 && args[3] != 0);
+                } else {
+                    dictionary.tokenise(args[0], args[1], current->operand_count > 3 && args[3] != 0);
+                }
+            } NEXT;
+            HANDLER(ENCODE_TEXT) encode_text(args[0], args[1], args[2], args[3]); NEXT;
+            HANDLER(COPY_TABLE) copy_table(args[0], args[1], args[2]); NEXT;
+            HANDLER(PRINT_TABLE) print_table(args[0], args[1], current->operand_count > 2 ? args[2] : 1, current->operand_count > 3 ? args[3] : 0); NEXT;
+            HANDLER(CHECK_ARG_COUNT) branch(args[0] <= call_stack.get_frame().argument_count); NEXT;
+
+            // Screen model: a single unbuffered window, so these have nothing to do
+            HANDLER(SPLIT_WINDOW) HANDLER(SET_WINDOW) HANDLER(ERASE_WINDOW) HANDLER(ERASE_LINE) HANDLER(SET_CURSOR)
+            HANDLER(SET_TEXT_STYLE) HANDLER(BUFFER_MODE) HANDLER(INPUT_STREAM) HANDLER(SOUND_EFFECT) HANDLER(SET_COLOUR)
+            HANDLER(SET_TRUE_COLOUR) NEXT;
+
+            // EXT
+            HANDLER(LOG_SHIFT) store(log_shift(args[0], static_cast<int16_t>(args[1]))); NEXT;
+            HANDLER(ART_SHIFT) store(art_shift(args[0], static_cast<int16_t>(args[1]))); NEXT;
+            HANDLER(SET_FONT) store(args[0] == 1 ? 1 : 0); NEXT;
+            HANDLER(SAVE_UNDO) store(0xFFFF); NEXT;
+            HANDLER(RESTORE_UNDO) store(0); NEXT;
+            HANDLER(PRINT_UNICODE) print_unicode(args[0]); NEXT;
+            HANDLER(CHECK_UNICODE) store(args[0] < 0x80 ? 3 : 1); NEXT;
+
+            // The auxiliary tables that version 5 saves and restores with operands are not
+            HANDLER(SAVE) {
+                bool saved = current->operand_count == 0 && save_game(Version <= 3 ? current->pc + 1 : current->next_pc - 1);
+
+                if (current->instruction.store) {
+                    store(saved ? 1 : 0);
+                } else {
+                    branch(saved);
+                }
+            } NEXT;
+
+            // A restored game goes on from its save
+            HANDLER(RESTORE) {
+                if (current->operand_count == 0 && restore_game()) {
+                    NEXT;
+                }
+
+                if (current->instruction.store) {
+                    store(0);
+                } else {
+                    branch(false);
+                }
+            } NEXT;
+
+            HANDLER(RESTART) unsupported(); quit = true; NEXT;
+
+            HANDLER(NULL_OP) HANDLER(EXTENDED) HANDLER(DRAW_PICTURE) HANDLER(PICTURE_DATA) HANDLER(ERASE_PICTURE)
+            HANDLER(SET_MARGINS) HANDLER(MOVE_WINDOW) HANDLER(WINDOW_SIZE) HANDLER(WINDOW_STYLE) HANDLER(GET_WIND_PROP)
+            HANDLER(SCROLL_WINDOW) HANDLER(POP_STACK) HANDLER(READ_MOUSE) HANDLER(MOUSE_WINDOW) HANDLER(PUSH_STACK)
+            HANDLER(PUT_WIND_PROP) HANDLER(PRINT_FORM) HANDLER(MAKE_MENU) HANDLER(PICTURE_TABLE) HANDLER(BUFFER_SCREEN)
+                unsupported();
+                if (current->instruction.store) {
+                    store(0);
+                }
+                NEXT;
+
+            /*
+             * Fused pairs. The first instruction runs as usual; the second one
+             * only if the budget allows it, counted as its own instruction, and
+             * its operands are constants so nothing has to be fetched for it.
+             */
+#define SECOND() \
+    do { \
+        current = current->fused_next; \
+        ++executed; \
+        if (profiling) { \
+            opcode_profile.count(current->instruction); \
+            routine_profile.step(); \
+        } \
+        pc = current->next_pc; \
+    } while (0)
+
+            FUSED(JE_JUMP) {
+                bool condition = je(args, current->operand_count);
+
+                if (condition == current->branch_on_true || executed == budget) {
+                    branch(condition);
+                } else {
+                    SECOND();
+                    jump(current->operands[0].value);
+                }
+            } NEXT;
+
+            FUSED(LOADW_JZ) FUSED(LOADB_JZ) {
+                word value = current->instruction.mnemonic == Mnemonic::LOADW ? loadw(args[0], args[1]) : loadb(args[0], args[1]);
+
+                if (executed == budget) {
+                    store(value);
+                } else {
+                    // Pushed and popped straight away when the value goes through the stack
+                    if (current->store_variable != 0) {
+                        write_variable(current->store_variable, value);
+                    }
+
+                    SECOND();
+                    branch(jz(value));
+                }
+            } NEXT;
+
+            FUSED(GET_PROP_STORE) {
+                word value = valid_object(args[0], "get_prop") ? objects.get_property(args[0], args[1]) : 0;
+
+                if (executed == budget) {
+                    store(value);
+                } else {
+                    SECOND();
+                    write_indirect(static_cast<uint8_t>(current->operands[0].value), value);
+                }
+            } NEXT;
+
+            FUSED(INC_JUMP) {
+                inc(static_cast<uint8_t>(args[0]));
+
+                if (executed < budget) {
+                    SECOND();
+                    jump(current->operands[0].value);
+                }
+            } NEXT;
+
+            // The ret_popped is counted here, and runs when the callee returns, see ret()
+            FUSED(CALL_VS_RET_POPPED) {
+                bool entered = args[0] != 0;
+                call(args[0], args + 1, current->operand_count - 1, true);
+
+                if (entered && !quit && executed < budget) {
+                    ++executed;
+                    call_stack.get_frame().tail_return = true;
+                }
+            } NEXT;
+
+#undef SECOND
+#ifndef ZM_COMPUTED_GOTO
+        }
+    }
+#endif
+
+#undef FETCH
+#undef HANDLER
+#undef FUSED
+#undef NEXT
+}
+
+template<uint8_t Version, typename Access>
+zm::word zm::Processor<Version, Access>::read_register(const zm::Register &source, const zm::word *locals, const zm::word *temporaries) {
+    switch (source.type) {
+        case RegisterType::CONSTANT : return source.value;
+        case RegisterType::LOCAL : return locals[source.value];
+        case RegisterType::TEMPORARY : return temporaries[source.value];
+        default : return memory.read_word(global_variables_address + (source.value << 1));
+    }
+}
+
+template<uint8_t Version, typename Access>
+void zm::Processor<Version, Access>::write_register(const zm::Register &destination, zm::word *locals, zm::word *temporaries, zm::word value) {
+    switch (destination.type) {
+        case RegisterType::LOCAL : locals[destination.value] = value; break;
+        case RegisterType::TEMPORARY : temporaries[destination.value] = value; break;
+        case RegisterType::GLOBAL : memory.write_word(global_variables_address + (destination.value << 1), value); break;
+        default : break;
+    }
+}
+
+/*
+ * Runs routines compiled ahead of time or by the JIT, handing every
+ * instruction they leave out to the IR executor one at a time. Calls and
+ * returns come back here, so compiled routines call each other through
+ * this loop.
+ */
+template<uint8_t Version, typename Access>
+uint64_t zm::Processor<Version, Access>::run_native(uint64_t budget) {
+    uint64_t executed = 0;
+
+    while (!quit && waiting == InputWait::NONE && executed < budget && !translator.invalidated()) {
+        StackFrame &frame = call_stack.get_frame();
+
+        if (!frame.routine || !(frame.routine->native || frame.routine->compiled) || !frame.routine->valid) {
+            break;
+        }
+
+        const AotRoutine *compiled = frame.routine->compiled;
+        const NativeRoutine *native = frame.routine->native;
+
+        if (compiled && compiled->entries[frame.ir_index]) {
+            AotState state {
+                call_stack.variables(),
+                call_stack.variables() + frame.arity,
+                &memory,
+                budget - executed
+            };
+
+            frame.ir_index = compiled->function(state, frame.ir_index);
+
+            if (profiling) {
+                opcode_profile.count_native(budget - executed - state.budget);
+                routine_profile.step(budget - executed - state.budget);
+            }
+
+            executed += budget - executed - state.budget;
+        } else if (native && native->entries[frame.ir_index]) {
+            JitState state {
+                call_stack.variables(),
+                call_stack.variables() + frame.arity,
+                memory.cast<uint8_t>(0),
+                memory.cast<uint8_t>(global_variables_address),
+                memory.watch_limit_address(),
+                budget - executed,
+                nullptr
+            };
+
+            frame.ir_index = native->run(state, frame.ir_index);
+
+            if (profiling) {
+                opcode_profile.count_native(budget - executed - state.budget);
+                routine_profile.step(budget - executed - state.budget);
+            }
+
+            executed += budget - executed - state.budget;
+        }
+
+        if (!quit && executed < budget) {
+            switch_engine = false;
+            executed += run_translated(1);
+        }
+    }
+
+    return executed;
+}
+
+template<uint8_t Version, typename Access>
+uint64_t zm::Processor<Version, Access>::run_translated(uint64_t budget) {
+    uint64_t executed = 0;
+    word args[MAX_OPERANDS];
+
+    StackFrame *frame;
+    const IrInstruction *code;
+    const IrInstruction *ir;
+    word *locals;
+    word *temporaries;
+
+    // Picks up the routine on top of the call stack where it stopped, unless it is interpreted
+#define ENTER() \
+    do { \
+        frame = &call_stack.get_frame(); \
+        if (quit || !frame->routine) { \
+            return executed; \
+        } \
+        code = frame->routine->code.data(); \
+        ir = code + frame->ir_index; \
+        locals = call_stack.variables(); \
+        temporaries = locals + frame->arity; \
+    } while (0)
+
+#define FETCH() \
+    do { \
+        if (quit || executed == budget || translator.invalidated()) { \
+            frame->ir_index = static_cast<uint32_t>(ir - code); \
+            return executed; \
+        } \
+        if (ir->reads_input && !input.ready()) { \
+            waiting = ir->instruction.mnemonic == Mnemonic::READ_CHAR ? InputWait::CHAR : InputWait::LINE; \
+            pc = ir->pc; \
+            frame->ir_index = static_cast<uint32_t>(ir - code); \
+            return executed; \
+        } \
+        ++executed; \
+        if (profiling) { \
+            opcode_profile.count(ir->instruction); \
+            routine_profile.step(); \
+        } \
+        for (uint8_t i = 0; i < ir->operand_count; ++i) { \
+            args[i] = read_register(ir->operands[i], locals, temporaries); \
+        } \
+        ZM_TRACE_INSTRUCTION(ir->pc, ir->instruction.mnemonic, ir->operand_count, args, TRACE_IR); \
+        pc = ir->next_pc; \
+    } while (0)
+
+#define RESULT(value) \
+    do { \
+        word result = (value); \
+        ZM_TRACE_STORE(result); \
+        write_register(ir->store, locals, temporaries, result); \
+    } while (0)
+#define REFERENCE(value) write_register(ir->operands[0], locals, temporaries, (value))
+
+#define RETURN(value) \
+    do { \
+        ret(value); \
+        ENTER(); \
+    } while (0)
+
+#define BRANCH(condition) \
+    do { \
+        bool taken = (condition) == ir->branch_on_true; \
+        ZM_TRACE_BRANCH(taken); \
+        if (!taken) { \
+            ++ir; \
+        } else if (ir->target == IR_RETURN_FALSE) { \
+            RETURN(0); \
+        } else if (ir->target == IR_RETURN_TRUE) { \
+            RETURN(1); \
+        } else { \
+            ir = code + ir->target; \
+        } \
+    } while (0)
+
+    // Calls leave when the callee is interpreted; the return comes back through ret()
+#define CALL(routine, count, store_result) \
+    do { \
+        if ((routine) == 0) { \
+            if (store_result) { \
+                RESULT(0); \
+            } \
+            ++ir; \
+        } else { \
+            frame->ir_index = static_cast<uint32_t>(ir - code) + 1; \
+            call((routine), args + 1, (count), (store_result)); \
+            ENTER(); \
+        } \
+    } while (0)
+
+    ENTER();
+
+#ifdef ZM_COMPUTED_GOTO
+    static void *handlers[] = {
+#define ZM_HANDLER_ADDRESS(name) &&ir_##name,
+        ZM_MNEMONICS(ZM_HANDLER_ADDRESS)
+#undef ZM_HANDLER_ADDRESS
+    };
+
+#define HANDLER(name) ir_##name:
+#define NEXT FETCH(); goto *handlers[static_cast<int>(ir->instruction.mnemonic)]
+
+    NEXT;
+#else
+#define HANDLER(name) case Mnemonic::name:
+#define NEXT continue
+
+    for (;;) {
+        FETCH();
+
+        switch (ir->instruction.mnemonic) {
+#endif
+            // 2OP
+            HANDLER(JE) BRANCH(je(args, ir->operand_count)); NEXT;
+            HANDLER(JL) BRANCH(jl(args[0], args[1])); NEXT;
+            HANDLER(JG) BRANCH(jg(args[0], args[1])); NEXT;
+            HANDLER(DEC_CHK) {
+                auto value = static_cast<int16_t>(args[0] - 1);
+                REFERENCE(value);
+                BRANCH(value < static_cast<int16_t>(args[1]));
+            } NEXT;
+            HANDLER(INC_CHK) {
+                auto value = static_cast<int16_t>(args[0] + 1);
+                REFERENCE(value);
+                BRANCH(value > static_cast<int16_t>(args[1]));
+            } NEXT;
+            HANDLER(JIN) BRANCH(jin(args[0], args[1])); NEXT;
+            HANDLER(TEST) BRANCH((args[0] & args[1]) == args[1]); NEXT;
+            HANDLER(OR) RESULT(args[0] | args[1]); ++ir; NEXT;
+            HANDLER(AND) RESULT(args[0] & args[1]); ++ir; NEXT;
+            HANDLER(TEST_ATTR) BRANCH(valid_object(args[0], "test_attr") && valid_attribute(args[1], "test_attr") && objects.test_attribute(args[0], static_cast<uint8_t>(args[1]))); NEXT;
+            HANDLER(SET_ATTR) if (valid_object(args[0], "set_attr") && valid_attribute(args[1], "set_attr")) { objects.set_attribute(args[0], static_cast<uint8_t>(args[1])); } ++ir; NEXT;
+            HANDLER(CLEAR_ATTR) if (valid_object(args[0], "clear_attr") && valid_attribute(args[1], "clear_attr")) { objects.clear_attribute(args[0], static_cast<uint8_t>(args[1])); } ++ir; NEXT;
+            HANDLER(STORE) REFERENCE(args[1]); ++ir; NEXT;
+            HANDLER(INSERT_OBJ) if (valid_object(args[0], "insert_obj") && valid_object(args[1], "insert_obj")) { objects.insert_object(args[0], args[1]); } ++ir; NEXT;
+            HANDLER(LOADW) RESULT(loadw(args[0], args[1])); ++ir; NEXT;
+            HANDLER(LOADB) RESULT(loadb(args[0], args[1])); ++ir; NEXT;
+            HANDLER(GET_PROP) RESULT(valid_object(args[0], "get_prop") ? objects.get_property(args[0], args[1]) : 0); ++ir; NEXT;
+            HANDLER(GET_PROP_ADDR) RESULT(valid_object(args[0], "get_prop_addr") ? objects.get_property_address(args[0], args[1]) : 0); ++ir; NEXT;
+            HANDLER(GET_NEXT_PROP) RESULT(valid_object(args[0], "get_next_prop") ? objects.get_next_property(args[0], args[1]) : 0); ++ir; NEXT;
+            HANDLER(ADD) RESULT(add(args[0], args[1])); ++ir; NEXT;
+            HANDLER(SUB) RESULT(sub(args[0], args[1])); ++ir; NEXT;
+            HANDLER(MUL) RESULT(mul(args[0], args[1])); ++ir; NEXT;
+            HANDLER(DIV) RESULT(div(args[0], args[1])); ++ir; NEXT;
+            HANDLER(MOD) RESULT(mod(args[0], args[1])); ++ir; NEXT;
+            HANDLER(CALL_2S) CALL(args[0], 1, true); NEXT;
+            HANDLER(CALL_2N) CALL(args[0], 1, false); NEXT;
+
+            // 1OP
+            HANDLER(JZ) BRANCH(jz(args[0])); NEXT;
+            HANDLER(GET_SIBLING) { word sibling = valid_object(args[0], "get_sibling") ? objects.get_sibling(args[0]) : 0; RESULT(sibling); BRANCH(sibling != 0); } NEXT;
+            HANDLER(GET_CHILD) { word child = valid_object(args[0], "get_child") ? objects.get_child(args[0]) : 0; RESULT(child); BRANCH(child != 0); } NEXT;
+            HANDLER(GET_PARENT) RESULT(valid_object(args[0], "get_parent") ? objects.get_parent(args[0]) : 0); ++ir; NEXT;
+            HANDLER(GET_PROP_LEN) RESULT(objects.get_property_length(args[0])); ++ir; NEXT;
+            HANDLER(INC) REFERENCE(static_cast<word>(args[0] + 1)); ++ir; NEXT;
+            HANDLER(DEC) REFERENCE(static_cast<word>(args[0] - 1)); ++ir; NEXT;
+            HANDLER(PRINT_ADDR) print_addr(args[0]); ++ir; NEXT;
+            HANDLER(CALL_1S) CALL(args[0], 0, true); NEXT;
+            HANDLER(REMOVE_OBJ) if (valid_object(args[0], "remove_obj")) { objects.remove_object(args[0]); } ++ir; NEXT;
+            HANDLER(PRINT_OBJ) print_obj(args[0]); ++ir; NEXT;
+            HANDLER(RET) RETURN(args[0]); NEXT;
+            HANDLER(JUMP) ir = code + ir->target; NEXT;
+            HANDLER(PRINT_PADDR) print_paddr(args[0]); ++ir; NEXT;
+            HANDLER(LOAD) RESULT(args[0]); ++ir; NEXT;
+            HANDLER(NOT) RESULT(static_cast<word>(~args[0])); ++ir; NEXT;
+            HANDLER(CALL_1N) CALL(args[0], 0, false); NEXT;
+
+            // 0OP
+            HANDLER(RTRUE) RETURN(1); NEXT;
+            HANDLER(RFALSE) RETURN(0); NEXT;
+            HANDLER(PRINT) print_string(ir->text_address, "print"); ++ir; NEXT;
+            HANDLER(PRINT_RET) print_string(ir->text_address, "print_ret"); output("\n"); RETURN(1); NEXT;
+            HANDLER(RET_POPPED) RETURN(args[0]); NEXT;
+            HANDLER(QUIT) quit = true; ++ir; NEXT;
+            HANDLER(NEW_LINE) output("\n"); ++ir; NEXT;
+            HANDLER(VERIFY) BRANCH(verified); NEXT;
+            HANDLER(PIRACY) BRANCH(true); NEXT;
+
+            // VAR
+            HANDLER(CALL) HANDLER(CALL_VS) HANDLER(CALL_VS2) CALL(args[0], ir->operand_count - 1, true); NEXT;
+            HANDLER(CALL_VN) HANDLER(CALL_VN2) CALL(args[0], ir->operand_count - 1, false); NEXT;
+            HANDLER(STOREW) storew(args[0], args[1], args[2]); ++ir; NEXT;
+            HANDLER(STOREB) storeb(args[0], args[1], args[2]); ++ir; NEXT;
+            HANDLER(PUT_PROP) if (valid_object(args[0], "put_prop")) { objects.put_property(args[0], args[1], args[2]); } ++ir; NEXT;
+            HANDLER(SREAD) read(args[0], ir->operand_count > 1 ? args[1] : 0); ++ir; NEXT;
+            HANDLER(AREAD) if (read(args[0], ir->operand_count > 1 ? args[1] : 0)) { RESULT(13); } ++ir; NEXT;
+            HANDLER(PRINT_CHAR) print_zscii(args[0]); ++ir; NEXT;
+            HANDLER(PRINT_NUM) print_num(static_cast<int16_t>(args[0])); ++ir; NEXT;
+            HANDLER(RANDOM) RESULT(random(static_cast<int16_t>(args[0]))); ++ir; NEXT;
+            HANDLER(PUSH) RESULT(args[0]); ++ir; NEXT;
+
+            // The pulled value is the last operand
+            HANDLER(PULL) {
+                if (ir->instruction.store) {
+                    RESULT(args[0]);
+                } else {
+                    REFERENCE(args[1]);
+                }
+            } ++ir; NEXT;
+
+            HANDLER(OUTPUT_STREAM) output_stream(static_cast<int16_t>(args[0]), ir->operand_count > 1 ? args[1] : 0); ++ir; NEXT;
+            HANDLER(COPY_TABLE) copy_table(args[0], args[1], args[2]); ++ir; NEXT;
+            HANDLER(PRINT_TABLE) print_table(args[0], args[1], ir->operand_count > 2 ? args[2] : 1, ir->operand_count > 3 ? args[3] : 0); ++ir; NEXT;
+            HANDLER(CHECK_ARG_COUNT) BRANCH(args[0] <= frame->argument_count); NEXT;
+
+            // The stack effect of pop was taken care of by the translation
+            HANDLER(NOP) HANDLER(POP) HANDLER(SHOW_STATUS)
+            HANDLER(SPLIT_WINDOW) HANDLER(SET_WINDOW) HANDLER(ERASE_WINDOW) HANDLER(ERASE_LINE) HANDLER(SET_CURSOR)
+            HANDLER(SET_TEXT_STYLE) HANDLER(BUFFER_MODE) HANDLER(INPUT_STREAM) HANDLER(SOUND_EFFECT) HANDLER(SET_COLOUR)
+            HANDLER(SET_TRUE_COLOUR) ++ir; NEXT;
+
+            // EXT
+            HANDLER(LOG_SHIFT) RESULT(log_shift(args[0], static_cast<int16_t>(args[1]))); ++ir; NEXT;
+            HANDLER(ART_SHIFT) RESULT(art_shift(args[0], static_cast<int16_t>(args[1]))); ++ir; NEXT;
+            HANDLER(SET_FONT) RESULT(args[0] == 1 ? 1 : 0); ++ir; NEXT;
+            HANDLER(PRINT_UNICODE) print_unicode(args[0]); ++ir; NEXT;
+            HANDLER(CHECK_UNICODE) RESULT(args[0] < 0x80 ? 3 : 1); ++ir; NEXT;
+
+            // Never translated, see Translator::supported
+            HANDLER(CATCH) HANDLER(THROW) HANDLER(SAVE) HANDLER(RESTORE) HANDLER(RESTART) HANDLER(READ_CHAR)
+            HANDLER(SCAN_TABLE) HANDLER(TOKENISE) HANDLER(ENCODE_TEXT) HANDLER(GET_CURSOR) HANDLER(SAVE_UNDO)
+            HANDLER(RESTORE_UNDO) HANDLER(NULL_OP) HANDLER(EXTENDED) HANDLER(DRAW_PICTURE) HANDLER(PICTURE_DATA)
+            HANDLER(ERASE_PICTURE) HANDLER(SET_MARGINS) HANDLER(MOVE_WINDOW) HANDLER(WINDOW_SIZE) HANDLER(WINDOW_STYLE)
+            HANDLER(GET_WIND_PROP) HANDLER(SCROLL_WINDOW) HANDLER(POP_STACK) HANDLER(READ_MOUSE) HANDLER(MOUSE_WINDOW)
+            HANDLER(PUSH_STACK) HANDLER(PUT_WIND_PROP) HANDLER(PRINT_FORM) HANDLER(MAKE_MENU) HANDLER(PICTURE_TABLE)
+            HANDLER(BUFFER_SCREEN)
+                spdlog::error("Untranslatable instruction {} at {:x}", mnemonic_name(ir->instruction.mnemonic), ir->pc);
+                quit = error = true;
+                NEXT;
+#ifndef ZM_COMPUTED_GOTO
+        }
+    }
+#endif
+
+#undef ENTER
+#undef FETCH
+#undef RESULT
+#undef REFERENCE
+#undef RETURN
+#undef BRANCH
+#undef CALL
+#undef HANDLER
+#undef NEXT
+}
+
+template class zm::Processor<1, zm::UncheckedAccess>;
+template class zm::Processor<1, zm::CheckedAccess>;
+template class zm::Processor<2, zm::UncheckedAccess>;
+template class zm::Processor<2, zm::CheckedAccess>;
+template class zm::Processor<3, zm::UncheckedAccess>;
+template class zm::Processor<3, zm::CheckedAccess>;
+template class zm::Processor<4, zm::UncheckedAccess>;
+template class zm::Processor<4, zm::CheckedAccess>;
+template class zm::Processor<5, zm::UncheckedAccess>;
+template class zm::Processor<5, zm::CheckedAccess>;
+template class zm::Processor<6, zm::UncheckedAccess>;
+template class zm::Processor<6, zm::CheckedAccess>;
+template class zm::Processor<7, zm::UncheckedAccess>;
+template class zm::Processor<7, zm::CheckedAccess>;
+template class zm::Processor<8, zm::UncheckedAccess>;
+template class zm::Processor<8, zm::CheckedAccess>;
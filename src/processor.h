@@ -3,104 +3,235 @@
 
 #include <cstdint>
 #include <stack>
+#include <string>
+#include <vector>
 
 #include "call_stack.h"
+#include "decoder.h"
+#include "fusion.h"
+#include "input.h"
+#include "instruction_cache.h"
+#include "jit.h"
+#include "opcode_profile.h"
+#include "options.h"
+#include "random_number_generator.h"
+#include "routine_cache.h"
+#include "routine_profile.h"
+#include "sample_profile.h"
+#include "translator.h"
+#include "version.h"
+
+#include "aot/plugin.h"
+#include "trace/trace.h"
+
+#include "memory/dictionary_mapper.h"
+#include "memory/object_mapper.h"
+#include "memory/zchar_mapper.h"
+
+/*
+ * Dispatch through a table of label addresses where the compiler supports
+ * it (GCC and Clang), so every handler ends in its own indirect jump.
+ * Define ZM_NO_COMPUTED_GOTO to force the portable switch.
+ */
+#if defined(__GNUC__) && !defined(ZM_NO_COMPUTED_GOTO)
+#define ZM_COMPUTED_GOTO 1
+#endif
 
 namespace zm {
-    class InstructionSet;
     class Random;
     class Timer;
     class Memory;
-    class Input;
     class Video;
 
+    /*
+     * Access is UncheckedAccess or CheckedAccess (see memory/memory.h): both
+     * are compiled, and the checks of the unchecked one fold away.
+     */
+    template<uint8_t Version, typename Access>
     class Processor {
     public:
-        Processor(const Memory &memory, const InstructionSet &instruction_set, const Video &video, const Input &input) :
-        memory(memory),
-        instruction_set(instruction_set),
-        video(video),
-        input(input) { }
+        using Traits = VersionTraits<Version>;
 
+        Processor(Memory &memory, Video &video, Input &input);
 
-        bool tick();
+        // Executes up to budget instructions and returns how many ran
+        uint64_t execute(uint64_t budget);
+
+        bool finished() const { return quit; }
+
+        // Quit because of an error in the story rather than by itself
+        bool failed() const { return error; }
+
+        // Stopped at a read whose input is not ready yet, which runs again on the next execute
+        InputWait waiting_for_input() const { return waiting; }
+
+        void configure(const Options &options);
+
+        const PairProfile &get_pair_profile() const { return pair_profile; }
+        const OpcodeProfile &get_opcode_profile() const { return opcode_profile; }
+        const RoutineProfile &get_routine_profile() const { return routine_profile; }
+        SampleProfile &get_sample_profile() { return sample_profile; }
+
+        // Hardware counters for the opcode profile to read around the instructions it times
+        void measure(const PerfCounters *counters) { opcode_profile.set_counters(counters); }
+
+#ifdef ZM_TRACE
+        const TraceBuffer &get_trace() const { return trace; }
+#endif
 
     protected:
+        // Variable access
+        word read_variable(uint8_t variable);
+        void write_variable(uint8_t variable, word value);
+        word read_indirect(uint8_t variable);
+        void write_indirect(uint8_t variable, word value);
+
+        void store(word value);
+        void branch(bool condition);
+
         // Jump operations
-        uint16_t je(uint16_t a, uint16_t b);
-        uint16_t jg(uint16_t a, uint16_t b);
-        uint16_t jin(uint16_t a, uint32_t b);
-        uint16_t jz(uint16_t a);
-        uint16_t jump(int16_t offset);
-        uint16_t jl(uint16_t a, uint16_t b);
+        bool je(const word *values, uint8_t count);
+        bool jg(word a, word b) { return static_cast<int16_t>(a) > static_cast<int16_t>(b); }
+        bool jl(word a, word b) { return static_cast<int16_t>(a) < static_cast<int16_t>(b); }
+        bool jin(word a, word b);
+        bool jz(word a) { return a == 0; }
+        void jump(word offset) { pc = pc + static_cast<int16_t>(offset) - 2; }
 
         // Routine operations
-        uint16_t call_1s(uint16_t routine);
-        uint16_t call_1n(uint16_t routine);
-        uint16_t call_2s(uint16_t routine, uint16_t arg);
-        uint16_t call_2n(uint16_t routine, uint16_t arg);
-        uint16_t call(uint16_t arg_count, uint16_t args[]);
-        uint16_t call_vs(uint16_t arg_count, uint16_t args[]);
-        uint16_t call_vs2(uint16_t arg_count, uint16_t args[]);
+        void call(word routine, const word *args, uint8_t arg_count, bool store_result);
+        void ret(word value);
+        void throw_to(word value, word frame);
+        void deoptimize();
 
         // Storage operations
-        uint16_t load(uint16_t variable);
-        uint16_t loadb(uint16_t array, uint8_t index);
-        uint16_t loadw(uint16_t array, uint16_t index);
-        uint16_t store(uint16_t variable, uint16_t value);
-        uint16_t storeb(uint16_t array, uint8_t index, uint16_t value);
-        uint16_t storew(uint16_t array, uint16_t index, uint16_t value);
+        word loadb(word array, word index);
+        word loadw(word array, word index);
+        void storeb(word array, word index, word value);
+        void storew(word array, word index, word value);
 
         // Arithmetic operations
-        int16_t add(int16_t a, int16_t b);
-        int16_t sub(int16_t a, int16_t b);
-        int16_t mul(int16_t a, int16_t b);
-        int16_t mod(int16_t a, int16_t b);
+        int16_t add(int16_t a, int16_t b) { return static_cast<int16_t>(a + b); }
+        int16_t sub(int16_t a, int16_t b) { return static_cast<int16_t>(a - b); }
+        int16_t mul(int16_t a, int16_t b) { return static_cast<int16_t>(a * b); }
         int16_t div(int16_t a, int16_t b);
-        int16_t inc(int16_t variable);
-        int16_t dec(int16_t variable);
-
-        uint16_t log_shift(uint16_t number, int8_t places);
-        uint16_t art_shift(uint16_t number, int8_t places);
+        int16_t mod(int16_t a, int16_t b);
+        int16_t inc(uint8_t variable);
+        int16_t dec(uint8_t variable);
 
-        // Boolean operations
-        uint16_t and_b(uint16_t a, uint16_t b);
-        uint16_t or_b(uint16_t a, uint16_t b);
-        uint16_t not_b(uint16_t a);
-        uint16_t r_true();
-        uint16_t r_false();
+        word log_shift(word number, int16_t places);
+        word art_shift(word number, int16_t places);
 
         // Object operations
-        uint16_t test_attr(uint16_t object, uint16_t attribute);
-        uint16_t set_attr(uint16_t object, uint16_t attribute);
-        uint16_t clear_attr(uint16_t object, uint16_t attribute);
-        uint16_t insert_obj(uint16_t object, uint16_t destination);
-        uint16_t get_prop(uint16_t object, uint16_t property);
-        uint16_t get_prop_addr(uint16_t object, uint16_t property);
-        uint16_t get_next_prop(uint16_t object, uint16_t property);
-        uint16_t get_sibling(uint16_t object);
-        uint16_t get_child(uint16_t object);
-        uint16_t get_parent(uint16_t object);
-        uint16_t get_prop_len(uint16_t property_address);
+        bool valid_object(word object, const char *operation);
+        bool valid_attribute(word attribute, const char *operation);
+
+        // Always true unless checked, where they stop the story at the first access outside the story or dynamic memory
+        bool readable(address start, uint32_t length, const char *operation);
+        bool writable(address start, uint32_t length, const char *operation);
+
+        // The same for taking a value from the evaluation stack of the routine, where checked stops at an empty one
+        bool stacked(const char *operation);
 
         // Print operations
-        uint16_t print();
-        uint16_t print_ret();
-        uint16_t print_addr(uint16_t byte_address);
-        uint16_t print_paddr(uint16_t packed_address);
-        uint16_t print_obj(uint16_t object);
-        uint16_t print_char(uint16_t output_character_code);
-        uint16_t print_num(int16_t number);
-        uint16_t print_table(uint16_t zscii_text, uint16_t width, uint16_t height, uint16_t skip);
-        uint16_t print_unicode(uint16_t char_number);
-        uint16_t print_form(uint16_t formatted_table);
+        void output(const std::string &text);
+        void print_zscii(word character);
+        void print_string(address string, const char *operation); // Checked stops at one that runs past the story
+        void print_addr(address byte_address);
+        void print_paddr(word packed_address);
+        void print_obj(word object);
+        void print_num(int16_t number);
+        void print_table(word zscii_text, word width, word height, word skip);
+        void print_unicode(word char_number);
+
+        // Input operations
+        bool read(word text_buffer, word parse_buffer);
+        bool read_char();
+
+        // Table operations
+        void scan_table(word x, word table, word length, word form);
+        void copy_table(word first, word second, word size);
+        void encode_text(word zscii_text, word length, word from, word coded_text);
+
+        void output_stream(int16_t number, word table);
+        word random(int16_t range);
+
+        // Quetzal saved games, resuming at the branch or store of the instruction that saved
+        bool save_game(address resume);
+        bool restore_game();
+
+        void initialize_header();
+        void unsupported();
+        void instrument();
+
+        // Execution engines: the decoded instruction interpreter, and the IR of translated routines
+        uint64_t interpret(uint64_t budget);
+        uint64_t run_translated(uint64_t budget);
+        uint64_t run_native(uint64_t budget);
+
+        word read_register(const Register &source, const word *locals, const word *temporaries);
+        void write_register(const Register &destination, word *locals, word *temporaries, word value);
 
     private:
-
-        const InstructionSet &instruction_set;
-        const Memory &memory;
-        const Video &video;
-        const Input &input;
+        Memory &memory;
+        Video &video;
+        Input &input;
+
+        CallStack call_stack;
+        InstructionCache<Version> instruction_cache;
+        RoutineCache<Version> routines;
+        Translator<Version> translator;
+        Jit jit;
+        AotPlugin plugin;
+        ObjectMapper<Version> objects;
+        DictionaryMapper<Version> dictionary;
+        ZCharMapper text;
+        RandomNumberGenerator rng;
+        PairProfile pair_profile;
+        OpcodeProfile opcode_profile;
+        RoutineProfile routine_profile;
+        SampleProfile sample_profile;
+
+#ifdef ZM_TRACE
+        TraceBuffer trace;
+        static constexpr bool tracing = true;
+#else
+        static constexpr bool tracing = false;
+#endif
+
+        address pc;
+        const DecodedInstruction *current = nullptr;
+
+        address global_variables_address;
+        word routines_offset;
+        word static_strings_offset;
+        bool verified; // What VERIFY branches on
+
+        // Where the story ends, and where static memory starts
+        address readable_end;
+        address writable_end;
+
+        // Dynamic memory as the story starts, which saved games are compared with
+        const uint8_t *original;
+        std::vector<uint8_t> original_copy;
+
+        // Where games are saved, or the last game saved when there is no file
+        std::string save_file;
+        std::vector<uint8_t> saved_game;
+
+        // Output stream 3 redirections: table address and characters written so far
+        std::vector<std::pair<word, word>> memory_streams;
+
+        bool quit = false;
+        bool error = false;
+        InputWait waiting = InputWait::NONE;
+        bool profile_pairs = false;
+        bool profiling = false; // Opcode and routine profiles, counted in both engines so translation and fusion stay on
+        bool instrumented = false; // Anything to do per instruction: one test in FETCH
+        bool translation = false;
+        bool jit_enabled = false;
+
+        // Set when a call or return lands in a routine of the other engine
+        bool switch_engine = false;
     };
 }
 
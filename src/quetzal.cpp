@@ -0,0 +1,177 @@
+#include "quetzal.h"
+
+#include "memory/big_endian.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+// Runs of unchanged bytes are counted in one byte, less one
+#define MAX_RUN 0x100
+
+// Restoring compares memory with the original in pieces no larger than a page
+#define PAGE_BYTES 0x1000u
+
+static uint64_t load_64(const uint8_t *bytes) {
+    uint64_t value;
+    std::memcpy(&value, bytes, sizeof(value));
+    return value;
+}
+
+zm::QuetzalWriter::QuetzalWriter() : data { 'F', 'O', 'R', 'M', 0, 0, 0, 0, 'I', 'F', 'Z', 'S' } { }
+
+void zm::QuetzalWriter::begin(const char *id) {
+    chunk = data.size();
+    bytes(id, 4);
+    bytes("\0\0\0\0", 4);
+}
+
+void zm::QuetzalWriter::end() {
+    zm::store_be32(&data[chunk + 4], static_cast<uint32_t>(data.size() - chunk - 8));
+
+    if (data.size() & 1) {
+        byte(0);
+    }
+}
+
+void zm::QuetzalWriter::word(uint16_t value) {
+    byte(static_cast<uint8_t>(value >> 8));
+    byte(static_cast<uint8_t>(value));
+}
+
+void zm::QuetzalWriter::address(uint32_t value) {
+    byte(static_cast<uint8_t>(value >> 16));
+    byte(static_cast<uint8_t>(value >> 8));
+    byte(static_cast<uint8_t>(value));
+}
+
+void zm::QuetzalWriter::bytes(const void *values, size_t length) {
+    auto begin = static_cast<const uint8_t *>(values);
+    data.insert(data.end(), begin, begin + length);
+}
+
+void zm::QuetzalWriter::compressed_memory(const uint8_t *current, const uint8_t *original, uint32_t length) {
+    uint32_t run = 0;
+
+    auto changed = [&](uint8_t delta) {
+        if (delta == 0) {
+            ++run;
+            return;
+        }
+
+        for (; run > 0; run -= std::min(run, static_cast<uint32_t>(MAX_RUN))) {
+            byte(0);
+            byte(static_cast<uint8_t>(std::min(run, static_cast<uint32_t>(MAX_RUN)) - 1));
+        }
+
+        byte(delta);
+    };
+
+    uint32_t i = 0;
+
+    // A word at a time while it is the same, a byte at a time in the words that changed
+    for (; i + 8 <= length; i += 8) {
+        if (load_64(current + i) == load_64(original + i)) {
+            run += 8;
+            continue;
+        }
+
+        for (uint32_t j = i; j < i + 8; ++j) {
+            changed(current[j] ^ original[j]);
+        }
+    }
+
+    for (; i < length; ++i) {
+        changed(current[i] ^ original[i]);
+    }
+
+    // Whatever is left unchanged at the end is implied
+}
+
+std::vector<uint8_t> zm::QuetzalWriter::finish() {
+    zm::store_be32(&data[4], static_cast<uint32_t>(data.size() - 8));
+    return std::move(data);
+}
+
+bool zm::QuetzalReader::valid() const {
+    if (save.size() < 12 || std::memcmp(save.data(), "FORM", 4) != 0 || std::memcmp(save.data() + 8, "IFZS", 4) != 0) {
+        return false;
+    }
+
+    return static_cast<size_t>(zm::load_be32(save.data() + 4)) + 8 <= save.size();
+}
+
+bool zm::QuetzalReader::find(const char *id, const uint8_t *&chunk, uint32_t &length) const {
+    size_t end = 8 + static_cast<size_t>(zm::load_be32(save.data() + 4));
+
+    for (size_t position = 12; position + 8 <= end; ) {
+        uint32_t size = zm::load_be32(&save[position + 4]);
+
+        if (size > end - position - 8) {
+            return false;
+        }
+
+        if (std::memcmp(&save[position], id, 4) == 0) {
+            chunk = &save[position + 8];
+            length = size;
+            return true;
+        }
+
+        position += 8 + size + (size & 1);
+    }
+
+    return false;
+}
+
+bool zm::decompress_memory(const uint8_t *chunk, uint32_t chunk_length, const uint8_t *original, uint8_t *memory, uint32_t length) {
+    // Checked first, so that nothing is written from a chunk that does not fit
+    uint32_t decoded = 0;
+
+    for (uint32_t p = 0; p < chunk_length; ++p) {
+        if (chunk[p] == 0) {
+            if (++p == chunk_length) {
+                return false;
+            }
+
+            decoded += chunk[p] + 1u;
+        } else {
+            ++decoded;
+        }
+    }
+
+    if (decoded > length) {
+        return false;
+    }
+
+    uint32_t i = 0;
+
+    // A page at a time, so that only the pages that differ are copied
+    auto unchanged = [&](uint32_t run) {
+        for (uint32_t end = i + run; i < end; ) {
+            uint32_t piece = std::min(end - i, PAGE_BYTES - (i & (PAGE_BYTES - 1)));
+
+            if (std::memcmp(memory + i, original + i, piece) != 0) {
+                std::memcpy(memory + i, original + i, piece);
+            }
+
+            i += piece;
+        }
+    };
+
+    for (uint32_t p = 0; p < chunk_length; ++p) {
+        if (chunk[p] == 0) {
+            unchanged(chunk[++p] + 1u);
+        } else {
+            auto value = static_cast<uint8_t>(original[i] ^ chunk[p]);
+
+            if (memory[i] != value) {
+                memory[i] = value;
+            }
+
+            ++i;
+        }
+    }
+
+    unchanged(length - i);
+    return true;
+}
@@ -0,0 +1,71 @@
+#ifndef ZETAMACHINE_QUETZAL_H
+#define ZETAMACHINE_QUETZAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace zm {
+    /*
+     * Builds a Quetzal saved game: an IFF FORM of type IFZS, one chunk at a
+     * time. Values are big-endian, chunks are padded to an even length.
+     */
+    class QuetzalWriter {
+    public:
+        QuetzalWriter();
+
+        // Starts a chunk, which lasts until end()
+        void begin(const char *id);
+        void end();
+
+        void byte(uint8_t value) { data.push_back(value); }
+        void word(uint16_t value);
+        void address(uint32_t value); // Three bytes, as program counters are saved
+        void bytes(const void *values, size_t length);
+
+        /*
+         * The contents of CMem: memory XORed with the original, where every
+         * run of unchanged bytes is a zero and its length less one, up to 256
+         * at a time. Unchanged memory is skipped eight bytes at a time, and
+         * the run at the end is left out.
+         */
+        void compressed_memory(const uint8_t *current, const uint8_t *original, uint32_t length);
+
+        // The saved game, once every chunk has ended. The writer is empty afterwards
+        std::vector<uint8_t> finish();
+
+    private:
+        std::vector<uint8_t> data;
+        size_t chunk = 0; // Where the chunk being written starts
+    };
+
+    // Finds the chunks of a saved game, which has to outlive the reader
+    class QuetzalReader {
+    public:
+        explicit QuetzalReader(const std::vector<uint8_t> &save) : save(save) { }
+
+        // A FORM of type IFZS whose chunks fit in it
+        bool valid() const;
+
+        // The first chunk with that id, false when there is none
+        bool find(const char *id, const uint8_t *&chunk, uint32_t &length) const;
+
+    private:
+        const std::vector<uint8_t> &save;
+    };
+
+    // A program counter as saved
+    inline uint32_t load_address(const uint8_t *bytes) {
+        return static_cast<uint32_t>(bytes[0]) << 16 | static_cast<uint32_t>(bytes[1]) << 8 | bytes[2];
+    }
+
+    /*
+     * Writes the memory a CMem chunk was made from over memory, straight from
+     * the chunk and the original. Bytes that are the same already are left
+     * alone, so shared pages stay shared. Memory is left as it was when the
+     * chunk decodes to more than that length.
+     */
+    bool decompress_memory(const uint8_t *chunk, uint32_t chunk_length, const uint8_t *original, uint8_t *memory, uint32_t length);
+}
+
+#endif //ZETAMACHINE_QUETZAL_H
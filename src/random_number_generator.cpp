@@ -3,3 +3,37 @@
 //
 
 #include "random_number_generator.h"
+
+#include <chrono>
+
+void zm::RandomNumberGenerator::seed(uint16_t seed) {
+    sequence_length = 0;
+    sequence_position = 0;
+
+    if (seed == 0) {
+        auto now = std::chrono::steady_clock::now().time_since_epoch().count();
+        state = static_cast<uint32_t>(now) | 1;
+    } else if (seed < 1000) {
+        sequence_length = seed;
+    } else {
+        state = seed;
+    }
+}
+
+uint16_t zm::RandomNumberGenerator::random() {
+    // xorshift32
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return static_cast<uint16_t>(state >> 16);
+}
+
+uint16_t zm::RandomNumberGenerator::random(uint16_t range) {
+    if (sequence_length != 0) {
+        sequence_position = sequence_position % sequence_length + 1;
+        return (sequence_position - 1) % range + 1;
+    }
+
+    return random() % range + 1;
+}
@@ -6,9 +6,22 @@
 namespace zm {
     class RandomNumberGenerator {
     public:
+        RandomNumberGenerator() { seed(0); }
+
+        /*
+         * Seed 0 goes back to random mode. Seeds below 1000 switch to the
+         * counting mode suggested by the standard (1, 2, ..., seed, 1, ...),
+         * any other seed gives a predictable pseudo-random sequence.
+         */
         void seed(uint16_t seed);
 
         uint16_t random();
+        uint16_t random(uint16_t range);
+
+    private:
+        uint32_t state;
+        uint16_t sequence_length;
+        uint16_t sequence_position;
     };
 }
 
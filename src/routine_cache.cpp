@@ -0,0 +1,91 @@
+#include "routine_cache.h"
+
+#include "version.h"
+
+template<uint8_t Version>
+zm::RoutineCache<Version>::RoutineCache(zm::Memory &memory, zm::address static_memory_base, zm::word routines_offset) :
+    memory(memory),
+    static_memory_base(static_memory_base),
+    routines_offset(routines_offset),
+    pages((0xFFFF >> ROUTINE_CACHE_PAGE_BITS) + 1) {
+    memory.observe_writes(this);
+}
+
+template<uint8_t Version>
+zm::RoutineCache<Version>::~RoutineCache() {
+    memory.ignore_writes(this);
+}
+
+template<uint8_t Version>
+zm::RoutineDescriptor &zm::RoutineCache<Version>::describe(zm::word packed) {
+    using Traits = VersionTraits<Version>;
+
+    RoutineDescriptor routine {};
+    routine.header = Traits::unpack_routine(packed, routines_offset);
+    routine.locals = memory.read(routine.header) & 0x0F;
+    routine.entry = routine.header + 1;
+
+    if (Traits::routine_default_locals) {
+        for (uint8_t i = 0; i < routine.locals; ++i) {
+            routine.defaults[i] = memory.read_word(routine.entry);
+            routine.entry += 2;
+        }
+    }
+
+    // Rewriting the header changes the descriptor
+    routine.dynamic = routine.header < static_memory_base;
+
+    if (routine.dynamic) {
+        watched.push_back(packed);
+        memory.extend_watch_limit(routine.entry);
+    }
+
+    auto &page = pages[packed >> ROUTINE_CACHE_PAGE_BITS];
+
+    if (!page) {
+        page.reset(new Page());
+    }
+
+    uint32_t index;
+
+    if (dropped.empty()) {
+        index = static_cast<uint32_t>(descriptors.size());
+        descriptors.push_back(routine);
+    } else {
+        index = dropped.back();
+        dropped.pop_back();
+        descriptors[index] = routine;
+    }
+
+    page->slots[packed & ROUTINE_CACHE_PAGE_MASK] = index + 1;
+
+    return descriptors[index];
+}
+
+template<uint8_t Version>
+void zm::RoutineCache<Version>::notify_write(uint32_t address, uint32_t length) {
+    for (size_t i = 0; i < watched.size(); ) {
+        uint32_t &slot = pages[watched[i] >> ROUTINE_CACHE_PAGE_BITS]->slots[watched[i] & ROUTINE_CACHE_PAGE_MASK];
+        const RoutineDescriptor &routine = descriptors[slot - 1];
+
+        if (address >= routine.entry || address + length <= routine.header) {
+            ++i;
+            continue;
+        }
+
+        // Described again on the next call
+        dropped.push_back(slot - 1);
+        slot = 0;
+        watched[i] = watched.back();
+        watched.pop_back();
+    }
+}
+
+template class zm::RoutineCache<1>;
+template class zm::RoutineCache<2>;
+template class zm::RoutineCache<3>;
+template class zm::RoutineCache<4>;
+template class zm::RoutineCache<5>;
+template class zm::RoutineCache<6>;
+template class zm::RoutineCache<7>;
+template class zm::RoutineCache<8>;
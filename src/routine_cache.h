@@ -0,0 +1,74 @@
+#ifndef ZETAMACHINE_ROUTINE_CACHE_H
+#define ZETAMACHINE_ROUTINE_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "call_stack.h"
+#include "memory/memory.h"
+
+#define ROUTINE_CACHE_PAGE_BITS 8
+#define ROUTINE_CACHE_PAGE_SIZE (1 << ROUTINE_CACHE_PAGE_BITS)
+#define ROUTINE_CACHE_PAGE_MASK (ROUTINE_CACHE_PAGE_SIZE - 1)
+
+#define MAX_LOCALS 15
+
+namespace zm {
+    // What calling a routine needs to know, read once from its header
+    struct RoutineDescriptor {
+        address header; // The locals count byte
+        address entry; // First instruction
+        uint8_t locals;
+        bool dynamic; // In dynamic memory, so it can be rewritten
+        word defaults[MAX_LOCALS]; // Initial values of the locals (zero from version 5 on)
+
+        // The translation, once asked for, nullptr if the routine is interpreted
+        bool translated;
+        TranslatedRoutine *translation;
+    };
+
+    /*
+     * Routine descriptors, keyed by packed address and built on the first
+     * call. Descriptors of routines in dynamic memory are dropped when their
+     * header is written to.
+     */
+    template<uint8_t Version>
+    class RoutineCache : public WriteObserver {
+    public:
+        RoutineCache(Memory &memory, address static_memory_base, word routines_offset);
+        ~RoutineCache() override;
+
+        // Valid until the next fetch
+        RoutineDescriptor &fetch(word packed) {
+            auto &page = pages[packed >> ROUTINE_CACHE_PAGE_BITS];
+
+            if (page && page->slots[packed & ROUTINE_CACHE_PAGE_MASK]) {
+                return descriptors[page->slots[packed & ROUTINE_CACHE_PAGE_MASK] - 1];
+            }
+
+            return describe(packed);
+        }
+
+        void notify_write(uint32_t address, uint32_t length) override;
+
+    private:
+        // Descriptor index + 1 per packed address, 0 when not described yet
+        struct Page {
+            uint32_t slots[ROUTINE_CACHE_PAGE_SIZE];
+        };
+
+        Memory &memory;
+        address static_memory_base;
+        word routines_offset;
+
+        std::vector<std::unique_ptr<Page>> pages;
+        std::vector<RoutineDescriptor> descriptors;
+        std::vector<uint32_t> dropped; // Descriptors free for reuse
+        std::vector<word> watched;
+
+        RoutineDescriptor &describe(word packed);
+    };
+}
+
+#endif //ZETAMACHINE_ROUTINE_CACHE_H
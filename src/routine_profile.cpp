@@ -0,0 +1,207 @@
+#include "routine_profile.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace {
+    struct Totals {
+        uint64_t calls = 0;
+        uint64_t exclusive = 0;
+        uint64_t inclusive = 0;
+        uint64_t exclusive_ticks = 0;
+        uint64_t inclusive_ticks = 0;
+    };
+
+    double percent(uint64_t part, uint64_t total) {
+        return total ? 100.0 * static_cast<double>(part) / static_cast<double>(total) : 0.0;
+    }
+}
+
+zm::RoutineProfile::RoutineProfile() : nodes { Node { 0, 0, 0, 0, 1, 0, 0 } }, active { 0 } {
+    charged_ticks = ticks();
+}
+
+void zm::RoutineProfile::enter(uint32_t routine) {
+    charge();
+
+    uint32_t parent = active.back();
+    uint32_t index = nodes[parent].child;
+
+    while (index && nodes[index].routine != routine) {
+        index = nodes[index].sibling;
+    }
+
+    if (!index) {
+        index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(Node { routine, parent, 0, nodes[parent].child, 0, 0, 0 });
+        nodes[parent].child = index;
+    }
+
+    ++nodes[index].calls;
+    active.push_back(index);
+}
+
+void zm::RoutineProfile::leave() {
+    // The root frame is never left
+    if (active.size() > 1) {
+        charge();
+        active.pop_back();
+    }
+}
+
+bool zm::RoutineProfile::write(const std::string &path, uint8_t shift, uint32_t offset) const {
+    std::ofstream report(path);
+    std::ofstream folded(path + ".folded");
+
+    if (!report || !folded) {
+        return false;
+    }
+
+    auto name = [&](uint32_t routine) {
+        if (routine == 0) {
+            return std::string("main");
+        }
+
+        std::ostringstream out;
+        out << "0x" << std::hex << std::setw(4) << std::setfill('0') << ((routine - offset) >> shift);
+        return out.str();
+    };
+
+    // What has run since the last call or return belongs to the routine on top
+    std::vector<uint64_t> exclusive(nodes.size());
+    std::vector<uint64_t> exclusive_ticks(nodes.size());
+
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        exclusive[i] = nodes[i].exclusive;
+        exclusive_ticks[i] = nodes[i].exclusive_ticks;
+    }
+
+    exclusive[active.back()] += clock - charged;
+
+    if (timed) {
+        exclusive_ticks[active.back()] += ticks() - charged_ticks;
+    }
+
+    // Children come after their parent, so one backwards pass sums every subtree
+    std::vector<uint64_t> inclusive(exclusive);
+    std::vector<uint64_t> inclusive_ticks(exclusive_ticks);
+
+    for (size_t i = nodes.size() - 1; i > 0; --i) {
+        inclusive[nodes[i].parent] += inclusive[i];
+        inclusive_ticks[nodes[i].parent] += inclusive_ticks[i];
+    }
+
+    std::map<uint32_t, Totals> routines;
+    std::map<std::pair<uint32_t, uint32_t>, Totals> edges;
+
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        const Node &node = nodes[i];
+        Totals &totals = routines[node.routine];
+
+        totals.calls += node.calls;
+        totals.exclusive += exclusive[i];
+        totals.exclusive_ticks += exclusive_ticks[i];
+
+        // Recursive calls are already inside the inclusive count of the outermost one
+        bool outermost = true;
+
+        for (uint32_t up = i; up != 0 && outermost; ) {
+            up = nodes[up].parent;
+            outermost = nodes[up].routine != node.routine;
+        }
+
+        if (outermost) {
+            totals.inclusive += inclusive[i];
+            totals.inclusive_ticks += inclusive_ticks[i];
+        }
+
+        if (i != 0) {
+            Totals &edge = edges[{ nodes[node.parent].routine, node.routine }];
+            edge.calls += node.calls;
+            edge.inclusive += inclusive[i];
+        }
+    }
+
+    std::vector<std::pair<uint32_t, Totals>> order(routines.begin(), routines.end());
+    std::sort(order.begin(), order.end(), [](const std::pair<uint32_t, Totals> &a, const std::pair<uint32_t, Totals> &b) {
+        return a.second.exclusive > b.second.exclusive;
+    });
+
+    uint64_t total = inclusive[0];
+
+    report << "Routines by exclusive instructions, " << total << " in total" << (timed ? ", times in " TICKS_UNIT " ticks" : "") << "\n\n";
+    report << std::setw(10) << "routine" << std::setw(12) << "calls" << std::setw(16) << "exclusive" << std::setw(8) << "%"
+           << std::setw(16) << "inclusive" << std::setw(8) << "%";
+
+    if (timed) {
+        report << std::setw(18) << "exclusive time" << std::setw(18) << "inclusive time";
+    }
+
+    report << "\n" << std::fixed << std::setprecision(2);
+
+    for (const auto &entry : order) {
+        const Totals &totals = entry.second;
+
+        report << std::setw(10) << name(entry.first) << std::setw(12) << totals.calls
+               << std::setw(16) << totals.exclusive << std::setw(8) << percent(totals.exclusive, total)
+               << std::setw(16) << totals.inclusive << std::setw(8) << percent(totals.inclusive, total);
+
+        if (timed) {
+            report << std::setw(18) << totals.exclusive_ticks << std::setw(18) << totals.inclusive_ticks;
+        }
+
+        report << "\n";
+    }
+
+    // Each routine with its callers above and its callees below, gprof style
+    report << "\nCall graph, instructions inclusive of the callee\n";
+
+    for (const auto &entry : order) {
+        report << "\n";
+
+        for (const auto &edge : edges) {
+            if (edge.first.second == entry.first) {
+                report << "  <- " << std::setw(10) << name(edge.first.first) << std::setw(12) << edge.second.calls
+                       << std::setw(16) << edge.second.inclusive << "\n";
+            }
+        }
+
+        report << "     " << std::setw(10) << name(entry.first) << std::setw(12) << entry.second.calls
+               << std::setw(16) << entry.second.inclusive << "\n";
+
+        for (const auto &edge : edges) {
+            if (edge.first.first == entry.first) {
+                report << "  -> " << std::setw(10) << name(edge.first.second) << std::setw(12) << edge.second.calls
+                       << std::setw(16) << edge.second.inclusive << "\n";
+            }
+        }
+    }
+
+    // One line per calling context: its frames from the root, then its exclusive instructions
+    for (uint32_t i = 0; i < nodes.size(); ++i) {
+        if (exclusive[i] == 0) {
+            continue;
+        }
+
+        std::vector<uint32_t> path;
+
+        for (uint32_t up = i; ; up = nodes[up].parent) {
+            path.push_back(nodes[up].routine);
+
+            if (up == 0) {
+                break;
+            }
+        }
+
+        for (auto frame = path.rbegin(); frame != path.rend(); ++frame) {
+            folded << (frame == path.rbegin() ? "" : ";") << name(*frame);
+        }
+
+        folded << " " << exclusive[i] << "\n";
+    }
+
+    return static_cast<bool>(report) && static_cast<bool>(folded);
+}
@@ -0,0 +1,71 @@
+#ifndef ZETAMACHINE_ROUTINE_PROFILE_H
+#define ZETAMACHINE_ROUTINE_PROFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "timer.h"
+
+namespace zm {
+    /*
+     * Executed instructions per routine, charged along a calling context
+     * tree: one node per distinct chain of calls, entered and left by the
+     * call stack. Exclusive counts, inclusive counts, caller to callee edges
+     * and folded stacks all come out of the tree when it is written, so a
+     * call only has to find or add a child of the current node.
+     */
+    class RoutineProfile {
+    public:
+        RoutineProfile();
+
+        // Also reads the clock on every call and return, for time per routine
+        void set_timed(bool timed) { this->timed = timed; }
+
+        void step() { ++clock; }
+        void step(uint64_t executed) { clock += executed; }
+
+        void enter(uint32_t routine);
+        void leave();
+
+        /*
+         * Writes the call graph report to path and the folded stacks, for
+         * flame graphs, to path.folded. Routines are named by packed address:
+         * (address - offset) >> shift.
+         */
+        bool write(const std::string &path, uint8_t shift, uint32_t offset) const;
+
+    private:
+        struct Node {
+            uint32_t routine; // Byte address, 0 for the root
+            uint32_t parent;
+            uint32_t child; // First child, 0 for none
+            uint32_t sibling;
+            uint64_t calls;
+            uint64_t exclusive;
+            uint64_t exclusive_ticks;
+        };
+
+        std::vector<Node> nodes;
+        std::vector<uint32_t> active; // Node of every frame from the root on
+
+        bool timed = false;
+        uint64_t clock = 0;
+        uint64_t charged = 0; // Clock when the current node was last charged
+        uint64_t charged_ticks = 0;
+
+        void charge() {
+            Node &node = nodes[active.back()];
+            node.exclusive += clock - charged;
+            charged = clock;
+
+            if (timed) {
+                uint64_t now = ticks();
+                node.exclusive_ticks += now - charged_ticks;
+                charged_ticks = now;
+            }
+        }
+    };
+}
+
+#endif //ZETAMACHINE_ROUTINE_PROFILE_H
@@ -0,0 +1,126 @@
+#include "sample_profile.h"
+
+#include <csignal>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+#include <sys/time.h>
+
+std::atomic<zm::SampleProfile *> zm::SampleProfile::active { nullptr };
+thread_local zm::SampleProfile *zm::SampleProfile::here = nullptr;
+
+/*
+ * Runs in the signal handler: it only reads the interrupted session and
+ * writes the ring. The stack is read as it is at that instant, without
+ * locking, and deeper frames than SAMPLE_DEPTH are left out. Ticks on other
+ * threads, or while the frames move, are dropped.
+ */
+void zm::SampleProfile::tick(int) {
+    SampleProfile *profile = active.load(std::memory_order_acquire);
+
+    if (!profile || here != profile || profile->stack->moving()) {
+        return;
+    }
+
+    uint64_t position = profile->head.load(std::memory_order_relaxed);
+    Sample &sample = profile->samples[position & SAMPLE_MASK];
+    const CallStack &stack = *profile->stack;
+
+    size_t frames = stack.size();
+    sample.pc = *profile->pc;
+    sample.depth = 0;
+    sample.frames = static_cast<uint16_t>(frames < 0xFFFF ? frames : 0xFFFF);
+
+    for (size_t i = frames; i > 0 && sample.depth < SAMPLE_DEPTH; --i) {
+        sample.routines[sample.depth++] = stack.get_frame(i - 1).start;
+    }
+
+    profile->head.store(position + 1, std::memory_order_release);
+}
+
+bool zm::SampleProfile::start(const address *pc, const CallStack *stack) {
+    SampleProfile *idle = nullptr;
+
+    if (!active.compare_exchange_strong(idle, this)) {
+        return false;
+    }
+
+    this->pc = pc;
+    this->stack = stack;
+
+    struct sigaction action {};
+    action.sa_handler = tick;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, nullptr);
+
+    itimerval timer {};
+    timer.it_interval.tv_usec = SAMPLE_INTERVAL_US;
+    timer.it_value.tv_usec = SAMPLE_INTERVAL_US;
+
+    if (setitimer(ITIMER_PROF, &timer, nullptr) != 0) {
+        active.store(nullptr);
+        return false;
+    }
+
+    running = true;
+    return true;
+}
+
+void zm::SampleProfile::stop() {
+    if (!running) {
+        return;
+    }
+
+    itimerval timer {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    active.store(nullptr, std::memory_order_release);
+    running = false;
+}
+
+bool zm::SampleProfile::write(const std::string &path, uint8_t shift, uint32_t offset) {
+    stop();
+
+    std::ofstream file(path);
+
+    if (!file) {
+        return false;
+    }
+
+    // The bottom frame is the story's main routine, or no routine before version 6
+    auto name = [&](address routine, bool bottom) {
+        if (bottom) {
+            return std::string("main");
+        }
+
+        std::ostringstream out;
+        out << "0x" << std::hex << std::setw(4) << std::setfill('0') << ((routine - offset) >> shift);
+        return out.str();
+    };
+
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end > SAMPLE_CAPACITY ? end - SAMPLE_CAPACITY : 0;
+    std::map<std::string, uint64_t> stacks;
+
+    for (uint64_t i = begin; i < end; ++i) {
+        const Sample &sample = samples[i & SAMPLE_MASK];
+        std::ostringstream line;
+
+        for (uint32_t frame = sample.depth; frame > 0; --frame) {
+            bool bottom = frame == sample.depth && sample.depth == sample.frames;
+            line << (frame == sample.depth ? "" : ";") << name(sample.routines[frame - 1], bottom);
+        }
+
+        // The innermost entry is the program counter by byte address, already past the instruction running
+        line << ";@" << std::hex << sample.pc;
+        ++stacks[line.str()];
+    }
+
+    for (const auto &stack : stacks) {
+        file << stack.first << " " << stack.second << "\n";
+    }
+
+    return static_cast<bool>(file);
+}
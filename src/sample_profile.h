@@ -0,0 +1,72 @@
+#ifndef ZETAMACHINE_SAMPLE_PROFILE_H
+#define ZETAMACHINE_SAMPLE_PROFILE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "call_stack.h"
+
+// Samples kept, the latest ones, a power of two
+#define SAMPLE_CAPACITY_BITS 14
+#define SAMPLE_CAPACITY (1 << SAMPLE_CAPACITY_BITS)
+#define SAMPLE_MASK (SAMPLE_CAPACITY - 1)
+
+// Frames kept per sample, from the innermost out
+#define SAMPLE_DEPTH 32
+
+// Processor time between samples
+#define SAMPLE_INTERVAL_US 1000
+
+namespace zm {
+    struct Sample {
+        address pc;
+        uint16_t depth; // Frames kept
+        uint16_t frames; // Frames on the call stack, saturated
+        address routines[SAMPLE_DEPTH]; // Start of the routine of every frame, innermost first
+    };
+
+    /*
+     * Statistical profile of a session: SIGPROF, every SAMPLE_INTERVAL_US of
+     * processor time, copies the program counter and the routines on the call
+     * stack into a ring allocated up front. Nothing runs between ticks, so it
+     * can be turned on against any session. One session is sampled at a time.
+     *
+     * The timer counts the time of the whole process, and its signal may land
+     * on any thread. Ticks are only taken on the thread running the session,
+     * between enter() and leave(), so the call stack is never read while
+     * another thread changes it.
+     */
+    class SampleProfile {
+    public:
+        SampleProfile() : samples(new Sample[SAMPLE_CAPACITY]) { }
+        ~SampleProfile() { stop(); }
+
+        // Starts the timer, pc and stack are read on every tick
+        bool start(const address *pc, const CallStack *stack);
+        void stop();
+
+        // Around running the session, on the thread that runs it
+        void enter() { here = this; }
+        void leave() { here = nullptr; }
+
+        // Folded stacks, one line per distinct stack with the number of samples in it
+        bool write(const std::string &path, uint8_t shift, uint32_t offset);
+
+    private:
+        std::unique_ptr<Sample[]> samples;
+        std::atomic<uint64_t> head { 0 };
+
+        const address *pc = nullptr;
+        const CallStack *stack = nullptr;
+        bool running = false;
+
+        static std::atomic<SampleProfile *> active;
+        static thread_local SampleProfile *here;
+
+        static void tick(int signal);
+    };
+}
+
+#endif //ZETAMACHINE_SAMPLE_PROFILE_H
@@ -0,0 +1,273 @@
+#include "scheduler.h"
+
+#include <algorithm>
+
+void zm::SessionOutput::print(const std::string &text) {
+    std::lock_guard<std::mutex> lock(mutex);
+    contents += text;
+
+    // Trimmed in large steps, so appending stays cheap
+    if (limit != 0 && contents.size() > limit << 1) {
+        contents.erase(0, contents.size() - limit);
+    }
+}
+
+std::string zm::SessionOutput::take() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string text;
+    text.swap(contents);
+    return text;
+}
+
+zm::Scheduler::Scheduler(unsigned workers, uint64_t slice, const zm::Options &options) : slice(std::max<uint64_t>(slice, 1)), options(options) {
+    workers = std::max(workers, 1u);
+
+    for (unsigned i = 0; i < workers; ++i) {
+        queues.emplace_back(new Queue());
+    }
+
+    for (unsigned i = 0; i < workers; ++i) {
+        this->workers.emplace_back(&Scheduler::work_on, this, i);
+    }
+}
+
+zm::Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        stopping = true;
+    }
+
+    work.notify_all();
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+zm::SessionId zm::Scheduler::add(const std::vector<uint8_t> &story) {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    std::unique_ptr<Session> session { new Session(last_id + 1) };
+
+    session->machine.configure(options);
+    session->machine.attach(&session->output, &session->input);
+
+    if (!session->machine.load(story)) {
+        return 0;
+    }
+
+    Session *started = session.get();
+    sessions.emplace(++last_id, std::move(session));
+    enqueue(started, next_queue++ % queues.size(), true);
+
+    return last_id;
+}
+
+void zm::Scheduler::send(zm::SessionId id, const std::string &line) {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    auto found = sessions.find(id);
+
+    if (found != sessions.end()) {
+        found->second->input.push_line(line);
+        wake(*found->second);
+    }
+}
+
+void zm::Scheduler::close(zm::SessionId id) {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    auto found = sessions.find(id);
+
+    if (found != sessions.end()) {
+        found->second->input.close();
+        wake(*found->second);
+    }
+}
+
+bool zm::Scheduler::remove(zm::SessionId id) {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    auto found = sessions.find(id);
+
+    if (found == sessions.end()) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> session_lock(found->second->mutex);
+
+        if (found->second->state != SessionState::PARKED && found->second->state != SessionState::FINISHED) {
+            return false;
+        }
+    }
+
+    sessions.erase(found);
+    return true;
+}
+
+std::string zm::Scheduler::take_output(zm::SessionId id) {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    auto found = sessions.find(id);
+
+    return found != sessions.end() ? found->second->output.take() : "";
+}
+
+zm::SessionState zm::Scheduler::state(zm::SessionId id) {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    auto found = sessions.find(id);
+
+    if (found == sessions.end()) {
+        return SessionState::UNKNOWN;
+    }
+
+    std::lock_guard<std::mutex> session_lock(found->second->mutex);
+    return found->second->state;
+}
+
+uint64_t zm::Scheduler::instructions(zm::SessionId id) {
+    std::lock_guard<std::mutex> lock(sessions_mutex);
+    auto found = sessions.find(id);
+
+    if (found == sessions.end()) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> session_lock(found->second->mutex);
+    return found->second->instructions;
+}
+
+void zm::Scheduler::wait() {
+    std::unique_lock<std::mutex> lock(idle_mutex);
+    idle.wait(lock, [this]() { return active == 0; });
+}
+
+zm::SchedulerStats zm::Scheduler::get_stats() const {
+    return { total_instructions.load(), slices.load(), steals.load(), parks.load() };
+}
+
+void zm::Scheduler::work_on(unsigned index) {
+    while (!stopping) {
+        Session *session = take(index);
+
+        if (!session) {
+            std::unique_lock<std::mutex> lock(idle_mutex);
+            work.wait(lock, [this]() { return stopping || queued > 0; });
+
+            if (stopping) {
+                return;
+            }
+
+            continue;
+        }
+
+        // Nothing else touches a running session's machine, so it runs unlocked
+        RunResult result = session->machine.run_for(slice);
+        total_instructions += result.instructions;
+        ++slices;
+
+        SessionId id = session->id;
+        SessionState state;
+
+        {
+            std::lock_guard<std::mutex> lock(session->mutex);
+            session->instructions += result.instructions;
+
+            /*
+             * A line sent before the lock is seen by ready() here; one sent
+             * after it finds the session parked and queues it again.
+             */
+            if (result.status == RunStatus::QUIT || result.status == RunStatus::ERROR) {
+                state = SessionState::FINISHED;
+            } else if (result.status != RunStatus::BUDGET && !session->input.ready()) {
+                state = SessionState::PARKED;
+            } else {
+                state = SessionState::RUNNABLE;
+            }
+
+            session->state = state;
+        }
+
+        if (state == SessionState::RUNNABLE) {
+            enqueue(session, index, false);
+            continue;
+        }
+
+        // Parked or finished, it may be removed from here on, and is only known by its id
+        parks += state == SessionState::PARKED;
+
+        if (stopped) {
+            stopped(id, state);
+        }
+
+        deactivate();
+    }
+}
+
+zm::Scheduler::Session *zm::Scheduler::take(unsigned index) {
+    Session *session = nullptr;
+
+    {
+        Queue &own = *queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+
+        if (!own.sessions.empty()) {
+            session = own.sessions.front();
+            own.sessions.pop_front();
+        }
+    }
+
+    // Steal the session the victim would run last
+    for (size_t i = 1; !session && i < queues.size(); ++i) {
+        Queue &victim = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.sessions.empty()) {
+            session = victim.sessions.back();
+            victim.sessions.pop_back();
+            ++steals;
+        }
+    }
+
+    if (session) {
+        {
+            std::lock_guard<std::mutex> lock(session->mutex);
+            session->state = SessionState::RUNNING;
+        }
+
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        --queued;
+    }
+
+    return session;
+}
+
+void zm::Scheduler::enqueue(zm::Scheduler::Session *session, unsigned index, bool activate) {
+    {
+        Queue &queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.sessions.push_back(session);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(idle_mutex);
+        ++queued;
+        active += activate;
+    }
+
+    work.notify_one();
+}
+
+// Called with the sessions locked, so the session can not be removed meanwhile
+void zm::Scheduler::wake(zm::Scheduler::Session &session) {
+    std::lock_guard<std::mutex> lock(session.mutex);
+
+    if (session.state == SessionState::PARKED) {
+        session.state = SessionState::RUNNABLE;
+        enqueue(&session, next_queue++ % queues.size(), true);
+    }
+}
+
+void zm::Scheduler::deactivate() {
+    std::lock_guard<std::mutex> lock(idle_mutex);
+
+    if (--active == 0) {
+        idle.notify_all();
+    }
+}
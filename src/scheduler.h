@@ -0,0 +1,148 @@
+#ifndef ZETAMACHINE_SCHEDULER_H
+#define ZETAMACHINE_SCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "input.h"
+#include "machine.h"
+#include "options.h"
+#include "video.h"
+
+namespace zm {
+    using SessionId = uint32_t;
+
+    // What a session printed and nobody took yet, at most about limit characters of it
+    class SessionOutput : public Video {
+    public:
+        explicit SessionOutput(size_t limit = 0) : limit(limit) { }
+
+        void print(const std::string &text) override;
+
+        std::string take();
+
+    private:
+        std::mutex mutex;
+        size_t limit;
+        std::string contents;
+    };
+
+    enum class SessionState {
+        RUNNABLE, // Queued on a worker
+        RUNNING,
+        PARKED, // Waiting for input, on no worker
+        FINISHED,
+        UNKNOWN // No such session
+    };
+
+    struct SchedulerStats {
+        uint64_t instructions;
+        uint64_t slices;
+        uint64_t steals;
+        uint64_t parks;
+    };
+
+    /*
+     * Runs many sessions on a fixed number of worker threads. Every worker
+     * has a deque of runnable sessions: it runs the oldest one for a slice of
+     * Z instructions, then queues it again at the back. Idle workers steal
+     * from the back of the others. A session that waits for input is parked
+     * off all deques, and queued again when a line is sent to it.
+     */
+    class Scheduler {
+    public:
+        Scheduler(unsigned workers, uint64_t slice, const Options &options = Options());
+
+        // Stops the workers after their current slice, whatever is still runnable
+        ~Scheduler();
+
+        Scheduler(const Scheduler &) = delete;
+        Scheduler &operator=(const Scheduler &) = delete;
+
+        /*
+         * Called on a worker whenever a session parks or finishes, before
+         * wait() can see it stopped. Lines sent from here are not missed.
+         * Set it before adding sessions.
+         */
+        void on_stop(std::function<void(SessionId, SessionState)> callback) { stopped = std::move(callback); }
+
+        // Starts a session of the story, 0 when the story can not be loaded
+        SessionId add(const std::vector<uint8_t> &story);
+
+        void send(SessionId id, const std::string &line);
+        void close(SessionId id);
+
+        // Only sessions that are parked or finished are removed
+        bool remove(SessionId id);
+
+        std::string take_output(SessionId id);
+        SessionState state(SessionId id);
+        uint64_t instructions(SessionId id);
+
+        // Until no session is runnable: all of them are parked or finished
+        void wait();
+
+        SchedulerStats get_stats() const;
+
+    private:
+        struct Session {
+            SessionId id;
+            QueuedInput input;
+            SessionOutput output;
+            Machine machine;
+
+            std::mutex mutex; // Guards state against a line sent while the session stops
+            SessionState state = SessionState::RUNNABLE;
+            uint64_t instructions = 0;
+
+            explicit Session(SessionId id) : id(id), output(1 << 16) { }
+        };
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Session *> sessions;
+        };
+
+        uint64_t slice;
+        Options options;
+        std::function<void(SessionId, SessionState)> stopped;
+
+        std::mutex sessions_mutex;
+        std::unordered_map<SessionId, std::unique_ptr<Session>> sessions;
+        SessionId last_id = 0;
+
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> workers;
+        std::atomic<unsigned> next_queue { 0 };
+
+        // Counts sessions queued, and queued or running, so idle workers and wait() know when to wake
+        std::mutex idle_mutex;
+        std::condition_variable work;
+        std::condition_variable idle;
+        int64_t queued = 0;
+        int64_t active = 0;
+        std::atomic<bool> stopping { false };
+
+        std::atomic<uint64_t> total_instructions { 0 };
+        std::atomic<uint64_t> slices { 0 };
+        std::atomic<uint64_t> steals { 0 };
+        std::atomic<uint64_t> parks { 0 };
+
+        void work_on(unsigned index);
+        Session *take(unsigned index);
+        void enqueue(Session *session, unsigned index, bool activate);
+        void wake(Session &session);
+        void deactivate();
+    };
+}
+
+#endif //ZETAMACHINE_SCHEDULER_H
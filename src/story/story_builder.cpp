@@ -0,0 +1,717 @@
+#include "spdlog/spdlog.h"
+
+#include "story_builder.h"
+
+#include <algorithm>
+#include <cstring>
+
+// The third alphabet from version 2 on, from Z-character 7
+static const char *alphabet_punctuation = "\n0123456789.,!?_#'\"/\\-:()";
+
+template<uint8_t Version>
+constexpr zm::Label zm::StoryBuilder<Version>::RETURN_FALSE;
+
+template<uint8_t Version>
+constexpr zm::Label zm::StoryBuilder<Version>::RETURN_TRUE;
+
+template<uint8_t Version>
+zm::StoryBuilder<Version>::StoryBuilder() {
+    std::fill(std::begin(defaults), std::end(defaults), 0);
+    std::fill(std::begin(globals), std::end(globals), 0);
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::fail(const std::string &message) {
+    spdlog::error("Could not build the story: {}", message);
+    failed = true;
+}
+
+// ------ Text ------
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::abbreviate(const std::string &text) {
+    if (abbreviations.size() == 96 || text.empty()) {
+        fail("at most 96 abbreviations, none of them empty");
+        return;
+    }
+
+    abbreviations.push_back(text);
+}
+
+template<uint8_t Version>
+std::vector<uint8_t> zm::StoryBuilder<Version>::zchars(const std::string &text, bool abbreviated) const {
+    std::vector<uint8_t> result;
+
+    for (size_t i = 0; i < text.size(); ) {
+        // The longest abbreviation that matches here, if any
+        int abbreviation = -1;
+        size_t length = 0;
+
+        for (size_t candidate = 0; abbreviated && candidate < abbreviations.size(); ++candidate) {
+            const std::string &expansion = abbreviations[candidate];
+
+            if (expansion.size() > length && text.compare(i, expansion.size(), expansion) == 0) {
+                abbreviation = static_cast<int>(candidate);
+                length = expansion.size();
+            }
+        }
+
+        if (abbreviation >= 0) {
+            result.push_back(static_cast<uint8_t>(1 + (abbreviation >> 5)));
+            result.push_back(static_cast<uint8_t>(abbreviation & 0x1F));
+            i += length;
+            continue;
+        }
+
+        char character = text[i++];
+        const char *punctuation = character ? std::strchr(alphabet_punctuation, character) : nullptr;
+
+        if (character == ' ') {
+            result.push_back(0);
+        } else if (character >= 'a' && character <= 'z') {
+            result.push_back(static_cast<uint8_t>(character - 'a' + 6));
+        } else if (character >= 'A' && character <= 'Z') {
+            result.push_back(4);
+            result.push_back(static_cast<uint8_t>(character - 'A' + 6));
+        } else if (punctuation) {
+            result.push_back(5);
+            result.push_back(static_cast<uint8_t>(7 + (punctuation - alphabet_punctuation)));
+        } else {
+            // Spelled out as a 10-bit ZSCII escape
+            result.push_back(5);
+            result.push_back(6);
+            result.push_back((static_cast<uint8_t>(character) >> 5) & 0x1F);
+            result.push_back(static_cast<uint8_t>(character) & 0x1F);
+        }
+    }
+
+    return result;
+}
+
+// Packs Z-characters three to a word, padded with 5s, the last word marked
+static std::vector<uint8_t> pack(std::vector<uint8_t> zchars) {
+    zchars.resize(std::max<size_t>(3, (zchars.size() + 2) / 3 * 3), 5);
+
+    std::vector<uint8_t> bytes;
+
+    for (size_t i = 0; i < zchars.size(); i += 3) {
+        uint16_t word = static_cast<uint16_t>((zchars[i] << 10) | (zchars[i + 1] << 5) | zchars[i + 2]);
+
+        if (i + 3 == zchars.size()) {
+            word |= 0x8000;
+        }
+
+        bytes.push_back(static_cast<uint8_t>(word >> 8));
+        bytes.push_back(static_cast<uint8_t>(word & 0xFF));
+    }
+
+    return bytes;
+}
+
+template<uint8_t Version>
+std::vector<uint8_t> zm::StoryBuilder<Version>::encode(const std::string &text, bool abbreviated) const {
+    return pack(zchars(text, abbreviated));
+}
+
+template<uint8_t Version>
+std::vector<uint8_t> zm::StoryBuilder<Version>::encode_word(const std::string &text) const {
+    auto result = zchars(text, false);
+    result.resize(Traits::dictionary_word_zchars, 5);
+
+    return pack(result);
+}
+
+// ------ Objects and data ------
+
+template<uint8_t Version>
+uint16_t zm::StoryBuilder<Version>::add_object(const std::string &name, uint16_t parent) {
+    if (objects.size() == (Traits::small_objects ? 255u : 65535u) || parent > objects.size()) {
+        fail("too many objects, or a parent that does not exist yet");
+        return 0;
+    }
+
+    Object object {};
+    object.name = name;
+    object.parent = parent;
+    objects.push_back(object);
+
+    auto number = static_cast<uint16_t>(objects.size());
+
+    if (parent != 0) {
+        uint16_t *link = &objects[parent - 1].child;
+
+        while (*link != 0) {
+            link = &objects[*link - 1].sibling;
+        }
+
+        *link = number;
+    }
+
+    return number;
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::set_attribute(uint16_t object, uint8_t attribute) {
+    if (object == 0 || object > objects.size() || attribute >= Traits::attribute_count) {
+        fail("no such object or attribute");
+        return;
+    }
+
+    objects[object - 1].attributes[attribute >> 3] |= 0x80 >> (attribute & 0x07);
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::set_property(uint16_t object, uint8_t property, const std::vector<uint8_t> &data) {
+    if (object == 0 || object > objects.size() || property == 0 || property > Traits::property_defaults ||
+        data.empty() || data.size() > (Traits::small_objects ? 8u : 64u)) {
+        fail("no such object or property, or a property of the wrong length");
+        return;
+    }
+
+    objects[object - 1].properties[property] = data;
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::set_property(uint16_t object, uint8_t property, uint16_t value) {
+    set_property(object, property, std::vector<uint8_t> { static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value & 0xFF) });
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::set_default(uint8_t property, uint16_t value) {
+    if (property == 0 || property > Traits::property_defaults) {
+        fail("no such property");
+        return;
+    }
+
+    defaults[property - 1] = value;
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::set_global(uint8_t global, uint16_t value) {
+    if (global >= 240) {
+        fail("no such global");
+        return;
+    }
+
+    globals[global] = value;
+}
+
+template<uint8_t Version>
+zm::Argument zm::StoryBuilder<Version>::word(const std::string &text) {
+    auto found = words.find(text);
+
+    if (found != words.end()) {
+        return { Reference::WORD, found->second };
+    }
+
+    auto index = static_cast<uint16_t>(word_texts.size());
+    words[text] = index;
+    word_texts.push_back(text);
+
+    return { Reference::WORD, index };
+}
+
+template<uint8_t Version>
+zm::Argument zm::StoryBuilder<Version>::array(uint16_t length, const std::vector<uint8_t> &initial) {
+    std::vector<uint8_t> contents(std::max<size_t>(length, initial.size()), 0);
+    std::copy(initial.begin(), initial.end(), contents.begin());
+    arrays.push_back(contents);
+
+    return { Reference::ARRAY, static_cast<uint16_t>(arrays.size() - 1) };
+}
+
+template<uint8_t Version>
+zm::Argument zm::StoryBuilder<Version>::string(const std::string &text) {
+    strings.push_back(text);
+
+    return { Reference::STRING, static_cast<uint16_t>(strings.size() - 1) };
+}
+
+// ------ Routines ------
+
+template<uint8_t Version>
+zm::Argument zm::StoryBuilder<Version>::routine() {
+    routines.push_back(Routine {});
+
+    return { Reference::ROUTINE, static_cast<uint16_t>(routines.size() - 1) };
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::begin(const Argument &routine, uint8_t locals, const std::vector<uint16_t> &defaults) {
+    finish_routine();
+
+    if (routine.reference != Reference::ROUTINE || routines[routine.value].defined || locals > 15 || defaults.size() > locals) {
+        fail("a routine defined twice, or with more than 15 locals");
+        return;
+    }
+
+    current = routine.value;
+    routines[current].defined = true;
+
+    auto &code = routines[current].code;
+    code.push_back(locals);
+
+    // Only versions up to 4 store initial values, the others start at zero
+    for (uint8_t i = 0; Traits::routine_default_locals && i < locals; ++i) {
+        uint16_t value = i < defaults.size() ? defaults[i] : 0;
+        code.push_back(static_cast<uint8_t>(value >> 8));
+        code.push_back(static_cast<uint8_t>(value & 0xFF));
+    }
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::begin_main(uint8_t locals) {
+    if (main_routine >= 0) {
+        fail("two main routines");
+        return;
+    }
+
+    if (Version != 6 && locals > 0) {
+        fail("locals in a main routine before version 6");
+        return;
+    }
+
+    Argument main = routine();
+    main_routine = main.value;
+    begin(main, locals);
+}
+
+template<uint8_t Version>
+zm::Label zm::StoryBuilder<Version>::label() {
+    label_offsets.push_back(-1);
+
+    return { static_cast<uint32_t>(label_offsets.size() - 1) };
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::bind(Label label) {
+    if (current < 0 || label.index >= label_offsets.size() || label_offsets[label.index] >= 0) {
+        fail("a label bound twice, or outside a routine");
+        return;
+    }
+
+    label_offsets[label.index] = static_cast<int64_t>(routines[current].code.size());
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::finish_routine() {
+    if (current < 0) {
+        return;
+    }
+
+    auto &code = routines[current].code;
+
+    // Branch and jump offsets count from the end of the instruction, minus 2
+    for (const auto &fixup : routines[current].labels) {
+        int64_t target = fixup.label < label_offsets.size() ? label_offsets[fixup.label] : -1;
+        int64_t offset = target - static_cast<int64_t>(fixup.offset);
+
+        if (target < 0 || (!fixup.jump && (offset < -8192 || offset > 8191))) {
+            fail("a label that was never bound, or is out of reach of a branch");
+            continue;
+        }
+
+        if (fixup.jump) {
+            code[fixup.offset] = static_cast<uint8_t>((offset >> 8) & 0xFF);
+        } else {
+            code[fixup.offset] = static_cast<uint8_t>((code[fixup.offset] & 0x80) | ((offset >> 8) & 0x3F));
+        }
+
+        code[fixup.offset + 1] = static_cast<uint8_t>(offset & 0xFF);
+    }
+
+    routines[current].labels.clear();
+    label_offsets.clear();
+    current = -1;
+}
+
+// ------ Instructions ------
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::op(Mnemonic mnemonic, const std::vector<Argument> &arguments) {
+    emit(mnemonic, arguments, nullptr, nullptr);
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::op(Mnemonic mnemonic, const std::vector<Argument> &arguments, Variable store) {
+    emit(mnemonic, arguments, &store, nullptr);
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::op(Mnemonic mnemonic, const std::vector<Argument> &arguments, Branch branch) {
+    emit(mnemonic, arguments, nullptr, &branch);
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::op(Mnemonic mnemonic, const std::vector<Argument> &arguments, Variable store, Branch branch) {
+    emit(mnemonic, arguments, &store, &branch);
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::print(const std::string &text, bool ret) {
+    emit(ret ? Mnemonic::PRINT_RET : Mnemonic::PRINT, {}, nullptr, nullptr);
+
+    if (current >= 0) {
+        auto encoded = encode(text);
+        auto &code = routines[current].code;
+        code.insert(code.end(), encoded.begin(), encoded.end());
+    }
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::jump(Label label) {
+    if (current < 0) {
+        fail("an instruction outside a routine");
+        return;
+    }
+
+    auto &code = routines[current].code;
+    code.push_back(0x8C);
+    routines[current].labels.push_back({ static_cast<uint32_t>(code.size()), label.index, true });
+    code.push_back(0);
+    code.push_back(0);
+}
+
+// Operand types: 00 a word, 01 a byte, 10 a variable
+static uint8_t operand_type(const zm::Argument &argument) {
+    if (argument.variable) {
+        return 0x02;
+    }
+
+    return argument.reference == zm::Reference::NONE && argument.value <= 0xFF ? 0x01 : 0x00;
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::emit_argument(const Argument &argument, bool large) {
+    auto &code = routines[current].code;
+
+    if (argument.reference != Reference::NONE) {
+        routines[current].fixups.push_back({ static_cast<uint32_t>(code.size()), argument.reference, argument.value });
+    }
+
+    if (large) {
+        code.push_back(static_cast<uint8_t>(argument.value >> 8));
+    }
+
+    code.push_back(static_cast<uint8_t>(argument.value & 0xFF));
+}
+
+template<uint8_t Version>
+void zm::StoryBuilder<Version>::emit(Mnemonic mnemonic, const std::vector<Argument> &arguments, const Variable *store, const Branch *branch) {
+    if (current < 0) {
+        fail("an instruction outside a routine");
+        return;
+    }
+
+    // Where the opcode lives in this version's tables
+    const OpcodeTable &table = InstructionTable<Version>::table;
+    const Instruction *instruction = nullptr;
+    uint8_t number = 0;
+
+    for (int i = 0; i < INSTRUCTION_SET_LENGTH && !instruction; ++i) {
+        bool form = i < 32 || (i >= 128 && i < 144) || (i >= 176 && i < 192 && i != 190) || i >= 224;
+
+        if (form && table.set[i].mnemonic == mnemonic && table.set[i].base_version <= Version) {
+            instruction = &table.set[i];
+            number = static_cast<uint8_t>(i < 128 ? i : (i < 224 ? i & 0x0F : i & 0x1F));
+        }
+    }
+
+    for (int i = 0; Version >= 5 && i < INSTRUCTION_SET_LENGTH && !instruction; ++i) {
+        if (table.extended_set[i].mnemonic == mnemonic && table.extended_set[i].base_version <= Version) {
+            instruction = &table.extended_set[i];
+            number = static_cast<uint8_t>(i);
+        }
+    }
+
+    if (!instruction || mnemonic == Mnemonic::NULL_OP) {
+        fail(std::string("no ") + mnemonic_name(mnemonic) + " in this version");
+        return;
+    }
+
+    if (instruction->store != (store != nullptr) || instruction->branch != (branch != nullptr)) {
+        fail(std::string(mnemonic_name(mnemonic)) + " stores or branches otherwise");
+        return;
+    }
+
+    auto &code = routines[current].code;
+    bool double_types = mnemonic == Mnemonic::CALL_VS2 || mnemonic == Mnemonic::CALL_VN2;
+    size_t maximum = instruction->opcode_type == OpcodeType::OP0 ? 0 : (instruction->opcode_type == OpcodeType::OP1 ? 1 : (double_types ? 8 : 4));
+
+    if (arguments.size() > maximum || (instruction->opcode_type == OpcodeType::OP1 && arguments.empty())) {
+        fail(std::string("wrong number of operands for ") + mnemonic_name(mnemonic));
+        return;
+    }
+
+    bool long_form = instruction->opcode_type == OpcodeType::OP2 && arguments.size() == 2 &&
+                     operand_type(arguments[0]) != 0x00 && operand_type(arguments[1]) != 0x00;
+
+    if (long_form) {
+        code.push_back(static_cast<uint8_t>((arguments[0].variable ? 0x40 : 0x00) | (arguments[1].variable ? 0x20 : 0x00) | number));
+    } else if (instruction->opcode_type == OpcodeType::OP1) {
+        code.push_back(static_cast<uint8_t>(0x80 | (operand_type(arguments[0]) << 4) | number));
+    } else if (instruction->opcode_type == OpcodeType::OP0) {
+        code.push_back(static_cast<uint8_t>(0xB0 | number));
+    } else {
+        if (instruction->opcode_type == OpcodeType::EXT) {
+            code.push_back(0xBE);
+            code.push_back(number);
+        } else {
+            code.push_back(static_cast<uint8_t>((instruction->opcode_type == OpcodeType::OP2 ? 0xC0 : 0xE0) | number));
+        }
+
+        // Four operand types to a byte, the unused ones omitted
+        for (size_t group = 0; group < (double_types ? 8u : 4u); group += 4) {
+            uint8_t types = 0;
+
+            for (size_t i = group; i < group + 4; ++i) {
+                types = static_cast<uint8_t>((types << 2) | (i < arguments.size() ? operand_type(arguments[i]) : 0x03));
+            }
+
+            code.push_back(types);
+        }
+    }
+
+    for (const auto &argument : arguments) {
+        emit_argument(argument, operand_type(argument) == 0x00);
+    }
+
+    if (store) {
+        code.push_back(store->number);
+    }
+
+    if (branch) {
+        uint8_t condition = branch->condition ? 0x80 : 0x00;
+
+        if (branch->label.index == RETURN_FALSE.index || branch->label.index == RETURN_TRUE.index) {
+            code.push_back(static_cast<uint8_t>(condition | 0x40 | (branch->label.index == RETURN_TRUE.index ? 1 : 0)));
+        } else {
+            routines[current].labels.push_back({ static_cast<uint32_t>(code.size()), branch->label.index, false });
+            code.push_back(condition);
+            code.push_back(0);
+        }
+    }
+}
+
+// ------ Layout ------
+
+template<uint8_t Version>
+std::vector<uint8_t> zm::StoryBuilder<Version>::build() {
+    finish_routine();
+
+    if (main_routine < 0) {
+        fail("no main routine");
+    }
+
+    for (const auto &routine : routines) {
+        if (!routine.defined) {
+            fail("a routine that was never defined");
+            break;
+        }
+    }
+
+    if (failed) {
+        return {};
+    }
+
+    std::vector<uint8_t> story(0x40, 0);
+
+    auto align = [&](uint32_t alignment) {
+        while (story.size() % alignment != 0) {
+            story.push_back(0);
+        }
+    };
+
+    auto put_word = [&](uint32_t address, uint32_t value) {
+        story[address] = static_cast<uint8_t>(value >> 8);
+        story[address + 1] = static_cast<uint8_t>(value & 0xFF);
+    };
+
+    auto append = [&](const std::vector<uint8_t> &bytes) {
+        story.insert(story.end(), bytes.begin(), bytes.end());
+    };
+
+    // Abbreviations, addressed by word
+    auto abbreviation_table = static_cast<uint32_t>(story.size());
+    story.resize(story.size() + 96 * 2, 0);
+
+    for (size_t i = 0; i < abbreviations.size(); ++i) {
+        align(2);
+        put_word(abbreviation_table + (i << 1), static_cast<uint32_t>(story.size() >> 1));
+        append(encode(abbreviations[i], false));
+    }
+
+    // Object table: property defaults, entries and then every object's properties
+    align(2);
+    auto object_table = static_cast<uint32_t>(story.size());
+
+    for (uint16_t value : defaults) {
+        story.push_back(static_cast<uint8_t>(value >> 8));
+        story.push_back(static_cast<uint8_t>(value & 0xFF));
+    }
+
+    auto entries = static_cast<uint32_t>(story.size());
+    story.resize(story.size() + objects.size() * Traits::object_entry_size, 0);
+
+    for (size_t i = 0; i < objects.size(); ++i) {
+        const Object &object = objects[i];
+        uint32_t entry = entries + static_cast<uint32_t>(i) * Traits::object_entry_size;
+
+        std::copy(object.attributes, object.attributes + Traits::object_attribute_bytes, story.begin() + entry);
+
+        uint16_t links[] = { object.parent, object.sibling, object.child };
+
+        for (int link = 0; link < 3; ++link) {
+            if (Traits::small_objects) {
+                story[entry + Traits::object_parent_offset + link] = static_cast<uint8_t>(links[link]);
+            } else {
+                put_word(entry + Traits::object_parent_offset + (link << 1), links[link]);
+            }
+        }
+
+        put_word(entry + Traits::object_properties_offset, static_cast<uint32_t>(story.size()));
+
+        auto name = object.name.empty() ? std::vector<uint8_t> {} : encode(object.name, false);
+        story.push_back(static_cast<uint8_t>(name.size() >> 1));
+        append(name);
+
+        // In descending order, each behind its size byte(s)
+        for (auto property = object.properties.rbegin(); property != object.properties.rend(); ++property) {
+            auto length = static_cast<uint8_t>(property->second.size());
+
+            if (Traits::small_objects) {
+                story.push_back(static_cast<uint8_t>(((length - 1) << 5) | property->first));
+            } else if (length <= 2) {
+                story.push_back(static_cast<uint8_t>((length == 2 ? 0x40 : 0x00) | property->first));
+            } else {
+                story.push_back(static_cast<uint8_t>(0x80 | property->first));
+                story.push_back(static_cast<uint8_t>(0x80 | (length & 0x3F)));
+            }
+
+            append(property->second);
+        }
+
+        story.push_back(0);
+    }
+
+    // Globals and tables, the rest of dynamic memory
+    align(2);
+    auto global_table = static_cast<uint32_t>(story.size());
+
+    for (uint16_t value : globals) {
+        story.push_back(static_cast<uint8_t>(value >> 8));
+        story.push_back(static_cast<uint8_t>(value & 0xFF));
+    }
+
+    std::vector<uint32_t> array_addresses;
+
+    for (const auto &contents : arrays) {
+        align(2);
+        array_addresses.push_back(static_cast<uint32_t>(story.size()));
+        append(contents);
+    }
+
+    // The dictionary opens static memory, its entries sorted by their encoded text
+    align(2);
+    auto static_base = static_cast<uint32_t>(story.size());
+    auto dictionary = static_base;
+    uint8_t entry_length = Traits::dictionary_word_bytes + 3;
+
+    append({ 3, '.', ',', '"', entry_length });
+    story.push_back(static_cast<uint8_t>(word_texts.size() >> 8));
+    story.push_back(static_cast<uint8_t>(word_texts.size() & 0xFF));
+
+    std::vector<std::pair<std::vector<uint8_t>, size_t>> sorted;
+
+    for (size_t i = 0; i < word_texts.size(); ++i) {
+        sorted.emplace_back(encode_word(word_texts[i]), i);
+    }
+
+    std::sort(sorted.begin(), sorted.end());
+
+    std::vector<uint32_t> word_addresses(word_texts.size());
+
+    for (const auto &entry : sorted) {
+        word_addresses[entry.second] = static_cast<uint32_t>(story.size());
+        append(entry.first);
+        story.resize(story.size() + 3, 0);
+    }
+
+    // High memory: the main routine, the other routines and the strings, on packed boundaries
+    uint32_t packing = 1u << Traits::packed_shift;
+    align(packing);
+    auto high_base = static_cast<uint32_t>(story.size());
+
+    std::vector<uint32_t> routine_addresses(routines.size());
+
+    for (size_t order = 0; order < routines.size(); ++order) {
+        // The main routine goes first
+        size_t i = order == 0 ? main_routine : (order <= static_cast<size_t>(main_routine) ? order - 1 : order);
+
+        align(packing);
+        routine_addresses[i] = static_cast<uint32_t>(story.size());
+        append(routines[i].code);
+    }
+
+    std::vector<uint32_t> string_addresses;
+
+    for (const auto &text : strings) {
+        align(packing);
+        string_addresses.push_back(static_cast<uint32_t>(story.size()));
+        append(encode(text));
+    }
+
+    uint32_t divisor = Version <= 3 ? 2 : (Version <= 5 ? 4 : 8);
+    align(divisor);
+
+    if (high_base > 0xFFFF || story.size() > 0xFFFFu * divisor || (story.size() >> Traits::packed_shift) > 0xFFFF) {
+        fail("too large for this version");
+        return {};
+    }
+
+    for (size_t i = 0; i < routines.size(); ++i) {
+        for (const auto &fixup : routines[i].fixups) {
+            uint32_t value = 0;
+
+            switch (fixup.reference) {
+                case Reference::ROUTINE : value = routine_addresses[fixup.index] >> Traits::packed_shift; break;
+                case Reference::STRING : value = string_addresses[fixup.index] >> Traits::packed_shift; break;
+                case Reference::WORD : value = word_addresses[fixup.index]; break;
+                case Reference::ARRAY : value = array_addresses[fixup.index]; break;
+                case Reference::NONE : break;
+            }
+
+            put_word(routine_addresses[i] + fixup.offset, value);
+        }
+    }
+
+    story[0x00] = Version;
+    put_word(0x02, 1);
+    put_word(0x04, high_base);
+    // Version 6 calls the main routine by packed address, the others start at its first instruction
+    put_word(0x06, Version == 6 ? routine_addresses[main_routine] >> Traits::packed_shift : routine_addresses[main_routine] + 1);
+    put_word(0x08, dictionary);
+    put_word(0x0A, object_table);
+    put_word(0x0C, global_table);
+    put_word(0x0E, static_base);
+    std::memcpy(&story[0x12], "000000", 6);
+    put_word(0x18, abbreviation_table);
+    put_word(0x1A, static_cast<uint32_t>(story.size() / divisor));
+
+    uint32_t checksum = 0;
+
+    for (size_t i = 0x40; i < story.size(); ++i) {
+        checksum += story[i];
+    }
+
+    put_word(0x1C, checksum & 0xFFFF);
+
+    return story;
+}
+
+template class zm::StoryBuilder<3>;
+template class zm::StoryBuilder<4>;
+template class zm::StoryBuilder<5>;
+template class zm::StoryBuilder<6>;
+template class zm::StoryBuilder<7>;
+template class zm::StoryBuilder<8>;
@@ -0,0 +1,180 @@
+#ifndef ZETAMACHINE_STORY_BUILDER_H
+#define ZETAMACHINE_STORY_BUILDER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "../instructions.h"
+#include "../version.h"
+
+namespace zm {
+    // A variable as an instruction names it: 0 is the stack, 1-15 locals, 16-255 globals
+    struct Variable {
+        uint8_t number;
+
+        static Variable stack() { return { 0 }; }
+        static Variable local(uint8_t local) { return { local }; }
+        static Variable global(uint8_t global) { return { static_cast<uint8_t>(0x10 + global) }; }
+    };
+
+    // What an argument stands for when its value is only known once the story is laid out
+    enum class Reference : uint8_t {
+        NONE,
+        ROUTINE, // Packed address
+        STRING, // Packed address
+        WORD, // Address of a dictionary entry
+        ARRAY // Address of a table in dynamic memory
+    };
+
+    // An operand of an assembled instruction
+    struct Argument {
+        bool variable;
+        uint16_t value; // Or the index of what it refers to
+        Reference reference;
+
+        Argument(int constant) : variable(false), value(static_cast<uint16_t>(constant)), reference(Reference::NONE) { }
+        Argument(Variable variable) : variable(true), value(variable.number), reference(Reference::NONE) { }
+        Argument(Reference reference, uint16_t index) : variable(false), value(index), reference(reference) { }
+
+        // Instructions such as inc, store or pull take the number of a variable as a constant
+        static Argument by_reference(Variable variable) { return Argument(static_cast<int>(variable.number)); }
+    };
+
+    // A place in the routine being assembled, to branch or jump to
+    struct Label {
+        uint32_t index;
+    };
+
+    // Where a branch goes when its condition is met (or not, with condition false)
+    struct Branch {
+        Label label;
+        bool condition;
+
+        static Branch when(Label label) { return { label, true }; }
+        static Branch unless(Label label) { return { label, false }; }
+    };
+
+    /*
+     * Lays out a story file from objects, dictionary words, abbreviations,
+     * strings and routines assembled one instruction at a time. Addresses of
+     * routines, strings, words and tables are fixed up once everything has
+     * been placed, so they can be used before they are defined. Versions 1 and
+     * 2 encode text differently and are not supported.
+     */
+    template<uint8_t Version>
+    class StoryBuilder {
+    public:
+        using Traits = VersionTraits<Version>;
+
+        static_assert(Version >= 3, "Stories are built from version 3 on");
+
+        // Branching to these returns true or false from the routine
+        static constexpr Label RETURN_FALSE { 0xFFFFFFFE };
+        static constexpr Label RETURN_TRUE { 0xFFFFFFFF };
+
+        StoryBuilder();
+
+        // Text matching an abbreviation is printed through it (up to 96)
+        void abbreviate(const std::string &text);
+
+        // Objects are numbered from 1, in creation order, and follow their parent's other children
+        uint16_t add_object(const std::string &name, uint16_t parent = 0);
+        void set_attribute(uint16_t object, uint8_t attribute);
+        void set_property(uint16_t object, uint8_t property, const std::vector<uint8_t> &data);
+        void set_property(uint16_t object, uint8_t property, uint16_t value);
+        void set_default(uint8_t property, uint16_t value);
+
+        void set_global(uint8_t global, uint16_t value);
+
+        // A dictionary entry, added the first time it is asked for
+        Argument word(const std::string &text);
+
+        // A zeroed table of that many bytes in dynamic memory, its first bytes set to initial
+        Argument array(uint16_t length, const std::vector<uint8_t> &initial = {});
+
+        // A string in high memory, for print_paddr
+        Argument string(const std::string &text);
+
+        // A routine, to be defined later with begin
+        Argument routine();
+
+        // Starts assembling a routine; the main one is where the story starts, and only has locals in version 6
+        void begin(const Argument &routine, uint8_t locals, const std::vector<uint16_t> &defaults = {});
+        void begin_main(uint8_t locals = 0);
+
+        // Labels belong to the routine being assembled
+        Label label();
+        void bind(Label label);
+
+        void op(Mnemonic mnemonic, const std::vector<Argument> &arguments = {});
+        void op(Mnemonic mnemonic, const std::vector<Argument> &arguments, Variable store);
+        void op(Mnemonic mnemonic, const std::vector<Argument> &arguments, Branch branch);
+        void op(Mnemonic mnemonic, const std::vector<Argument> &arguments, Variable store, Branch branch);
+
+        // print or print_ret, with the text inline
+        void print(const std::string &text, bool ret = false);
+        void jump(Label label);
+
+        // The story file, empty if something could not be laid out
+        std::vector<uint8_t> build();
+
+    private:
+        struct Object {
+            std::string name;
+            uint16_t parent;
+            uint16_t sibling;
+            uint16_t child;
+            uint8_t attributes[6];
+            std::map<uint8_t, std::vector<uint8_t>> properties;
+        };
+
+        // An address to write once it is known
+        struct Fixup {
+            uint32_t offset; // In the routine's code
+            Reference reference;
+            uint16_t index;
+        };
+
+        // A branch or jump to a label in the same routine
+        struct LabelFixup {
+            uint32_t offset;
+            uint32_t label;
+            bool jump;
+        };
+
+        struct Routine {
+            bool defined;
+            std::vector<uint8_t> code; // From the header on
+            std::vector<Fixup> fixups;
+            std::vector<LabelFixup> labels;
+        };
+
+        std::vector<std::string> abbreviations;
+        std::vector<Object> objects;
+        uint16_t defaults[Traits::property_defaults];
+        uint16_t globals[240];
+        std::map<std::string, uint16_t> words;
+        std::vector<std::string> word_texts;
+        std::vector<std::vector<uint8_t>> arrays;
+        std::vector<std::string> strings;
+        std::vector<Routine> routines;
+
+        int main_routine = -1;
+        int current = -1; // The routine being assembled
+        std::vector<int64_t> label_offsets; // Of the routine being assembled, -1 until bound
+        bool failed = false;
+
+        std::vector<uint8_t> zchars(const std::string &text, bool abbreviated) const;
+        std::vector<uint8_t> encode(const std::string &text, bool abbreviated = true) const;
+        std::vector<uint8_t> encode_word(const std::string &text) const;
+
+        void emit(Mnemonic mnemonic, const std::vector<Argument> &arguments, const Variable *store, const Branch *branch);
+        void emit_argument(const Argument &argument, bool large);
+        void finish_routine();
+        void fail(const std::string &message);
+    };
+}
+
+#endif //ZETAMACHINE_STORY_BUILDER_H
@@ -0,0 +1,896 @@
+#include "../bench/stories.h"
+#include "../headless.h"
+#include "../machine.h"
+#include "../scheduler.h"
+#include "../memory/big_endian.h"
+#include "../memory/story_image.h"
+#include "../story/story_builder.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Stories that end at a page, as far as memory goes when they are mapped
+#define PAGE_STORY_LENGTH 0x1000
+
+namespace {
+    // What a macro-benchmark story prints last, and how many instructions it takes however it is run
+    struct Expected {
+        const char *name;
+        uint8_t version;
+        uint64_t instructions;
+        const char *result;
+    };
+
+    const Expected expected_stories[] = {
+        { "arithmetic", 3, 9079006, "Arithmetic: 21450" },
+        { "recursion", 3, 5651006, "Recursion: -4888" },
+        { "objects", 3, 20060006, "Objects: 27882" },
+        { "text", 3, 200006, "Text: 20000" },
+        { "parser", 3, 1187508, "Parser: -27040, unknown words: 10000" },
+        { "arithmetic", 5, 11079006, "Arithmetic: -8911" },
+        { "recursion", 5, 5651006, "Recursion: -4888" },
+        { "objects", 5, 20060006, "Objects: 27882" },
+        { "text", 5, 200006, "Text: 20000" },
+        { "parser", 5, 1247508, "Parser: 18284, unknown words: 10000" },
+        { "arithmetic", 8, 11079006, "Arithmetic: -8911" },
+        { "recursion", 8, 5651006, "Recursion: -4888" },
+        { "objects", 8, 20060006, "Objects: 27882" },
+        { "text", 8, 200006, "Text: 20000" },
+        { "parser", 8, 1247508, "Parser: 18284, unknown words: 10000" },
+        { "tail_calls", 5, 120005, "1" },
+        { "tail_calls", 8, 120005, "1" }
+    };
+
+    struct Played {
+        std::string text;
+        std::string last;
+        uint64_t instructions;
+    };
+
+    Played play(const std::vector<uint8_t> &story, const std::vector<std::string> &lines, const zm::Options &options) {
+        zm::Transcript video {};
+        zm::ScriptedInput input { lines };
+
+        zm::Machine machine {};
+        machine.configure(options);
+        machine.attach(&video, &input);
+
+        uint64_t instructions = machine.run(story);
+        return { video.text(), video.last_line(), instructions };
+    }
+
+    // A chain of 30000 calls, each returning what it calls returns, which fusion runs as one instruction and counts as two
+    template<uint8_t Version>
+    std::vector<uint8_t> build_tail_call_story() {
+        using zm::Mnemonic;
+        using zm::Variable;
+
+        zm::StoryBuilder<Version> story;
+        auto chain = story.routine();
+
+        story.begin_main();
+        story.op(Mnemonic::CALL_VS, { chain, 30000 }, Variable::stack());
+        story.op(Mnemonic::PRINT_NUM, { Variable::stack() });
+        story.op(Mnemonic::NEW_LINE);
+        story.op(Mnemonic::QUIT);
+
+        story.begin(chain, 1);
+        story.op(Mnemonic::JZ, { Variable::local(1) }, zm::Branch::when(zm::StoryBuilder<Version>::RETURN_TRUE));
+        story.op(Mnemonic::SUB, { Variable::local(1), 1 }, Variable::stack());
+        story.op(Mnemonic::CALL_VS, { chain, Variable::stack() }, Variable::stack());
+        story.op(Mnemonic::RET_POPPED);
+
+        return story.build();
+    }
+
+    // The macro-benchmark stories, and those built here to cover what they do not
+    std::vector<zm::MacroStory> build_stories() {
+        std::vector<zm::MacroStory> stories;
+
+        for (uint8_t version : { 3, 5, 8 }) {
+            auto built = zm::build_macro_stories(version);
+            stories.insert(stories.end(), built.begin(), built.end());
+        }
+
+        stories.push_back({ "tail_calls", 5, build_tail_call_story<5>(), {} });
+        stories.push_back({ "tail_calls", 8, build_tail_call_story<8>(), {} });
+        return stories;
+    }
+
+    // Every story prints what it should, in as many instructions as it should
+    bool check_stories(const zm::Options &options) {
+        bool passed = true;
+        size_t checked = 0;
+
+        for (const auto &story : build_stories()) {
+            std::string name = story.name + ".z" + std::to_string(story.version);
+            const Expected *expected = nullptr;
+
+            for (const auto &candidate : expected_stories) {
+                if (story.name == candidate.name && story.version == candidate.version) {
+                    expected = &candidate;
+                }
+            }
+
+            if (expected == nullptr) {
+                std::cerr << name << " has no expected result" << std::endl;
+                passed = false;
+                continue;
+            }
+
+            auto played = play(story.image, story.input, options);
+            ++checked;
+
+            if (played.last != expected->result || played.instructions != expected->instructions) {
+                std::cerr << name << ": \"" << played.last << "\" in " << played.instructions << " instructions, expected \""
+                          << expected->result << "\" in " << expected->instructions << std::endl;
+                passed = false;
+            }
+        }
+
+        if (checked != sizeof(expected_stories) / sizeof(expected_stories[0])) {
+            std::cerr << "Only " << checked << " of the stories were built" << std::endl;
+            passed = false;
+        }
+
+        return passed;
+    }
+
+    // The JIT changes nothing a story prints, nor how many instructions it counts
+    bool check_jit(zm::Options options) {
+        bool passed = true;
+
+        for (const auto &story : build_stories()) {
+            std::string name = story.name + ".z" + std::to_string(story.version);
+
+            options.jit = false;
+            auto interpreted = play(story.image, story.input, options);
+            options.jit = true;
+            auto compiled = play(story.image, story.input, options);
+
+            if (compiled.text != interpreted.text) {
+                std::cerr << name << ": prints \"" << compiled.last << "\" with the JIT, \"" << interpreted.last << "\" without it" << std::endl;
+                passed = false;
+            }
+
+            if (compiled.instructions != interpreted.instructions) {
+                std::cerr << name << ": " << compiled.instructions << " instructions with the JIT, " << interpreted.instructions << " without it" << std::endl;
+                passed = false;
+            }
+        }
+
+        return passed;
+    }
+
+    /*
+     * Saves in the middle of a routine, with locals, the stack and a caller
+     * below it, then changes a global, a table, a local and the stack and
+     * restores. The second pass takes the branch SAVE takes after a restore.
+     */
+    template<uint8_t Version>
+    std::vector<uint8_t> build_save_story() {
+        using zm::Argument;
+        using zm::Branch;
+        using zm::Mnemonic;
+        using zm::Variable;
+
+        zm::StoryBuilder<Version> story;
+        auto call = Version >= 4 ? Mnemonic::CALL_VS : Mnemonic::CALL;
+        auto pass = Variable::global(1), changed = Variable::global(2);
+        auto inner = story.routine(), middle = story.routine();
+        auto table = story.array(64, { 1, 2, 3 });
+        story.set_global(0, 10);
+
+        // Random numbers 1, 2, 3... from here on
+        story.begin_main();
+        story.op(Mnemonic::RANDOM, { -3 }, Variable::stack());
+        story.op(Mnemonic::PULL, { Argument::by_reference(changed) });
+        story.op(call, { middle }, Variable::stack());
+        story.op(Mnemonic::PRINT_NUM, { Variable::stack() });
+        story.print("\n");
+        story.op(Mnemonic::QUIT);
+
+        story.begin(middle, 1);
+        story.op(Mnemonic::PUSH, { 100 });
+        story.op(call, { inner, 5 }, Variable::stack());
+        story.op(Mnemonic::ADD, { Variable::stack(), Variable::stack() }, Variable::stack());
+        story.op(Mnemonic::RET_POPPED);
+
+        story.begin(inner, 3);
+        auto saved = story.label(), done = story.label();
+        story.op(Mnemonic::STORE, { Argument::by_reference(Variable::local(2)), 42 });
+        story.op(Mnemonic::PUSH, { 7 });
+
+        if (Version <= 3) {
+            story.op(Mnemonic::SAVE, {}, Branch::when(saved));
+        } else {
+            story.op(Mnemonic::SAVE, {}, Variable::local(3));
+            story.op(Mnemonic::JZ, { Variable::local(3) }, Branch::unless(saved));
+        }
+
+        story.print("save failed\n");
+        story.op(Mnemonic::QUIT);
+
+        story.bind(saved);
+        story.print("save result ");
+        story.op(Mnemonic::PRINT_NUM, { Variable::local(3) });
+        story.op(Mnemonic::RANDOM, { 3 }, pass);
+        story.print(" pass ");
+        story.op(Mnemonic::PRINT_NUM, { pass });
+        story.print(" a=");
+        story.op(Mnemonic::PRINT_NUM, { Variable::local(1) });
+        story.print(" b=");
+        story.op(Mnemonic::PRINT_NUM, { Variable::local(2) });
+        story.print(" g0=");
+        story.op(Mnemonic::PRINT_NUM, { Variable::global(0) });
+        story.print(" table=");
+        story.op(Mnemonic::LOADW, { table, 1 }, changed);
+        story.op(Mnemonic::PRINT_NUM, { changed });
+        story.print("\n");
+        story.op(Mnemonic::JE, { pass, 2 }, Branch::when(done));
+
+        story.op(Mnemonic::STORE, { Argument::by_reference(Variable::global(0)), 99 });
+        story.op(Mnemonic::STOREW, { table, 1, 0x1234 });
+        story.op(Mnemonic::STORE, { Argument::by_reference(Variable::local(2)), 1 });
+        story.op(Mnemonic::PUSH, { 55 });
+
+        if (Version <= 3) {
+            story.op(Mnemonic::RESTORE, {}, Branch::when(done));
+        } else {
+            story.op(Mnemonic::RESTORE, {}, Variable::local(3));
+        }
+
+        story.print("restore failed\n");
+        story.op(Mnemonic::QUIT);
+
+        // 5 + 42 + 100 only when the locals and the stack were restored
+        story.bind(done);
+        story.op(Mnemonic::PULL, { Argument::by_reference(changed) });
+        story.op(Mnemonic::ADD, { Variable::local(1), Variable::local(2) }, Variable::stack());
+        story.op(Mnemonic::RET_POPPED);
+
+        return story.build();
+    }
+
+    // A game saved and restored in memory and through a file plays on from where it was saved
+    bool check_quetzal(zm::Options options) {
+        bool passed = true;
+        const std::vector<std::string> lines;
+
+        for (uint8_t version : { 3, 5, 8 }) {
+            auto story = version == 3 ? build_save_story<3>() : version == 5 ? build_save_story<5>() : build_save_story<8>();
+
+            // Version 3 branches on SAVE rather than storing its result
+            std::string first = version == 3 ? "0" : "1", second = version == 3 ? "0" : "2";
+            std::string expected = "save result " + first + " pass 1 a=5 b=42 g0=10 table=768\n"
+                                   "save result " + second + " pass 2 a=5 b=42 g0=10 table=768\n"
+                                   "147\n";
+
+            // Named for the process, as ctest may run several of these at once
+            for (std::string file : { std::string(), "zetamachine_test." + std::to_string(getpid()) + ".qzl" }) {
+                options.save_file = file;
+                auto played = play(story, lines, options);
+
+                if (!file.empty()) {
+                    std::remove(file.c_str());
+                }
+
+                if (played.text != expected) {
+                    std::cerr << "save.z" << static_cast<int>(version) << (file.empty() ? " in memory" : " through a file") << " printed:\n" << played.text << std::endl;
+                    passed = false;
+                }
+            }
+        }
+
+        return passed;
+    }
+
+    /*
+     * Reads a line with its buffers popped from the stack, over a value
+     * left below them, then a key in versions that have read_char. Each
+     * number printed is wrong if a read that waited popped the stack twice.
+     */
+    template<uint8_t Version>
+    std::vector<uint8_t> build_input_story() {
+        using zm::Mnemonic;
+        using zm::Variable;
+
+        zm::StoryBuilder<Version> story;
+        auto reader = story.routine();
+        auto text = story.array(32, { 30 }), parse = story.array(32, { 4 });
+
+        story.begin_main();
+        story.op(Version >= 4 ? Mnemonic::CALL_VS : Mnemonic::CALL, { reader }, Variable::stack());
+        story.op(Mnemonic::QUIT);
+
+        // In a routine of its own, so that it is translated too
+        story.begin(reader, 1);
+        story.op(Mnemonic::PUSH, { 1111 });
+        story.op(Mnemonic::PUSH, { parse });
+        story.op(Mnemonic::PUSH, { text });
+
+        if (Version >= 5) {
+            story.op(Mnemonic::AREAD, { Variable::stack(), Variable::stack() }, Variable::local(1));
+        } else {
+            story.op(Mnemonic::SREAD, { Variable::stack(), Variable::stack() });
+        }
+
+        story.op(Mnemonic::PRINT_NUM, { Variable::stack() });
+        story.print(" ");
+        story.op(Mnemonic::PRINT_NUM, { Variable::local(1) });
+        story.print(" ");
+        story.op(Mnemonic::LOADB, { parse, 1 }, Variable::stack());
+        story.op(Mnemonic::PRINT_NUM, { Variable::stack() });
+        story.print("\n");
+
+        if (Version >= 4) {
+            story.op(Mnemonic::PUSH, { 2222 });
+            story.op(Mnemonic::READ_CHAR, { 1 }, Variable::stack());
+            story.op(Mnemonic::PRINT_NUM, { Variable::stack() });
+            story.print(" ");
+            story.op(Mnemonic::PRINT_NUM, { Variable::stack() });
+            story.print("\n");
+        }
+
+        story.op(Mnemonic::RTRUE);
+        return story.build();
+    }
+
+    /*
+     * A story that waits for input it is sent later, a few instructions at a
+     * time, prints what it prints with all of its input typed up front, in as
+     * many instructions.
+     */
+    bool check_input(const zm::Options &options) {
+        bool passed = true;
+        const std::vector<std::string> lines { "look around", "x" };
+
+        for (uint8_t version : { 3, 5, 8 }) {
+            auto story = version == 3 ? build_input_story<3>() : version == 5 ? build_input_story<5>() : build_input_story<8>();
+            std::string name = "input.z" + std::to_string(version);
+
+            auto typed = play(story, lines, options);
+            std::string expected = version >= 5 ? "1111 13 2\n120 2222\n" : "1111 0 2\n";
+
+            if (typed.text != expected) {
+                std::cerr << name << " with its input typed up front printed:\n" << typed.text << std::endl;
+                passed = false;
+            }
+
+            zm::Transcript video {};
+            zm::Machine machine {};
+            machine.configure(options);
+            machine.attach(&video, nullptr);
+
+            if (!machine.load(story)) {
+                std::cerr << name << " did not load" << std::endl;
+                return false;
+            }
+
+            uint64_t instructions = 0;
+            size_t sent = 0;
+            zm::RunResult result { zm::RunStatus::BUDGET, 0 };
+
+            while (result.status != zm::RunStatus::QUIT && result.status != zm::RunStatus::ERROR) {
+                result = machine.run_for(3);
+                instructions += result.instructions;
+
+                if (result.status == zm::RunStatus::WAITING_FOR_LINE && sent < lines.size()) {
+                    machine.send_line(lines[sent++]);
+                } else if (result.status == zm::RunStatus::WAITING_FOR_CHAR && sent < lines.size()) {
+                    machine.send_char(static_cast<uint8_t>(lines[sent++][0]));
+                } else if (result.status != zm::RunStatus::BUDGET) {
+                    break;
+                }
+            }
+
+            if (result.status != zm::RunStatus::QUIT || video.text() != expected || instructions != typed.instructions) {
+                std::cerr << name << " with its input sent while it waited printed, in " << instructions << " instructions rather than "
+                          << typed.instructions << ":\n" << video.text() << std::endl;
+                passed = false;
+            }
+        }
+
+        return passed;
+    }
+
+    // How a story loaded from memory ends, with no input
+    zm::RunStatus finish(const std::vector<uint8_t> &story, const zm::Options &options, zm::Transcript &video) {
+        zm::Machine machine {};
+        machine.configure(options);
+        machine.attach(&video, nullptr);
+
+        if (!machine.load(story)) {
+            return zm::RunStatus::ERROR;
+        }
+
+        machine.close_input();
+        zm::RunResult result { zm::RunStatus::BUDGET, 0 };
+
+        while (result.status == zm::RunStatus::BUDGET) {
+            result = machine.run_for(1000);
+        }
+
+        return result.status;
+    }
+
+    /*
+     * A version 5 story padded with zeros to a page, so that what it reads at
+     * its end is not followed by more memory. Its length and checksum cover
+     * what is patched in at the end.
+     */
+    std::vector<uint8_t> build_page_story(const std::function<void(zm::StoryBuilder<5> &)> &main, const std::vector<std::pair<uint32_t, uint16_t>> &patches) {
+        zm::StoryBuilder<5> builder;
+        builder.begin_main();
+        main(builder);
+        builder.print("after\n");
+        builder.op(zm::Mnemonic::QUIT);
+
+        auto story = builder.build();
+
+        if (story.empty() || story.size() > PAGE_STORY_LENGTH / 2) {
+            return {};
+        }
+
+        story.resize(PAGE_STORY_LENGTH);
+
+        for (const auto &patch : patches) {
+            zm::store_be16(&story[patch.first], patch.second);
+        }
+
+        zm::store_be16(&story[0x1A], PAGE_STORY_LENGTH >> 2);
+        zm::store_be16(&story[0x1C], zm::story_checksum(story.data(), PAGE_STORY_LENGTH));
+        return story;
+    }
+
+    // Checked access stops a story at text or an instruction that runs past its end, instead of reading on
+    bool check_bounds(const zm::Options &options) {
+        bool passed = true;
+
+        // The last word of the story, without the bit that ends a string
+        auto unterminated = build_page_story([](zm::StoryBuilder<5> &story) {
+            story.op(zm::Mnemonic::PRINT_ADDR, { PAGE_STORY_LENGTH - 2 });
+        }, { { PAGE_STORY_LENGTH - 2, 0x1CA5 } });
+
+        // An abbreviation of itself, from a table of abbreviations near the end
+        auto abbreviation = build_page_story([](zm::StoryBuilder<5> &story) {
+            story.op(zm::Mnemonic::PRINT_ADDR, { PAGE_STORY_LENGTH - 8 });
+        }, { { 0x18, PAGE_STORY_LENGTH - 4 }, { PAGE_STORY_LENGTH - 4, (PAGE_STORY_LENGTH - 8) >> 1 }, { PAGE_STORY_LENGTH - 8, 0x8405 } });
+
+        // A routine whose first instruction, call_vs with four word operands, is cut off by the end
+        auto instruction = build_page_story([](zm::StoryBuilder<5> &story) {
+            story.op(zm::Mnemonic::CALL_VS, { (PAGE_STORY_LENGTH - 4) >> 2 }, zm::Variable::stack());
+        }, { { PAGE_STORY_LENGTH - 4, 0x00E0 }, { PAGE_STORY_LENGTH - 2, 0x0012 } });
+
+        const std::pair<const char *, const std::vector<uint8_t> &> stories[] = {
+            { "unterminated text", unterminated }, { "nested abbreviations", abbreviation }, { "a cut off instruction", instruction }
+        };
+
+        for (const auto &story : stories) {
+            zm::Transcript video {};
+
+            if (story.second.empty() || finish(story.second, options, video) != zm::RunStatus::ERROR || video.text().find("after") != std::string::npos) {
+                std::cerr << "The story with " << story.first << " was not stopped, it printed:\n" << video.text() << std::endl;
+                passed = false;
+            }
+        }
+
+        return passed;
+    }
+
+    /*
+     * Sessions of a story that waits for input twice, on two workers taking
+     * a few instructions at a time, fed from the callback as they park. They
+     * print what the story prints on its own. Then more of them, removed by
+     * this thread as soon as they park or finish, while the workers go on.
+     */
+    bool check_scheduler(const zm::Options &options) {
+        const unsigned sessions = 16;
+        const std::vector<std::string> lines { "look around", "x" };
+        auto story = build_input_story<5>();
+        auto alone = play(story, lines, options);
+
+        zm::Scheduler scheduler { 2, 3, options };
+        std::vector<size_t> positions(2 * sessions + 1, 0);
+
+        scheduler.on_stop([&](zm::SessionId id, zm::SessionState state) {
+            if (state != zm::SessionState::PARKED) {
+                return;
+            }
+
+            if (positions[id] < lines.size()) {
+                scheduler.send(id, lines[positions[id]++]);
+            } else {
+                scheduler.close(id);
+            }
+        });
+
+        std::vector<zm::SessionId> ids;
+
+        for (unsigned i = 0; i < sessions; ++i) {
+            ids.push_back(scheduler.add(story));
+        }
+
+        scheduler.wait();
+        bool passed = true;
+
+        for (zm::SessionId id : ids) {
+            auto state = scheduler.state(id);
+            auto instructions = scheduler.instructions(id);
+            auto text = scheduler.take_output(id);
+
+            if (id == 0 || state != zm::SessionState::FINISHED || text != alone.text || instructions != alone.instructions) {
+                std::cerr << "Session " << id << " printed, in " << instructions << " instructions rather than " << alone.instructions << ":\n" << text << std::endl;
+                passed = false;
+            }
+
+            if (!scheduler.remove(id) || scheduler.state(id) != zm::SessionState::UNKNOWN) {
+                std::cerr << "Session " << id << " was not removed" << std::endl;
+                passed = false;
+            }
+        }
+
+        ids.clear();
+
+        for (unsigned i = 0; i < sessions; ++i) {
+            ids.push_back(scheduler.add(story));
+        }
+
+        while (!ids.empty()) {
+            ids.erase(std::remove_if(ids.begin(), ids.end(), [&](zm::SessionId id) { return scheduler.remove(id); }), ids.end());
+        }
+
+        scheduler.wait();
+        return passed;
+    }
+
+    // What is in a directory, but for . and ..
+    std::vector<std::string> files_in(const std::string &directory) {
+        std::vector<std::string> names;
+        DIR *listing = opendir(directory.c_str());
+
+        for (dirent *entry; listing && (entry = readdir(listing)) != nullptr; ) {
+            std::string name = entry->d_name;
+
+            if (name != "." && name != "..") {
+                names.push_back(name);
+            }
+        }
+
+        if (listing) {
+            closedir(listing);
+        }
+
+        return names;
+    }
+
+    void remove_files(const std::string &directory) {
+        for (const auto &name : files_in(directory)) {
+            unlink((directory + "/" + name).c_str());
+        }
+    }
+
+    /*
+     * Processes that share a story in a directory at once all get an image of
+     * it, and leave one there, which is then played from. One that others
+     * could change, of the wrong size or behind a link is not trusted, and
+     * the story is played from an image of its own.
+     */
+    bool check_images(zm::Options options) {
+        const std::vector<std::string> lines { "look around", "x" };
+        auto story = build_input_story<5>();
+        auto alone = play(story, lines, options);
+        zm::StoryKey key = zm::story_key(story.data(), story.size(), static_cast<uint32_t>(story.size()));
+
+        // Named for the process, as ctest may run several of these at once
+        std::string directory = "zetamachine_test." + std::to_string(getpid()) + ".images";
+
+        if (mkdir(directory.c_str(), 0700) != 0) {
+            std::cerr << "Could not make " << directory << std::endl;
+            return false;
+        }
+
+        bool passed = true;
+        std::vector<pid_t> children;
+
+        for (int i = 0; i < 4; ++i) {
+            pid_t child = fork();
+
+            if (child == 0) {
+                auto image = zm::StoryImage::create(story, directory);
+                _exit(image && image->length() == story.size() && std::equal(story.begin(), story.end(), image->bytes()) ? 0 : 1);
+            }
+
+            children.push_back(child);
+        }
+
+        for (pid_t child : children) {
+            int status = 0;
+
+            if (child < 0 || waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                std::cerr << "A process sharing the story did not get an image of it" << std::endl;
+                passed = false;
+            }
+        }
+
+        auto files = files_in(directory);
+        auto shared = zm::StoryImage::open(directory, key);
+
+        if (files.size() != 1 || !shared || !std::equal(story.begin(), story.end(), shared->bytes())) {
+            std::cerr << "The processes left " << files.size() << " files in " << directory << " rather than an image of the story" << std::endl;
+            passed = false;
+        }
+
+        shared.reset();
+        options.images = directory;
+        std::string path = directory + "/" + (files.empty() ? "" : files[0]);
+
+        const std::pair<const char *, std::function<bool()>> cases[] = {
+            { "a shared image", [] { return true; } },
+            { "an image others can write to", [&] { return chmod(path.c_str(), 0464) == 0; } },
+            { "an image of the wrong size", [&] {
+                struct stat status {};
+                return stat(path.c_str(), &status) == 0 && chmod(path.c_str(), 0644) == 0 &&
+                       truncate(path.c_str(), status.st_size + sysconf(_SC_PAGESIZE)) == 0 && chmod(path.c_str(), 0444) == 0;
+            } },
+            { "a link to an image", [&] { return rename(path.c_str(), (path + ".moved").c_str()) == 0 && symlink((files[0] + ".moved").c_str(), path.c_str()) == 0; } }
+        };
+
+        for (const auto &test : cases) {
+            if (files.size() != 1) {
+                break;
+            }
+
+            remove_files(directory);
+            zm::StoryImage::create(story, directory);
+
+            bool trusted = &test == cases;
+
+            if (!test.second() || (zm::StoryImage::open(directory, key) != nullptr) != trusted) {
+                std::cerr << "The story was " << (trusted ? "not " : "") << "shared from " << test.first << std::endl;
+                passed = false;
+            }
+
+            auto played = play(story, lines, options);
+
+            if (played.text != alone.text || played.instructions != alone.instructions) {
+                std::cerr << "The story with " << test.first << " printed, in " << played.instructions << " instructions rather than "
+                          << alone.instructions << ":\n" << played.text << std::endl;
+                passed = false;
+            }
+        }
+
+        remove_files(directory);
+        rmdir(directory.c_str());
+        return passed;
+    }
+
+    // A chunk of an IFF file, padded to an even length, and where it starts
+    size_t append_chunk(std::vector<uint8_t> &file, const char *type, const std::vector<uint8_t> &data) {
+        size_t chunk = file.size();
+        file.insert(file.end(), type, type + 4);
+        file.resize(chunk + 8);
+        zm::store_be32(&file[chunk + 4], static_cast<uint32_t>(data.size()));
+        file.insert(file.end(), data.begin(), data.end());
+
+        if (data.size() % 2 != 0) {
+            file.push_back(0);
+        }
+
+        return chunk;
+    }
+
+    /*
+     * A Blorb file with the story in it, after a chunk of odd length. With an
+     * index, the story is found through it. The story starts at a page when
+     * aligned.
+     */
+    std::vector<uint8_t> build_blorb(const std::vector<uint8_t> &story, bool indexed, bool aligned) {
+        std::vector<uint8_t> file { 'F', 'O', 'R', 'M', 0, 0, 0, 0, 'I', 'F', 'R', 'S' };
+        std::vector<uint8_t> index(4 + 12, 0);
+        size_t entry = 0;
+
+        if (indexed) {
+            zm::store_be32(&index[0], 1);
+            std::copy_n("Exec", 4, index.begin() + 4);
+            entry = append_chunk(file, "RIdx", index) + 8 + 4;
+        }
+
+        size_t padding = aligned ? static_cast<size_t>(sysconf(_SC_PAGESIZE)) - file.size() - 16 - 1 : 3;
+        append_chunk(file, "AUTH", std::vector<uint8_t>(padding, 'a'));
+
+        size_t chunk = append_chunk(file, "ZCOD", story);
+
+        if (indexed) {
+            zm::store_be32(&file[entry + 8], static_cast<uint32_t>(chunk));
+        }
+
+        zm::store_be32(&file[4], static_cast<uint32_t>(file.size() - 8));
+        return file;
+    }
+
+    /*
+     * The story is found in Blorb files, with or without an index, and
+     * played from them, mapped when it starts at a page. Files that are
+     * not Blorb files, or whose chunks run past their end, are read no
+     * further than that.
+     */
+    bool check_blorb(const zm::Options &options) {
+        const std::vector<std::string> lines { "look around", "x" };
+        auto story = build_input_story<5>();
+        auto alone = play(story, lines, options);
+        bool passed = true;
+
+        // Named for the process, as ctest may run several of these at once
+        std::string path = "zetamachine_test." + std::to_string(getpid()) + ".zblorb";
+
+        for (bool indexed : { true, false }) {
+            for (bool aligned : { true, false }) {
+                auto file = build_blorb(story, indexed, aligned);
+                std::string name = std::string(indexed ? "An indexed" : "A") + (aligned ? " page-aligned" : "") + " Blorb file";
+                size_t offset = 0, length = 0;
+
+                if (!zm::find_blorb_story(file.data(), file.size(), offset, length) || offset + story.size() + story.size() % 2 != file.size() ||
+                    length != story.size()) {
+                    std::cerr << name << " has a story of " << length << " bytes at " << offset << std::endl;
+                    passed = false;
+                    continue;
+                }
+
+                FILE *written = std::fopen(path.c_str(), "wb");
+                bool saved = written && std::fwrite(file.data(), 1, file.size(), written) == file.size();
+
+                if (written) {
+                    std::fclose(written);
+                }
+
+                auto image = zm::StoryImage::map(path);
+
+                // Mapped from the file, or copied out of it
+                if (!saved || !image || image->offset() != (aligned ? offset : 0) || image->length() != story.size() ||
+                    !std::equal(story.begin(), story.end(), image->bytes())) {
+                    std::cerr << name << " was not mapped" << std::endl;
+                    passed = false;
+                }
+
+                image.reset();
+
+                zm::Transcript video {};
+                zm::ScriptedInput input { lines };
+                zm::Machine machine {};
+                machine.configure(options);
+                machine.attach(&video, &input);
+                uint64_t instructions = machine.run(path);
+
+                if (video.text() != alone.text || instructions != alone.instructions) {
+                    std::cerr << name << " printed, in " << instructions << " instructions rather than " << alone.instructions << ":\n" << video.text() << std::endl;
+                    passed = false;
+                }
+
+                std::remove(path.c_str());
+            }
+        }
+
+        auto file = build_blorb(story, true, false);
+        size_t chunk = file.size() - story.size() - story.size() % 2 - 8;
+        size_t offset = 0, length = 0;
+
+        // A story cut short by the end of the file is only read up to it
+        if (!zm::find_blorb_story(file.data(), file.size() - 10, offset, length) || offset != chunk + 8 || offset + length != file.size() - 10) {
+            std::cerr << "A story cut short was found with " << length << " bytes" << std::endl;
+            passed = false;
+        }
+
+        auto aiff = file;
+        std::copy_n("AIFF", 4, aiff.begin() + 8);
+
+        // No index entry or chunk leads to the story
+        auto misplaced = file;
+        zm::store_be32(&misplaced[12 + 8 + 4 + 8], static_cast<uint32_t>(file.size()));
+        std::copy_n("ZCOX", 4, misplaced.begin() + static_cast<std::ptrdiff_t>(chunk));
+
+        // A chunk longer than the file hides the story after it
+        auto oversized = file;
+        zm::store_be32(&oversized[12 + 8 + 4 + 8], 0);
+        zm::store_be32(&oversized[12 + 8 + 16 + 4], 0xFFFFFFFF);
+
+        const std::pair<const char *, std::vector<uint8_t>> malformed[] = {
+            { "a file that is not a Blorb file", aiff }, { "a file cut off after its header", std::vector<uint8_t>(file.begin(), file.begin() + 10) },
+            { "an index and chunks that lead nowhere", misplaced }, { "a chunk longer than the file", oversized }
+        };
+
+        for (const auto &test : malformed) {
+            if (zm::find_blorb_story(test.second.data(), test.second.size(), offset, length)) {
+                std::cerr << "A story of " << length << " bytes at " << offset << " was found in " << test.first << std::endl;
+                passed = false;
+            }
+        }
+
+        return passed;
+    }
+}
+
+/*
+ * The regression tests run by ctest. stories plays the macro-benchmark
+ * stories, built with the story builder, with the options given and
+ * compares what they print last and their instruction counts with the
+ * expected ones. jit plays them with the JIT on and off, and compares
+ * everything they print and their instruction counts. quetzal saves and
+ * restores a game in a story built for it, and checks that it goes on
+ * from where it was saved. input sends a story its input while it waits
+ * for it, a few instructions at a time. bounds runs stories whose text
+ * and code run past their end, which checked access has to stop.
+ * scheduler plays sessions on the work-stealing scheduler. images shares
+ * a story through a directory, from several processes at once. blorb
+ * finds and plays a story in Blorb files.
+ */
+int main(int argc, char *argv[]) {
+    std::string test = argc > 1 ? argv[1] : "";
+    zm::Options options;
+
+    for (int i = 2; i < argc; ++i) {
+        std::string argument = argv[i];
+
+        if (argument == "--no-fusion") {
+            options.fusion = false;
+        } else if (argument == "--no-translation") {
+            options.translation = false;
+        } else if (argument == "--jit") {
+            options.jit = true;
+        } else if (argument == "--checked") {
+            options.checked = true;
+        } else if (argument == "--aot" && i + 1 < argc) {
+            options.aot_plugin = argv[++i];
+        } else {
+            test.clear();
+            break;
+        }
+    }
+
+    if (test == "stories") {
+        return check_stories(options) ? 0 : 1;
+    }
+
+    if (test == "jit") {
+        return check_jit(options) ? 0 : 1;
+    }
+
+    if (test == "quetzal") {
+        return check_quetzal(options) ? 0 : 1;
+    }
+
+    if (test == "input") {
+        return check_input(options) ? 0 : 1;
+    }
+
+    if (test == "bounds") {
+        return check_bounds(options) ? 0 : 1;
+    }
+
+    if (test == "scheduler") {
+        return check_scheduler(options) ? 0 : 1;
+    }
+
+    if (test == "images") {
+        return check_images(options) ? 0 : 1;
+    }
+
+    if (test == "blorb") {
+        return check_blorb(options) ? 0 : 1;
+    }
+
+    std::cerr << "Usage: zetamachine_test <stories|jit|quetzal|input|bounds|scheduler|images|blorb> [--no-fusion] [--no-translation] [--jit] [--checked] [--aot <plugin>]" << std::endl;
+    return 1;
+}
@@ -0,0 +1,48 @@
+#include "trace.h"
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/*
+ * Prints a trace written by a zetamachine built with ZM_TRACE, one
+ * instruction per line, indented by call depth.
+ */
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: zetamachine_trace <trace file>" << std::endl;
+        return 1;
+    }
+
+    std::vector<zm::TraceRecord> records;
+
+    if (!zm::read_trace(argv[1], records)) {
+        std::cerr << "Not a trace file: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    for (const auto &record : records) {
+        const char *name = record.mnemonic < zm::MNEMONIC_COUNT ? zm::mnemonic_name(static_cast<zm::Mnemonic>(record.mnemonic)) : "?";
+
+        std::cout << std::hex << std::setw(6) << std::setfill('0') << record.pc << std::setfill(' ') << std::dec
+                  << (record.flags & zm::TRACE_IR ? " ir " : "    ")
+                  << std::string(record.depth, ' ') << name << std::hex;
+
+        for (uint8_t i = 0; i < record.operand_count && i < MAX_OPERANDS; ++i) {
+            std::cout << " " << record.operands[i];
+        }
+
+        if (record.flags & zm::TRACE_STORED) {
+            std::cout << " -> " << record.result;
+        }
+
+        if (record.flags & zm::TRACE_BRANCH) {
+            std::cout << (record.flags & zm::TRACE_TAKEN ? " ?taken" : " ?not taken");
+        }
+
+        std::cout << std::dec << "\n";
+    }
+
+    return 0;
+}
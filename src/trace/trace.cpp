@@ -0,0 +1,46 @@
+#include "trace.h"
+
+#include <cstring>
+#include <fstream>
+
+bool zm::TraceBuffer::write(const std::string &path) const {
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file) {
+        return false;
+    }
+
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t start = end > TRACE_CAPACITY ? end - TRACE_CAPACITY : 0;
+
+    TraceHeader header {};
+    std::memcpy(header.magic, TRACE_MAGIC, 4);
+    header.format = TRACE_FORMAT;
+    header.record_size = sizeof(TraceRecord);
+    header.count = static_cast<uint32_t>(end - start);
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (uint64_t i = start; i < end; ++i) {
+        file.write(reinterpret_cast<const char *>(&records[i & TRACE_MASK]), sizeof(TraceRecord));
+    }
+
+    return static_cast<bool>(file);
+}
+
+bool zm::read_trace(const std::string &path, std::vector<zm::TraceRecord> &records) {
+    std::ifstream file(path, std::ios::binary);
+    TraceHeader header {};
+
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+        return false;
+    }
+
+    if (std::memcmp(header.magic, TRACE_MAGIC, 4) != 0 || header.format != TRACE_FORMAT || header.record_size != sizeof(TraceRecord)) {
+        return false;
+    }
+
+    records.resize(header.count);
+
+    return static_cast<bool>(file.read(reinterpret_cast<char *>(records.data()), header.count * sizeof(TraceRecord)));
+}
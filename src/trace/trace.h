@@ -0,0 +1,112 @@
+#ifndef ZETAMACHINE_TRACE_H
+#define ZETAMACHINE_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../decoder.h"
+#include "../instructions.h"
+
+#define TRACE_CAPACITY_BITS 16
+#define TRACE_CAPACITY (1 << TRACE_CAPACITY_BITS)
+#define TRACE_MASK (TRACE_CAPACITY - 1)
+
+#define TRACE_MAGIC "ZMTR"
+#define TRACE_FORMAT 1
+
+namespace zm {
+    enum TraceFlags : uint8_t {
+        TRACE_STORED = 0x01,
+        TRACE_BRANCH = 0x02,
+        TRACE_TAKEN = 0x04,
+        TRACE_IR = 0x08 // Executed by the IR executor rather than the interpreter
+    };
+
+    // One executed instruction, as written to trace files
+    struct TraceRecord {
+        uint32_t pc;
+        uint16_t mnemonic;
+        uint8_t operand_count;
+        uint8_t depth; // Frames on the call stack, saturated
+        word operands[MAX_OPERANDS];
+        word result;
+        uint8_t flags;
+        uint8_t reserved;
+    };
+
+    struct TraceHeader {
+        char magic[4];
+        uint32_t format;
+        uint32_t record_size;
+        uint32_t count;
+    };
+
+    /*
+     * The latest TRACE_CAPACITY instructions of one session. The session is
+     * the only writer and publishes each record with a release store of the
+     * head, so another thread may read behind it without locking; the newest
+     * record may still get its store or branch outcome.
+     */
+    class TraceBuffer {
+    public:
+        TraceBuffer() : records(new TraceRecord[TRACE_CAPACITY]) { }
+
+        void record(address pc, Mnemonic mnemonic, uint8_t operand_count, const word *operands, size_t depth, uint8_t flags) {
+            uint64_t position = head.load(std::memory_order_relaxed);
+            TraceRecord &entry = records[position & TRACE_MASK];
+
+            entry.pc = pc;
+            entry.mnemonic = static_cast<uint16_t>(mnemonic);
+            entry.operand_count = operand_count;
+            entry.depth = static_cast<uint8_t>(depth < 0xFF ? depth : 0xFF);
+            entry.result = 0;
+            entry.flags = flags;
+
+            for (uint8_t i = 0; i < operand_count; ++i) {
+                entry.operands[i] = operands[i];
+            }
+
+            head.store(position + 1, std::memory_order_release);
+        }
+
+        void stored(word value) {
+            TraceRecord &entry = last();
+            entry.result = value;
+            entry.flags |= TRACE_STORED;
+        }
+
+        void branched(bool taken) {
+            last().flags |= taken ? TRACE_BRANCH | TRACE_TAKEN : TRACE_BRANCH;
+        }
+
+        // Writes the records still in the ring, oldest first
+        bool write(const std::string &path) const;
+
+    private:
+        std::unique_ptr<TraceRecord[]> records;
+        std::atomic<uint64_t> head { 0 };
+
+        TraceRecord &last() { return records[(head.load(std::memory_order_relaxed) - 1) & TRACE_MASK]; }
+    };
+
+    bool read_trace(const std::string &path, std::vector<TraceRecord> &records);
+}
+
+/*
+ * Hooks of the execution engines. They only record anything in builds with
+ * ZM_TRACE defined (cmake -DZM_TRACE=ON); otherwise they compile to nothing.
+ */
+#ifdef ZM_TRACE
+#define ZM_TRACE_INSTRUCTION(pc, mnemonic, count, operands, flags) trace.record((pc), (mnemonic), (count), (operands), call_stack.size(), (flags))
+#define ZM_TRACE_STORE(value) trace.stored(value)
+#define ZM_TRACE_BRANCH(taken) trace.branched(taken)
+#else
+#define ZM_TRACE_INSTRUCTION(pc, mnemonic, count, operands, flags) do { } while (0)
+#define ZM_TRACE_STORE(value) do { } while (0)
+#define ZM_TRACE_BRANCH(taken) do { } while (0)
+#endif
+
+#endif //ZETAMACHINE_TRACE_H
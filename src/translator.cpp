@@ -0,0 +1,317 @@
+#include "translator.h"
+
+#include "version.h"
+
+#include <iterator>
+#include <utility>
+
+template<uint8_t Version>
+zm::Translator<Version>::Translator(zm::Memory &memory, zm::address static_memory_base) :
+    memory(memory),
+    decoder(memory),
+    static_memory_base(static_memory_base) {
+    memory.observe_writes(this);
+}
+
+template<uint8_t Version>
+zm::Translator<Version>::~Translator() {
+    memory.ignore_writes(this);
+}
+
+template<uint8_t Version>
+bool zm::Translator<Version>::supported(zm::Mnemonic mnemonic) {
+    switch (mnemonic) {
+        // 2OP
+        case Mnemonic::JE : case Mnemonic::JL : case Mnemonic::JG : case Mnemonic::DEC_CHK : case Mnemonic::INC_CHK :
+        case Mnemonic::JIN : case Mnemonic::TEST : case Mnemonic::OR : case Mnemonic::AND : case Mnemonic::TEST_ATTR :
+        case Mnemonic::SET_ATTR : case Mnemonic::CLEAR_ATTR : case Mnemonic::STORE : case Mnemonic::INSERT_OBJ :
+        case Mnemonic::LOADW : case Mnemonic::LOADB : case Mnemonic::GET_PROP : case Mnemonic::GET_PROP_ADDR :
+        case Mnemonic::GET_NEXT_PROP : case Mnemonic::ADD : case Mnemonic::SUB : case Mnemonic::MUL : case Mnemonic::DIV :
+        case Mnemonic::MOD : case Mnemonic::CALL_2S : case Mnemonic::CALL_2N :
+        // 1OP
+        case Mnemonic::JZ : case Mnemonic::GET_SIBLING : case Mnemonic::GET_CHILD : case Mnemonic::GET_PARENT :
+        case Mnemonic::GET_PROP_LEN : case Mnemonic::INC : case Mnemonic::DEC : case Mnemonic::PRINT_ADDR :
+        case Mnemonic::CALL_1S : case Mnemonic::REMOVE_OBJ : case Mnemonic::PRINT_OBJ : case Mnemonic::RET :
+        case Mnemonic::JUMP : case Mnemonic::PRINT_PADDR : case Mnemonic::LOAD : case Mnemonic::NOT : case Mnemonic::CALL_1N :
+        // 0OP
+        case Mnemonic::RTRUE : case Mnemonic::RFALSE : case Mnemonic::PRINT : case Mnemonic::PRINT_RET : case Mnemonic::NOP :
+        case Mnemonic::RET_POPPED : case Mnemonic::POP : case Mnemonic::QUIT : case Mnemonic::NEW_LINE :
+        case Mnemonic::SHOW_STATUS : case Mnemonic::VERIFY : case Mnemonic::PIRACY :
+        // VAR
+        case Mnemonic::CALL : case Mnemonic::CALL_VS : case Mnemonic::CALL_VS2 : case Mnemonic::CALL_VN : case Mnemonic::CALL_VN2 :
+        case Mnemonic::STOREW : case Mnemonic::STOREB : case Mnemonic::PUT_PROP : case Mnemonic::SREAD : case Mnemonic::AREAD :
+        case Mnemonic::PRINT_CHAR : case Mnemonic::PRINT_NUM : case Mnemonic::RANDOM : case Mnemonic::PUSH : case Mnemonic::PULL :
+        case Mnemonic::OUTPUT_STREAM : case Mnemonic::COPY_TABLE : case Mnemonic::PRINT_TABLE : case Mnemonic::CHECK_ARG_COUNT :
+        case Mnemonic::SPLIT_WINDOW : case Mnemonic::SET_WINDOW : case Mnemonic::ERASE_WINDOW : case Mnemonic::ERASE_LINE :
+        case Mnemonic::SET_CURSOR : case Mnemonic::SET_TEXT_STYLE : case Mnemonic::BUFFER_MODE : case Mnemonic::INPUT_STREAM :
+        case Mnemonic::SOUND_EFFECT : case Mnemonic::SET_COLOUR : case Mnemonic::SET_TRUE_COLOUR :
+        // EXT
+        case Mnemonic::LOG_SHIFT : case Mnemonic::ART_SHIFT : case Mnemonic::SET_FONT : case Mnemonic::PRINT_UNICODE :
+        case Mnemonic::CHECK_UNICODE :
+            return true;
+
+        // Everything that needs the real stack or the whole machine state (catch, throw, save...)
+        default :
+            return false;
+    }
+}
+
+template<uint8_t Version>
+bool zm::Translator<Version>::convert_variable(zm::word variable, uint8_t locals, int depth, zm::Register &ir) {
+    if (variable == 0x00) {
+        // Top of stack, in place
+        if (depth == 0) {
+            return false;
+        }
+
+        ir = Register { RegisterType::TEMPORARY, static_cast<word>(depth - 1) };
+    } else if (variable <= 0x0F) {
+        if (variable > locals) {
+            return false;
+        }
+
+        ir = Register { RegisterType::LOCAL, static_cast<word>(variable - 1) };
+    } else if (variable <= 0xFF) {
+        ir = Register { RegisterType::GLOBAL, static_cast<word>(variable - 0x10) };
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Rewrites one instruction in terms of registers, following what it does to
+ * the stack: operands read from it in order, then the result pushed.
+ */
+template<uint8_t Version>
+bool zm::Translator<Version>::convert(const zm::DecodedInstruction &decoded, uint8_t locals, int &depth, zm::IrInstruction &ir) {
+    const Instruction &instruction = decoded.instruction;
+    Mnemonic mnemonic = instruction.mnemonic;
+
+    if (!supported(mnemonic)) {
+        return false;
+    }
+
+    ir.instruction = instruction;
+    ir.operand_count = decoded.operand_count;
+    ir.text_address = decoded.text_address;
+    ir.next_pc = decoded.next_pc;
+    ir.depth = static_cast<uint8_t>(depth);
+    ir.reads_input = decoded.reads_input;
+    ir.branch_on_true = decoded.branch_on_true;
+
+    bool by_reference = mnemonic == Mnemonic::STORE || mnemonic == Mnemonic::LOAD || mnemonic == Mnemonic::INC ||
+            mnemonic == Mnemonic::DEC || mnemonic == Mnemonic::INC_CHK || mnemonic == Mnemonic::DEC_CHK ||
+            (mnemonic == Mnemonic::PULL && !instruction.store);
+
+    // Version 6 pull from a user stack
+    if (mnemonic == Mnemonic::PULL && instruction.store && decoded.operand_count > 0) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < decoded.operand_count; ++i) {
+        const Operand &operand = decoded.operands[i];
+
+        if (i == 0 && by_reference) {
+            // The variable must be known now, and is resolved once the other operands are read
+            if (operand.type == OperandType::VARIABLE_NUMBER) {
+                return false;
+            }
+        } else if (operand.type != OperandType::VARIABLE_NUMBER) {
+            ir.operands[i] = Register { RegisterType::CONSTANT, operand.value };
+        } else if (operand.value == 0x00) {
+            if (depth == 0) {
+                return false;
+            }
+
+            ir.operands[i] = Register { RegisterType::TEMPORARY, static_cast<word>(--depth) };
+        } else if (!convert_variable(operand.value, locals, depth, ir.operands[i])) {
+            return false;
+        }
+    }
+
+    // Instructions which pop without naming the stack in an operand
+    if (mnemonic == Mnemonic::PULL || mnemonic == Mnemonic::RET_POPPED || mnemonic == Mnemonic::POP) {
+        if (depth == 0) {
+            return false;
+        }
+
+        // The popped value becomes the last operand
+        ir.operands[ir.operand_count++] = Register { RegisterType::TEMPORARY, static_cast<word>(--depth) };
+    }
+
+    if (by_reference && decoded.operand_count > 0 && !convert_variable(decoded.operands[0].value, locals, depth, ir.operands[0])) {
+        return false;
+    }
+
+    if (mnemonic == Mnemonic::PUSH) {
+        ir.store = Register { RegisterType::TEMPORARY, static_cast<word>(depth++) };
+    } else if (instruction.store) {
+        if (decoded.store_variable == 0x00) {
+            ir.store = Register { RegisterType::TEMPORARY, static_cast<word>(depth++) };
+        } else if (!convert_variable(decoded.store_variable, locals, depth, ir.store)) {
+            return false;
+        }
+    }
+
+    return depth <= 0xFF;
+}
+
+template<uint8_t Version>
+std::unique_ptr<zm::TranslatedRoutine> zm::Translator<Version>::build(zm::word packed, zm::address routine_address) {
+    uint8_t locals = memory.read_byte(routine_address) & 0x0F;
+    address start = routine_address + 1 + (VersionTraits<Version>::routine_default_locals ? locals << 1 : 0);
+
+    std::unique_ptr<TranslatedRoutine> routine { new TranslatedRoutine { packed, routine_address, start, 0, { }, true, 0, nullptr, nullptr } };
+
+    // Walk all the code reachable from the start, carrying the stack depth along
+    std::map<address, IrInstruction> code;
+    std::vector<std::pair<address, int>> pending { { start, 0 } };
+
+    while (!pending.empty()) {
+        address pc = pending.back().first;
+        int depth = pending.back().second;
+        pending.pop_back();
+
+        auto seen = code.find(pc);
+
+        if (seen != code.end()) {
+            // Joining paths must agree on the stack, or the temporaries would not line up
+            if (seen->second.depth != depth) {
+                return nullptr;
+            }
+
+            continue;
+        }
+
+        if (pc < routine->begin || pc >= memory.capacity() || code.size() >= MAX_TRANSLATED_INSTRUCTIONS) {
+            return nullptr;
+        }
+
+        DecodedInstruction decoded = decoder.decode(pc);
+        IrInstruction ir {};
+
+        if (!convert(decoded, locals, depth, ir)) {
+            return nullptr;
+        }
+
+        ir.pc = pc;
+
+        if (decoded.next_pc > routine->end) {
+            routine->end = decoded.next_pc;
+        }
+
+        if (depth > routine->max_depth) {
+            routine->max_depth = static_cast<uint8_t>(depth);
+        }
+
+        Mnemonic mnemonic = decoded.instruction.mnemonic;
+
+        // Targets are addresses until the layout is known
+        if (decoded.instruction.branch) {
+            switch (decoded.branch_offset) {
+                case 0 : ir.target = IR_RETURN_FALSE; break;
+                case 1 : ir.target = IR_RETURN_TRUE; break;
+                default :
+                    ir.target = decoded.next_pc + decoded.branch_offset - 2;
+                    pending.emplace_back(ir.target, depth);
+            }
+        }
+
+        if (mnemonic == Mnemonic::JUMP) {
+            if (decoded.operands[0].type == OperandType::VARIABLE_NUMBER) {
+                return nullptr;
+            }
+
+            ir.target = decoded.next_pc + static_cast<int16_t>(decoded.operands[0].value) - 2;
+            pending.emplace_back(ir.target, depth);
+        }
+
+        bool ends = mnemonic == Mnemonic::JUMP || mnemonic == Mnemonic::RET || mnemonic == Mnemonic::RTRUE ||
+                mnemonic == Mnemonic::RFALSE || mnemonic == Mnemonic::RET_POPPED || mnemonic == Mnemonic::PRINT_RET ||
+                mnemonic == Mnemonic::QUIT;
+
+        if (!ends) {
+            pending.emplace_back(decoded.next_pc, depth);
+        }
+
+        code.emplace(pc, ir);
+    }
+
+    // Lay the instructions out in address order, so falling through is going to the next one
+    std::unordered_map<address, uint32_t> indices;
+
+    for (auto it = code.begin(); it != code.end(); ++it) {
+        indices[it->first] = static_cast<uint32_t>(routine->code.size());
+        routine->code.push_back(it->second);
+
+        // Instructions overlapping each other can not be laid out that way
+        auto next = std::next(it);
+
+        if (next != code.end() && next->first < it->second.next_pc) {
+            return nullptr;
+        }
+    }
+
+    for (auto &ir : routine->code) {
+        bool jumps = ir.instruction.branch || ir.instruction.mnemonic == Mnemonic::JUMP;
+
+        if (jumps && ir.target < IR_RETURN_FALSE) {
+            ir.target = indices[ir.target];
+        }
+    }
+
+    return routine;
+}
+
+template<uint8_t Version>
+zm::TranslatedRoutine *zm::Translator<Version>::translate(zm::word packed, zm::address routine_address) {
+    auto found = routines.find(packed);
+
+    if (found != routines.end()) {
+        return found->second.get();
+    }
+
+    auto &routine = routines[packed];
+    routine = build(packed, routine_address);
+
+    if (routine && routine->begin < static_memory_base) {
+        watched.push_back(routine.get());
+        memory.extend_watch_limit(routine->end);
+    }
+
+    return routine.get();
+}
+
+template<uint8_t Version>
+void zm::Translator<Version>::notify_write(uint32_t address, uint32_t length) {
+    for (size_t i = 0; i < watched.size(); ) {
+        TranslatedRoutine *routine = watched[i];
+
+        if (address >= routine->end || address + length <= routine->begin) {
+            ++i;
+            continue;
+        }
+
+        // Retire it: the next call translates the new code
+        routine->valid = false;
+        invalidation = true;
+
+        auto found = routines.find(routine->packed);
+        retired.push_back(std::move(found->second));
+        routines.erase(found);
+
+        watched[i] = watched.back();
+        watched.pop_back();
+    }
+}
+
+template class zm::Translator<1>;
+template class zm::Translator<2>;
+template class zm::Translator<3>;
+template class zm::Translator<4>;
+template class zm::Translator<5>;
+template class zm::Translator<6>;
+template class zm::Translator<7>;
+template class zm::Translator<8>;
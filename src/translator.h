@@ -0,0 +1,117 @@
+#ifndef ZETAMACHINE_TRANSLATOR_H
+#define ZETAMACHINE_TRANSLATOR_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "decoder.h"
+#include "instructions.h"
+#include "memory/memory.h"
+
+// Routines with more instructions than this are left to the interpreter
+#define MAX_TRANSLATED_INSTRUCTIONS 4096
+
+namespace zm {
+    /*
+     * Where an IR operand lives. Locals and stack temporaries are registers of
+     * the frame; the stack depth is known at every instruction, so stack slot n
+     * is simply TEMPORARY n and nothing is ever pushed or popped.
+     */
+    enum class RegisterType : uint8_t {
+        NONE,
+        CONSTANT,
+        LOCAL,
+        TEMPORARY,
+        GLOBAL
+    };
+
+    struct Register {
+        RegisterType type;
+        word value; // The constant, or the local/temporary/global number
+    };
+
+    // Branch targets that leave the routine instead
+    constexpr uint32_t IR_RETURN_FALSE = 0xFFFFFFFE;
+    constexpr uint32_t IR_RETURN_TRUE = 0xFFFFFFFF;
+
+    struct IrInstruction {
+        Instruction instruction;
+        uint8_t operand_count;
+        Register operands[MAX_OPERANDS]; // Instructions taking a variable by reference get it as operand 0
+        Register store;
+
+        bool branch_on_true;
+        uint32_t target; // IR index of the branch or jump destination
+
+        address text_address;
+        address pc;
+        address next_pc;
+        uint8_t depth; // Stack depth before the instruction
+        bool reads_input;
+    };
+
+    struct NativeRoutine;
+    struct AotRoutine;
+
+    struct TranslatedRoutine {
+        word packed;
+        address begin; // Bytes the translation was made from
+        address end;
+        uint8_t max_depth;
+        std::vector<IrInstruction> code;
+
+        bool valid; // Cleared when the code is written to; frames still running it fall back to the interpreter
+        uint32_t calls;
+        const NativeRoutine *native; // Compiled by the JIT...
+        const AotRoutine *compiled; // ...or ahead of time
+    };
+
+    /*
+     * Translates routines, the first time they are called, into a register
+     * based IR. Only routines whose reachable code has a consistent stack depth
+     * and only uses instructions the IR executor implements are translated; the
+     * others keep running on the interpreter.
+     *
+     * Translations made from dynamic memory are watched, and retired as soon as
+     * any of their bytes are written to.
+     */
+    template<uint8_t Version>
+    class Translator : public WriteObserver {
+    public:
+        Translator(Memory &memory, address static_memory_base);
+        ~Translator() override;
+
+        // Translation of the routine at this packed address, nullptr if it has to be interpreted
+        TranslatedRoutine *translate(word packed, address routine_address);
+
+        // Whether a translation was retired since the last acknowledge()
+        bool invalidated() const { return invalidation; }
+        void acknowledge() { invalidation = false; }
+
+        void notify_write(uint32_t address, uint32_t length) override;
+
+        static bool supported(Mnemonic mnemonic);
+
+    private:
+        Memory &memory;
+        Decoder<Version> decoder;
+        address static_memory_base;
+
+        // Failed translations are remembered too, as nullptr
+        std::unordered_map<word, std::unique_ptr<TranslatedRoutine>> routines;
+
+        // Translations from dynamic memory, and the ones retired (frames may still point to them)
+        std::vector<TranslatedRoutine *> watched;
+        std::vector<std::unique_ptr<TranslatedRoutine>> retired;
+        bool invalidation = false;
+
+        std::unique_ptr<TranslatedRoutine> build(word packed, address routine_address);
+        bool convert(const DecodedInstruction &decoded, uint8_t locals, int &depth, IrInstruction &ir);
+        bool convert_variable(word variable, uint8_t locals, int depth, Register &ir);
+    };
+}
+
+#endif //ZETAMACHINE_TRANSLATOR_H
@@ -0,0 +1,77 @@
+#ifndef ZETAMACHINE_VERSION_H
+#define ZETAMACHINE_VERSION_H
+
+#include <cstdint>
+
+#define MIN_VERSION 1
+#define MAX_VERSION 8
+
+namespace zm {
+    /*
+     * Everything that changes between story versions, resolved at compile time.
+     * Code templated on the version reads these instead of switching on the
+     * version byte, so the version checks fold away entirely.
+     */
+    template<uint8_t Version>
+    struct VersionTraits {
+        static_assert(Version >= MIN_VERSION && Version <= MAX_VERSION, "Unsupported story version");
+
+        static constexpr uint8_t version = Version;
+
+        // Routines carry default values for their locals up to version 4
+        static constexpr bool routine_default_locals = Version <= 4;
+
+        // Packed addresses: 2P, 4P, 4P + 8R_O/8S_O (versions 6 and 7) or 8P
+        static constexpr uint8_t packed_shift = Version <= 3 ? 1 : (Version <= 7 ? 2 : 3);
+        static constexpr bool packed_offsets = Version == 6 || Version == 7;
+
+        static constexpr uint32_t unpack_routine(uint16_t packed, uint16_t routines_offset) {
+            return (static_cast<uint32_t>(packed) << packed_shift) + (packed_offsets ? (static_cast<uint32_t>(routines_offset) << 3) : 0);
+        }
+
+        static constexpr uint32_t unpack_string(uint16_t packed, uint16_t static_strings_offset) {
+            return (static_cast<uint32_t>(packed) << packed_shift) + (packed_offsets ? (static_cast<uint32_t>(static_strings_offset) << 3) : 0);
+        }
+
+        // Object table layout
+        static constexpr bool small_objects = Version <= 3;
+        static constexpr uint8_t object_entry_size = small_objects ? 9 : 14;
+        static constexpr uint8_t object_link_size = small_objects ? 1 : 2;
+        static constexpr uint8_t object_attribute_bytes = small_objects ? 4 : 6;
+        static constexpr uint8_t object_parent_offset = object_attribute_bytes;
+        static constexpr uint8_t object_sibling_offset = object_parent_offset + object_link_size;
+        static constexpr uint8_t object_child_offset = object_sibling_offset + object_link_size;
+        static constexpr uint8_t object_properties_offset = object_child_offset + object_link_size;
+        static constexpr uint8_t attribute_count = small_objects ? 32 : 48;
+        static constexpr uint8_t property_defaults = small_objects ? 31 : 63;
+        static constexpr uint16_t property_defaults_size = property_defaults << 1;
+
+        // Dictionary words are truncated to 6 or 9 Z-characters
+        static constexpr uint8_t dictionary_word_zchars = Version <= 3 ? 6 : 9;
+        static constexpr uint8_t dictionary_word_bytes = (dictionary_word_zchars / 3) << 1;
+
+        // Text buffers of READ hold a length byte from version 5 on
+        static constexpr uint8_t text_buffer_start = Version <= 4 ? 1 : 2;
+    };
+
+    /*
+     * Calls function.apply<V>() with the story version as a
+     * template argument; the one place where the runtime version byte
+     * picks a compile-time specialization.
+     */
+    template<typename Function>
+    auto dispatch_version(uint8_t version, Function &&function) -> decltype(function.template apply<5>()) {
+        switch (version) {
+            case 1 : return function.template apply<1>();
+            case 2 : return function.template apply<2>();
+            case 3 : return function.template apply<3>();
+            case 4 : return function.template apply<4>();
+            case 6 : return function.template apply<6>();
+            case 7 : return function.template apply<7>();
+            case 8 : return function.template apply<8>();
+            default : return function.template apply<5>();
+        }
+    }
+}
+
+#endif //ZETAMACHINE_VERSION_H
@@ -1 +1,7 @@
 #include "video.h"
+
+#include <iostream>
+
+void zm::Video::print(const std::string &text) {
+    std::cout << text;
+}
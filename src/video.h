@@ -3,10 +3,19 @@
 
 
 #include <cstdint>
+#include <string>
 
 namespace zm {
+    /*
+     * Where the story's text ends up. The default implementation writes
+     * to standard output; headless sessions override print().
+     */
     class Video {
     public:
+        virtual ~Video() = default;
+
+        virtual void print(const std::string &text);
+
         uint8_t line_height();
         uint8_t character_width();
 
@@ -0,0 +1,128 @@
+#include "walkthrough.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Nearest rank, of values sorted in ascending order
+static double percentile(const std::vector<double> &values, double rank) {
+    if (values.empty()) {
+        return 0.0;
+    }
+
+    auto index = static_cast<size_t>(std::ceil(rank / 100.0 * static_cast<double>(values.size())));
+    return values[std::min(values.size(), std::max<size_t>(index, 1)) - 1];
+}
+
+/*
+ * Plays every story in a directory with its script, on all cores, and
+ * compares the transcripts with the golden ones. Reports instructions per
+ * second and turn latencies per story; fails if any transcript differs.
+ */
+int main(int argc, char *argv[]) {
+    std::string directory;
+    zm::Options options;
+    unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+    bool update = false;
+
+    // Transcripts only compare if the random numbers do
+    options.seed = 12345;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string argument = argv[i];
+
+        if (argument == "--jobs" && i + 1 < argc) {
+            jobs = static_cast<unsigned>(std::max(1, std::stoi(argv[++i])));
+        } else if (argument == "--update") {
+            update = true;
+        } else if (argument == "--seed" && i + 1 < argc) {
+            options.seed = static_cast<uint16_t>(std::stoi(argv[++i]));
+        } else if (argument == "--no-fusion") {
+            options.fusion = false;
+        } else if (argument == "--no-translation") {
+            options.translation = false;
+        } else if (argument == "--jit") {
+            options.jit = true;
+        } else if (argument == "--checked") {
+            options.checked = true;
+        } else if (directory.empty() && argument[0] != '-') {
+            directory = argument;
+        } else {
+            directory.clear();
+            break;
+        }
+    }
+
+    if (directory.empty()) {
+        std::cerr << "Usage: zetamachine_walkthrough [--jobs <n>] [--update] [--seed <n>] [--no-fusion] [--no-translation] [--jit] [--checked] <directory>" << std::endl;
+        return 1;
+    }
+
+    auto walkthroughs = zm::find_walkthroughs(directory);
+
+    if (walkthroughs.empty()) {
+        std::cerr << "No story files in " << directory << std::endl;
+        return 1;
+    }
+
+    // Workers take the next walkthrough until there are none left
+    std::vector<zm::WalkthroughResult> results(walkthroughs.size());
+    std::atomic<size_t> next { 0 };
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned worker = 0; worker < std::min<size_t>(jobs, walkthroughs.size()); ++worker) {
+        workers.emplace_back([&]() {
+            for (size_t i = next++; i < walkthroughs.size(); i = next++) {
+                results[i] = zm::play(walkthroughs[i], options, update);
+            }
+        });
+    }
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::left << std::setw(24) << "story" << std::setw(9) << "result" << std::right << std::setw(14) << "instructions"
+              << std::setw(14) << "instr/s" << std::setw(7) << "turns" << std::setw(10) << "p50 ms" << std::setw(10) << "p90 ms"
+              << std::setw(10) << "p99 ms" << std::setw(10) << "max ms" << "\n";
+
+    int failures = 0;
+    uint64_t instructions = 0;
+    double busy = 0.0;
+
+    for (size_t i = 0; i < walkthroughs.size(); ++i) {
+        auto &result = results[i];
+        std::sort(result.turns.begin(), result.turns.end());
+
+        std::cout << std::left << std::setw(24) << walkthroughs[i].name << std::setw(9) << zm::verdict_name(result.verdict) << std::right
+                  << std::setw(14) << result.instructions << std::setw(14) << std::fixed << std::setprecision(0)
+                  << (result.seconds > 0.0 ? static_cast<double>(result.instructions) / result.seconds : 0.0)
+                  << std::setw(7) << result.turns.size() << std::setprecision(3)
+                  << std::setw(10) << percentile(result.turns, 50) << std::setw(10) << percentile(result.turns, 90)
+                  << std::setw(10) << percentile(result.turns, 99) << std::setw(10) << (result.turns.empty() ? 0.0 : result.turns.back()) << "\n";
+
+        if (!result.difference.empty()) {
+            std::cout << "    " << result.difference << "\n";
+        }
+
+        failures += result.verdict == zm::Verdict::FAILED || result.verdict == zm::Verdict::BROKEN;
+        instructions += result.instructions;
+        busy += result.seconds;
+    }
+
+    std::cout << walkthroughs.size() << " stories, " << failures << " failed, " << instructions << " instructions in "
+              << std::setprecision(3) << wall << " s on " << workers.size() << " threads (" << std::setprecision(0)
+              << static_cast<double>(instructions) / wall << " instr/s, " << std::setprecision(2) << busy / wall << "x parallel)" << std::endl;
+
+    return failures == 0 ? 0 : 2;
+}
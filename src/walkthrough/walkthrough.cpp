@@ -0,0 +1,141 @@
+#include "walkthrough.h"
+
+#include "../headless.h"
+#include "../machine.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+
+static bool read_file(const std::string &path, std::string &contents) {
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file) {
+        return false;
+    }
+
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+static bool exists(const std::string &path) {
+    return static_cast<bool>(std::ifstream(path));
+}
+
+std::vector<zm::Walkthrough> zm::find_walkthroughs(const std::string &directory) {
+    std::vector<Walkthrough> walkthroughs;
+    DIR *listing = opendir(directory.c_str());
+
+    if (!listing) {
+        return walkthroughs;
+    }
+
+    while (dirent *entry = readdir(listing)) {
+        std::string name = entry->d_name;
+        size_t length = name.size();
+
+        if (length < 4 || name[length - 3] != '.' || name[length - 2] != 'z' || name[length - 1] < '1' || name[length - 1] > '8') {
+            continue;
+        }
+
+        std::string story = directory + "/" + name;
+        walkthroughs.push_back({ name, story, exists(story + ".txt") ? story + ".txt" : "", story + ".golden" });
+    }
+
+    closedir(listing);
+
+    std::sort(walkthroughs.begin(), walkthroughs.end(), [](const Walkthrough &a, const Walkthrough &b) { return a.name < b.name; });
+    return walkthroughs;
+}
+
+// Line number and both versions of the first line that differs
+static std::string first_difference(const std::string &expected, const std::string &actual) {
+    std::istringstream expected_lines(expected);
+    std::istringstream actual_lines(actual);
+    std::string a, b;
+
+    for (int line = 1; ; ++line) {
+        bool more_expected = static_cast<bool>(std::getline(expected_lines, a));
+        bool more_actual = static_cast<bool>(std::getline(actual_lines, b));
+
+        if (!more_expected && !more_actual) {
+            return "";
+        }
+
+        if (!more_expected || !more_actual || a != b) {
+            return "line " + std::to_string(line) + ": expected \"" + (more_expected ? a : "<end>") + "\", got \"" + (more_actual ? b : "<end>") + "\"";
+        }
+    }
+}
+
+zm::WalkthroughResult zm::play(const Walkthrough &walkthrough, const Options &options, bool update) {
+    WalkthroughResult result { Verdict::BROKEN, 0, 0.0, {}, "" };
+
+    std::string image;
+    std::string script;
+
+    if (!read_file(walkthrough.story, image) || image.empty() || (!walkthrough.script.empty() && !read_file(walkthrough.script, script))) {
+        result.difference = "could not read the story or its script";
+        return result;
+    }
+
+    std::vector<std::string> lines;
+    std::istringstream script_lines(script);
+
+    for (std::string line; std::getline(script_lines, line); ) {
+        lines.push_back(line);
+    }
+
+    Transcript transcript;
+    ScriptedInput input { lines, &transcript };
+
+    Machine machine {};
+    machine.configure(options);
+    machine.attach(&transcript, &input);
+
+    auto start = std::chrono::steady_clock::now();
+    result.instructions = machine.run(std::vector<uint8_t>(image.begin(), image.end()));
+    auto end = std::chrono::steady_clock::now();
+
+    result.seconds = std::chrono::duration<double>(end - start).count();
+
+    // A turn ends when the story asks for the next line, the first one starts with the story
+    auto previous = start;
+
+    for (auto request : input.get_requests()) {
+        result.turns.push_back(std::chrono::duration<double, std::milli>(request - previous).count());
+        previous = request;
+    }
+
+    result.turns.push_back(std::chrono::duration<double, std::milli>(end - previous).count());
+
+    std::string golden;
+
+    if (!read_file(walkthrough.golden, golden)) {
+        result.verdict = Verdict::NEW;
+    } else {
+        result.difference = first_difference(golden, transcript.text());
+        result.verdict = result.difference.empty() ? Verdict::PASSED : (update ? Verdict::UPDATED : Verdict::FAILED);
+    }
+
+    if (update && result.verdict != Verdict::PASSED) {
+        std::ofstream file(walkthrough.golden, std::ios::binary);
+        file << transcript.text();
+    }
+
+    return result;
+}
+
+const char *zm::verdict_name(Verdict verdict) {
+    switch (verdict) {
+        case Verdict::PASSED : return "passed";
+        case Verdict::FAILED : return "FAILED";
+        case Verdict::NEW : return "new";
+        case Verdict::UPDATED : return "updated";
+        case Verdict::BROKEN : return "BROKEN";
+    }
+
+    return "";
+}
@@ -0,0 +1,51 @@
+#ifndef ZETAMACHINE_WALKTHROUGH_H
+#define ZETAMACHINE_WALKTHROUGH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../options.h"
+
+namespace zm {
+    // A story, the commands typed into it and the transcript it should give
+    struct Walkthrough {
+        std::string name;
+        std::string story;
+        std::string script; // Empty when nothing is typed
+        std::string golden;
+    };
+
+    enum class Verdict {
+        PASSED,
+        FAILED,
+        NEW, // No transcript to compare with yet
+        UPDATED,
+        BROKEN // The story could not be read
+    };
+
+    struct WalkthroughResult {
+        Verdict verdict;
+        uint64_t instructions;
+        double seconds;
+        std::vector<double> turns; // Milliseconds, from one line asked for to the next
+        std::string difference; // The first line that differs from the golden transcript
+    };
+
+    /*
+     * Every story file (.z1 to .z8) in a directory, with its script next to
+     * it as <story>.txt and its golden transcript as <story>.golden.
+     */
+    std::vector<Walkthrough> find_walkthroughs(const std::string &directory);
+
+    /*
+     * Plays a walkthrough headless and compares its transcript. Sessions share
+     * nothing, so any number of them can be played at once. With update, new
+     * and different transcripts are written as the golden ones.
+     */
+    WalkthroughResult play(const Walkthrough &walkthrough, const Options &options, bool update);
+
+    const char *verdict_name(Verdict verdict);
+}
+
+#endif //ZETAMACHINE_WALKTHROUGH_H